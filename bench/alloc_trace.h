@@ -0,0 +1,41 @@
+#ifndef ALLOC_TRACE_H
+#define ALLOC_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Binary allocation trace written by trace_record.cpp and read by trace_replay.
+ * A TraceHeader followed by fixed size TraceRecords, all in host byte order.
+ * Pointers are replaced by ids: every successful allocation gets a new id,
+ * 0 stands for NULL (or for a pointer the recorder never saw).
+ */
+
+#define TRACE_MAGIC "SMTRACE"
+#define TRACE_VERSION (1)
+
+enum TraceOp { TRACE_SMALLOC, TRACE_SCALLOC, TRACE_SFREE, TRACE_SREALLOC, TRACE_SMEMALIGN, TRACE_OP_COUNT };
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+struct TraceRecord {
+    uint64_t timestamp_ns; /*since the first traced call*/
+    uint64_t size; /*bytes requested, num*size for scalloc*/
+    uint32_t id; /*id of the returned pointer*/
+    uint32_t old_id; /*id of the pointer passed in (sfree, srealloc)*/
+    uint32_t thread; /*kernel thread id of the caller*/
+    uint16_t alignment; /*log2 of the alignment for smemalign*/
+    uint8_t op;
+    uint8_t reserved;
+};
+
+inline const char* traceOpName(int op)
+{
+    static const char* names[TRACE_OP_COUNT] = { "smalloc", "scalloc", "sfree", "srealloc", "smemalign" };
+    return names[op];
+}
+
+#endif /* ALLOC_TRACE_H */
@@ -0,0 +1,38 @@
+#ifndef BENCH_ENGINE_H
+#define BENCH_ENGINE_H
+
+#include <stddef.h>
+
+/*
+ * The allocator interface as seen by the benchmarks. Every malloc_N.cpp build
+ * links against this, but malloc_1 only has smalloc and the glibc baseline has
+ * no stats, so everything beyond smalloc is weak: missing functions resolve to
+ * NULL and can be checked with engineHas().
+ */
+
+#ifndef BENCH_ENGINE
+#define BENCH_ENGINE "unknown"
+#endif
+
+void *smalloc(size_t size);
+void *scalloc(size_t num, size_t size) __attribute__((weak));
+void sfree(void *p) __attribute__((weak));
+void *srealloc(void *oldp, size_t size) __attribute__((weak));
+void *smemalign(size_t alignment, size_t size) __attribute__((weak));
+
+size_t _num_free_blocks() __attribute__((weak));
+size_t _num_free_bytes() __attribute__((weak));
+size_t _num_allocated_blocks() __attribute__((weak));
+size_t _num_allocated_bytes() __attribute__((weak));
+size_t _num_meta_data_bytes() __attribute__((weak));
+size_t _size_meta_data() __attribute__((weak));
+size_t _largest_free_block() __attribute__((weak));
+double _external_fragmentation() __attribute__((weak));
+size_t _num_mapped_bytes() __attribute__((weak));
+
+typedef int (*heap_walk_callback)(void *ptr, size_t size, bool is_free, bool is_mmapped, void *ctx);
+size_t _heap_walk(heap_walk_callback callback, void *ctx) __attribute__((weak));
+
+#define engineHas(function) ((function) != NULL)
+
+#endif /* BENCH_ENGINE_H */
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sched.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * Stores and checks benchmark baselines.
+ *
+ *   bench_regress save BASELINE [options] -- COMMAND [ARGS...]
+ *   bench_regress compare BASELINE [options] -- COMMAND [ARGS...]
+ *
+ *   --repeats N      runs of COMMAND (default 10)
+ *   --cpu K          pin COMMAND to cpu K (default: the first cpu we may run on, -1 for none)
+ *   --alpha A        significance level over all keys (default 0.01)
+ *   --threshold PCT  slowdowns below this are never reported (default 10)
+ *   --report FILE    also write the report to FILE
+ *
+ * COMMAND must print CSV with a header line, like micro_bench does. The last
+ * column is the measurement (lower is better), every non numeric column before
+ * it is part of the key. save writes every sample of every key to BASELINE.
+ * compare reruns COMMAND and flags a key as FAIL when a one sided Mann-Whitney U
+ * test says the new samples are larger with p < alpha / keys (Bonferroni, one
+ * benchmark run reports many keys) and the median got slower by more than the
+ * threshold; the exit code is 1 if any key failed, and 77
+ * (ctest's skip code) if BASELINE does not exist.
+ */
+
+#define SKIP_EXIT_CODE (77)
+
+typedef std::map<std::string, std::vector<double>> Samples;
+
+struct Options {
+    bool save;
+    const char* baseline_path;
+    int repeats;
+    int cpu;
+    double alpha;
+    double threshold_percent;
+    const char* report_path;
+    char** command;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s save|compare BASELINE [--repeats N] [--cpu K] [--alpha A] [--threshold PCT] [--report FILE] -- COMMAND [ARGS...]\n", prog);
+    exit(2);
+}
+
+static int firstAllowedCpu()
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        return -1;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    if (argc < 3) {
+        usage(argv[0]);
+    }
+
+    Options options = { false, argv[2], 10, firstAllowedCpu(), 0.01, 10, NULL, NULL };
+    if (strcmp(argv[1], "save") == 0) {
+        options.save = true;
+    } else if (strcmp(argv[1], "compare") != 0) {
+        usage(argv[0]);
+    }
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            options.command = argv + i + 1;
+            break;
+        }
+
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--repeats") == 0) {
+            options.repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpu") == 0) {
+            options.cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--alpha") == 0) {
+            options.alpha = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threshold") == 0) {
+            options.threshold_percent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--report") == 0) {
+            options.report_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.command == NULL || options.command[0] == NULL || options.repeats < 2) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static bool isNumber(const std::string& field)
+{
+    char* end;
+    strtod(field.c_str(), &end);
+    return !field.empty() && *end == '\0';
+}
+
+static std::vector<std::string> splitCsv(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t comma = line.find(',', start);
+        fields.push_back(line.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        if (comma == std::string::npos) {
+            return fields;
+        }
+        start = comma + 1;
+    }
+}
+
+/* Adds one sample per CSV row of the command's output */
+static void parseRun(const std::string& output, Samples* samples)
+{
+    size_t start = 0;
+    bool header = true;
+    while (start < output.size()) {
+        size_t end = output.find('\n', start);
+        std::string line = output.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        start = end == std::string::npos ? output.size() : end + 1;
+        if (header || line.empty()) {
+            header = false;
+            continue;
+        }
+
+        std::vector<std::string> fields = splitCsv(line);
+        if (fields.size() < 2 || !isNumber(fields.back())) {
+            continue;
+        }
+
+        std::string key;
+        for (size_t i = 0; i + 1 < fields.size(); i++) {
+            if (!isNumber(fields[i])) {
+                key += key.empty() ? fields[i] : "/" + fields[i];
+            }
+        }
+        (*samples)[key].push_back(atof(fields.back().c_str()));
+    }
+}
+
+static bool runOnce(const Options& options, std::string* output)
+{
+    int pipe_fds[2];
+    if (pipe(pipe_fds) == -1) {
+        perror("pipe");
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+
+    if (pid == 0) {
+        if (options.cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(options.cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+                perror("sched_setaffinity");
+            }
+        }
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        execvp(options.command[0], options.command);
+        perror(options.command[0]);
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+    char buf[4096];
+    ssize_t got;
+    while ((got = read(pipe_fds[0], buf, sizeof(buf))) > 0 || (got == -1 && errno == EINTR)) {
+        if (got > 0) {
+            output->append(buf, (size_t)got);
+        }
+    }
+    close(pipe_fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed\n", options.command[0]);
+        return false;
+    }
+
+    return true;
+}
+
+static bool runRepeated(const Options& options, Samples* samples)
+{
+    for (int run = 0; run < options.repeats; run++) {
+        std::string output;
+        if (!runOnce(options, &output)) {
+            return false;
+        }
+        parseRun(output, samples);
+    }
+
+    return true;
+}
+
+static bool saveBaseline(const char* path, const Options& options, const Samples& samples)
+{
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return false;
+    }
+
+    fprintf(out, "# bench_regress baseline of");
+    for (char** arg = options.command; *arg != NULL; arg++) {
+        fprintf(out, " %s", *arg);
+    }
+    fprintf(out, "\nkey,sample\n");
+    for (const auto& entry : samples) {
+        for (double sample : entry.second) {
+            fprintf(out, "%s,%.6g\n", entry.first.c_str(), sample);
+        }
+    }
+
+    fclose(out);
+    return true;
+}
+
+static bool loadBaseline(const char* path, Samples* samples)
+{
+    FILE* in = fopen(path, "r");
+    if (in == NULL) {
+        return false;
+    }
+
+    std::string text;
+    char buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), in)) > 0) {
+        text.append(buf, got);
+    }
+    fclose(in);
+
+    /*drop the comment line, parseRun skips the header*/
+    if (!text.empty() && text[0] == '#') {
+        size_t newline = text.find('\n');
+        text = newline == std::string::npos ? "" : text.substr(newline + 1);
+    }
+    parseRun(text, samples);
+    return true;
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 != 0 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+/* One sided p value for "current tends to be larger than baseline", normal
+ * approximation of the U statistic with tie and continuity corrections */
+static double mannWhitneyGreater(const std::vector<double>& baseline, const std::vector<double>& current)
+{
+    std::vector<std::pair<double, int>> all;
+    for (double value : baseline) {
+        all.push_back({ value, 0 });
+    }
+    for (double value : current) {
+        all.push_back({ value, 1 });
+    }
+    std::sort(all.begin(), all.end());
+
+    double n1 = (double)baseline.size(), n2 = (double)current.size(), n = n1 + n2;
+    double current_ranks = 0, tie_term = 0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) {
+            j++;
+        }
+
+        /*ranks are 1 based, ties share the average of their ranks*/
+        double rank = (double)(i + j + 1) / 2;
+        for (size_t k = i; k < j; k++) {
+            current_ranks += all[k].second == 1 ? rank : 0;
+        }
+        double ties = (double)(j - i);
+        tie_term += ties * ties * ties - ties;
+        i = j;
+    }
+
+    double u = current_ranks - n2 * (n2 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (variance <= 0) {
+        return 1;
+    }
+
+    double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+static int compare(const Options& options, const Samples& baseline, const Samples& current, FILE* report)
+{
+    int failures = 0;
+    double alpha = options.alpha / (double)std::max<size_t>(current.size(), 1);
+    fprintf(report, "%-8s %-40s %12s %12s %9s %10s\n", "result", "key", "baseline", "current", "change", "p");
+    for (const auto& entry : current) {
+        auto base = baseline.find(entry.first);
+        if (base == baseline.end()) {
+            fprintf(report, "%-8s %-40s %12s %12.2f\n", "NEW", entry.first.c_str(), "-", median(entry.second));
+            continue;
+        }
+
+        double base_median = median(base->second);
+        double current_median = median(entry.second);
+        double change = base_median == 0 ? 0 : (current_median / base_median - 1) * 100;
+        double p = mannWhitneyGreater(base->second, entry.second);
+        bool failed = p < alpha && change > options.threshold_percent;
+        failures += failed ? 1 : 0;
+        fprintf(report, "%-8s %-40s %12.2f %12.2f %+8.1f%% %10.2g\n", failed ? "FAIL" : "PASS", entry.first.c_str(),
+                base_median, current_median, change, p);
+    }
+
+    for (const auto& entry : baseline) {
+        if (current.find(entry.first) == current.end()) {
+            fprintf(report, "%-8s %-40s\n", "MISSING", entry.first.c_str());
+        }
+    }
+
+    fprintf(report, "%d regression%s\n", failures, failures == 1 ? "" : "s");
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+
+    Samples baseline;
+    if (!options.save && !loadBaseline(options.baseline_path, &baseline)) {
+        printf("no baseline at %s, run bench_regress save first\n", options.baseline_path);
+        return SKIP_EXIT_CODE;
+    }
+
+    Samples current;
+    if (!runRepeated(options, &current)) {
+        return 1;
+    }
+
+    if (options.save) {
+        return saveBaseline(options.baseline_path, options, current) ? 0 : 1;
+    }
+
+    int failures = compare(options, baseline, current, stdout);
+    if (options.report_path != NULL) {
+        FILE* report = fopen(options.report_path, "w");
+        if (report == NULL) {
+            perror(options.report_path);
+            return 1;
+        }
+        compare(options, baseline, current, report);
+        fclose(report);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench_engine.h"
+
+/*
+ * Cache misses spent walking a long free list.
+ *
+ *   cache_bench_malloc_3 [--blocks N] [--ops K] [--csv FILE]
+ *
+ * N blocks of 64..248 bytes are allocated and every other one is freed, which
+ * leaves N/2 free blocks that cannot merge. Then K smalloc/sfree pairs ask for
+ * the largest size, so every best fit search walks nearly the whole free list.
+ * With malloc_3's inline headers each step of that walk reads a different user
+ * page line, malloc_3_oob only reads its descriptor table. The hardware counters
+ * come from perf_event_open and print as n/a where the kernel does not allow them
+ * (containers, perf_event_paranoid).
+ */
+
+#define MIN_BLOCK (64)
+#define MAX_BLOCK (248)
+
+struct Options {
+    size_t blocks;
+    size_t ops;
+    const char* csv_path;
+};
+
+struct Counter {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+    uint64_t value;
+};
+
+static Counter counters[] = {
+    { "cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, 0 },
+    { "cache_references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, -1, 0 },
+    { "l1d_read_misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1, 0 },
+};
+#define COUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--blocks N] [--ops K] [--csv FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { 20000, 2000, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--blocks") == 0) {
+            options.blocks = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ops") == 0) {
+            options.ops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            options.csv_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.blocks < 2 || options.ops == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static void openCounters()
+{
+    for (size_t i = 0; i < COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counters[i].type;
+        attr.config = counters[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters[i].fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void startCounters()
+{
+    for (size_t i = 0; i < COUNTERS; i++) {
+        if (counters[i].fd != -1) {
+            ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void stopCounters()
+{
+    for (size_t i = 0; i < COUNTERS; i++) {
+        if (counters[i].fd == -1) {
+            continue;
+        }
+
+        ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counters[i].fd, &counters[i].value, sizeof(counters[i].value)) != sizeof(counters[i].value)) {
+            close(counters[i].fd);
+            counters[i].fd = -1;
+        }
+    }
+}
+
+static void printPerOp(FILE* out, const Counter& counter, size_t ops)
+{
+    if (counter.fd == -1) {
+        fprintf(out, ",n/a");
+    } else {
+        fprintf(out, ",%.2f", (double)counter.value / (double)ops);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    if (!engineHas(sfree)) {
+        fprintf(stderr, "%s: engine %s cannot free, nothing to measure\n", argv[0], BENCH_ENGINE);
+        return 0;
+    }
+
+    FILE* out = stdout;
+    if (options.csv_path != NULL) {
+        out = fopen(options.csv_path, "w");
+        if (out == NULL) {
+            perror(options.csv_path);
+            return 1;
+        }
+    }
+
+    std::vector<void*> blocks(options.blocks);
+    for (size_t i = 0; i < options.blocks; i++) {
+        /*distinct sizes spread over the range, so the size order differs from the address order*/
+        size_t size = MIN_BLOCK + (i * 7919 % ((MAX_BLOCK - MIN_BLOCK) / 8 + 1)) * 8;
+        blocks[i] = smalloc(size);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "%s: smalloc failed after %zu blocks\n", argv[0], i);
+            return 1;
+        }
+        memset(blocks[i], 0xab, size);
+    }
+
+    for (size_t i = 0; i < options.blocks; i += 2) {
+        sfree(blocks[i]);
+    }
+
+    openCounters();
+    auto start = std::chrono::steady_clock::now();
+    startCounters();
+    for (size_t i = 0; i < options.ops; i++) {
+        void* p = smalloc(MAX_BLOCK);
+        sfree(p);
+    }
+    stopCounters();
+    double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(out, "engine,free_blocks,ops,ns_per_op");
+    for (size_t i = 0; i < COUNTERS; i++) {
+        fprintf(out, ",%s_per_op", counters[i].name);
+    }
+    fprintf(out, "\n%s,%zu,%zu,%.1f", BENCH_ENGINE, (options.blocks + 1) / 2, options.ops, elapsed_ns / (double)options.ops);
+    for (size_t i = 0; i < COUNTERS; i++) {
+        printPerOp(out, counters[i], options.ops);
+    }
+    fprintf(out, "\n");
+
+    for (size_t i = 1; i < options.blocks; i += 2) {
+        sfree(blocks[i]);
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bench_engine.h"
+#include "size_dist.h"
+
+/*
+ * sfree latency and throughput under allocation churn.
+ *
+ *   churn_bench_malloc_3 [--ops N] [--window W] [--dist NAME] [--csv FILE]
+ *
+ * Workloads:
+ *   pingpong  smalloc and immediately sfree a block, over and over
+ *   window    keep W blocks alive, every step frees the oldest and allocates a new one
+ *   burst     allocate W blocks, free them newest first, repeat
+ * Each runs twice: once untimed per call for ops/sec of the whole smalloc+sfree
+ * mix, once timing every sfree for its mean, p50, p99 and max in ns.
+ * Compare churn_bench_malloc_3 with churn_bench_malloc_3_deferred.
+ */
+
+enum Workload { WORKLOAD_PINGPONG, WORKLOAD_WINDOW, WORKLOAD_BURST, WORKLOADS };
+
+static const char* workload_names[WORKLOADS] = { "pingpong", "window", "burst" };
+
+struct Options {
+    size_t ops;
+    size_t window;
+    SizeDistribution dist;
+    const char* csv_path;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--ops N] [--window W] [--dist fixed|uniform|power_law|bimodal] [--csv FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { 200000, 1000, DIST_BIMODAL, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--ops") == 0) {
+            options.ops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--window") == 0) {
+            options.window = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dist") == 0) {
+            if (!parseDist(argv[++i], &options.dist)) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            options.csv_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.ops == 0 || options.window == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+/* Frees one block, timing it when latencies is not NULL */
+static void timedFree(void* p, std::vector<double>* latencies)
+{
+    if (latencies == NULL) {
+        sfree(p);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    sfree(p);
+    latencies->push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+}
+
+/* Runs ops smalloc/sfree pairs of the workload, returns the elapsed seconds */
+static double run(Workload workload, const Options& options, std::vector<double>* latencies)
+{
+    SizeSampler sampler(options.dist, 3);
+    std::vector<void*> live(options.window, NULL);
+    size_t oldest = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < options.ops;) {
+        switch (workload) {
+            case WORKLOAD_PINGPONG:
+                timedFree(smalloc(sampler.next()), latencies);
+                done += 1;
+                break;
+            case WORKLOAD_WINDOW:
+                if (live[oldest] != NULL) {
+                    timedFree(live[oldest], latencies);
+                    done += 1;
+                }
+                live[oldest] = smalloc(sampler.next());
+                oldest = (oldest + 1) % options.window;
+                break;
+            case WORKLOAD_BURST:
+                for (size_t i = 0; i < options.window; i++) {
+                    live[i] = smalloc(sampler.next());
+                }
+                for (size_t i = options.window; i > 0 && done < options.ops; i--, done++) {
+                    timedFree(live[i - 1], latencies);
+                    live[i - 1] = NULL;
+                }
+                for (size_t i = 0; i < options.window; i++) {
+                    sfree(live[i]);
+                    live[i] = NULL;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (void* p : live) {
+        sfree(p);
+    }
+
+    return seconds;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    return sorted[(size_t)(p / 100.0 * (double)(sorted.size() - 1))];
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    if (!engineHas(sfree)) {
+        fprintf(stderr, "%s: engine %s cannot free, nothing to measure\n", argv[0], BENCH_ENGINE);
+        return 0;
+    }
+
+    FILE* out = stdout;
+    if (options.csv_path != NULL) {
+        out = fopen(options.csv_path, "w");
+        if (out == NULL) {
+            perror(options.csv_path);
+            return 1;
+        }
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(options.ops);
+
+    fprintf(out, "engine,workload,distribution,ops,ops_per_sec,sfree_mean_ns,sfree_p50_ns,sfree_p99_ns,sfree_max_ns\n");
+    for (int workload = 0; workload < WORKLOADS; workload++) {
+        double seconds = run((Workload)workload, options, NULL);
+
+        latencies.clear();
+        run((Workload)workload, options, &latencies);
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0;
+        for (double latency : latencies) {
+            mean += latency;
+        }
+        mean /= (double)latencies.size();
+
+        fprintf(out, "%s,%s,%s,%zu,%.0f,%.1f,%.1f,%.1f,%.1f\n", BENCH_ENGINE, workload_names[workload], distName(options.dist),
+                options.ops, (double)options.ops / seconds, mean, percentile(latencies, 50), percentile(latencies, 99),
+                latencies.back());
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
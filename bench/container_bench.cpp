@@ -0,0 +1,133 @@
+#include "smalloc_resource.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Container heavy workloads run once per allocator family:
+ * std::allocator (glibc), SmallocAllocator and std::pmr over SmallocResource.
+ * Prints one CSV line per workload and allocator.
+ */
+
+struct GlibcFamily {
+    template <class T> using type = std::allocator<T>;
+    static const char* name() { return "std::allocator"; }
+};
+
+struct SmallocFamily {
+    template <class T> using type = SmallocAllocator<T>;
+    static const char* name() { return "SmallocAllocator"; }
+};
+
+struct PmrFamily {
+    /*default constructed polymorphic allocators pick up the default resource set in runFamily*/
+    template <class T> using type = std::pmr::polymorphic_allocator<T>;
+    static const char* name() { return "SmallocResource"; }
+};
+
+template <class Family>
+size_t mapInsertErase(size_t n)
+{
+    typedef std::pair<const int, int> value_type;
+    std::map<int, int, std::less<int>, typename Family::template type<value_type> > map;
+    std::mt19937 rng(1);
+    size_t ops = 0;
+    for (size_t round = 0; round < 4; round++) {
+        for (size_t i = 0; i < n; i++, ops++) {
+            map[(int)(rng() % (4 * n))] = (int)i;
+        }
+        for (size_t i = 0; i < n; i++, ops++) {
+            map.erase((int)(rng() % (4 * n)));
+        }
+    }
+
+    return ops;
+}
+
+template <class Family>
+size_t unorderedMapInsertErase(size_t n)
+{
+    typedef std::pair<const int, int> value_type;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, typename Family::template type<value_type> > map;
+    std::mt19937 rng(2);
+    size_t ops = 0;
+    for (size_t round = 0; round < 4; round++) {
+        for (size_t i = 0; i < n; i++, ops++) {
+            map[(int)(rng() % (4 * n))] = (int)i;
+        }
+        for (size_t i = 0; i < n; i++, ops++) {
+            map.erase((int)(rng() % (4 * n)));
+        }
+    }
+
+    return ops;
+}
+
+template <class Family>
+size_t vectorGrowth(size_t n)
+{
+    size_t ops = 0;
+    for (size_t round = 0; round < 64; round++) {
+        std::vector<long, typename Family::template type<long> > vec;
+        for (size_t i = 0; i < n; i++, ops++) {
+            vec.push_back((long)i);
+        }
+    }
+
+    return ops;
+}
+
+template <class Family>
+size_t stringChurn(size_t n)
+{
+    typedef std::basic_string<char, std::char_traits<char>, typename Family::template type<char> > string;
+    std::vector<string, typename Family::template type<string> > pool(1024);
+    std::mt19937 rng(3);
+    size_t ops = 0;
+    for (size_t i = 0; i < 8 * n; i++, ops++) {
+        /*long enough to defeat the small string optimization*/
+        pool[rng() % pool.size()].assign(16 + rng() % 240, 'x');
+    }
+
+    return ops;
+}
+
+template <class Family>
+void runWorkload(const char* workload, size_t (*fn)(size_t), size_t n)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t ops = fn(n);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    printf("%s,%s,%zu,%.2f\n", workload, Family::name(), ops, ns / (double)ops);
+}
+
+template <class Family>
+void runFamily(size_t n)
+{
+    std::pmr::memory_resource* prev_resource = std::pmr::set_default_resource(smalloc_resource());
+    runWorkload<Family>("map_insert_erase", mapInsertErase<Family>, n);
+    runWorkload<Family>("unordered_map_insert_erase", unorderedMapInsertErase<Family>, n);
+    runWorkload<Family>("vector_growth", vectorGrowth<Family>, n);
+    runWorkload<Family>("string_churn", stringChurn<Family>, n);
+    std::pmr::set_default_resource(prev_resource);
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 20000;
+
+    printf("workload,allocator,ops,ns_per_op\n");
+    runFamily<GlibcFamily>(n);
+    runFamily<SmallocFamily>(n);
+    runFamily<PmrFamily>(n);
+    return 0;
+}
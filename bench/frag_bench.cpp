@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "bench_engine.h"
+#include "size_dist.h"
+
+/*
+ * Long running random alloc/free/realloc mix that samples fragmentation over time.
+ *
+ *   frag_bench_malloc_3 [--steps N] [--sample-every K] [--slots S] [--dist NAME] [--csv FILE]
+ *
+ * Every K steps one CSV line is written: heap size (program break growth),
+ * live bytes requested by the benchmark, the engine's free bytes/blocks and,
+ * when the engine has them, its largest free block and external fragmentation.
+ * bench/plot_fragmentation.gp plots one or more of these files.
+ */
+
+struct Options {
+    size_t steps;
+    size_t sample_every;
+    size_t slots;
+    SizeDistribution dist;
+    const char* csv_path;
+};
+
+struct Slot {
+    void* ptr;
+    size_t size;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--steps N] [--sample-every K] [--slots S] [--dist fixed|uniform|power_law|bimodal] [--csv FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { 200000, 1000, 20000, DIST_POWER_LAW, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--steps") == 0) {
+            options.steps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sample-every") == 0) {
+            options.sample_every = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--slots") == 0) {
+            options.slots = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dist") == 0) {
+            if (!parseDist(argv[++i], &options.dist)) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            options.csv_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.sample_every == 0 || options.slots == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static void sample(FILE* out, size_t step, void* base, size_t live_bytes)
+{
+    size_t heap_bytes = (size_t)((char*)sbrk(0) - (char*)base);
+    fprintf(out, "%s,%zu,%zu,%zu", BENCH_ENGINE, step, heap_bytes, live_bytes);
+    if (engineHas(_num_free_bytes)) {
+        fprintf(out, ",%zu,%zu", _num_free_bytes(), _num_free_blocks());
+    } else {
+        fprintf(out, ",,");
+    }
+    if (engineHas(_largest_free_block)) {
+        fprintf(out, ",%zu,%.4f\n", _largest_free_block(), _external_fragmentation());
+    } else {
+        fprintf(out, ",,\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    if (!engineHas(sfree)) {
+        fprintf(stderr, "%s cannot free, fragmentation is meaningless\n", BENCH_ENGINE);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (options.csv_path != NULL) {
+        out = fopen(options.csv_path, "w");
+        if (out == NULL) {
+            perror(options.csv_path);
+            return 1;
+        }
+    }
+
+    /*allocated before measuring, so glibc does not move the break under the engine*/
+    std::vector<Slot> slots(options.slots, Slot{ NULL, 0 });
+    std::vector<size_t> live;
+    live.reserve(options.slots);
+    std::mt19937_64 rng(1);
+    SizeSampler sampler(options.dist, 2);
+
+    fprintf(out, "engine,step,heap_bytes,live_bytes,free_bytes,free_blocks,largest_free_block,external_fragmentation\n");
+    void* base = sbrk(0);
+    size_t live_bytes = 0;
+    for (size_t step = 0; step < options.steps; step++) {
+        unsigned action = rng() % 100;
+        if (live.empty() || (action < 50 && live.size() < options.slots)) {
+            /*slots are reused in index order, live keeps the occupied ones*/
+            size_t index = live.size();
+            for (size_t i = 0; i < options.slots; i++) {
+                if (slots[(step + i) % options.slots].ptr == NULL) {
+                    index = (step + i) % options.slots;
+                    break;
+                }
+            }
+            size_t size = sampler.next();
+            slots[index].ptr = smalloc(size);
+            if (slots[index].ptr != NULL) {
+                slots[index].size = size;
+                live.push_back(index);
+                live_bytes += size;
+            }
+        } else if (action < 85 || !engineHas(srealloc)) {
+            size_t pick = rng() % live.size();
+            Slot& slot = slots[live[pick]];
+            sfree(slot.ptr);
+            live_bytes -= slot.size;
+            slot.ptr = NULL;
+            live[pick] = live.back();
+            live.pop_back();
+        } else {
+            Slot& slot = slots[live[rng() % live.size()]];
+            size_t size = sampler.next();
+            void* newp = srealloc(slot.ptr, size);
+            if (newp != NULL) {
+                live_bytes = live_bytes - slot.size + size;
+                slot.ptr = newp;
+                slot.size = size;
+            }
+        }
+
+        if (step % options.sample_every == 0) {
+            sample(out, step, base, live_bytes);
+        }
+    }
+
+    sample(out, options.steps, base, live_bytes);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench_engine.h"
+
+/*
+ * Cost of the free block index with many free blocks.
+ *
+ *   free_index_bench_malloc_3 [--free-blocks N,N,...] [--ops K] [--classes C]
+ *
+ * For every N a child process builds a heap of N free blocks kept apart by small
+ * used ones, their sizes spread over C size classes and growing with the address.
+ * It then times K smalloc/sfree pairs of a random class: smalloc has to find the
+ * best fit and sfree puts the block back at the same place in the size order.
+ * Compare free_index_bench_malloc_3 (linked list) with
+ * free_index_bench_malloc_3_packed (-DMALLOC_PACKED_FREE_INDEX).
+ *
+ * The linked list makes every pair O(N), so K is cut down for large N to keep the
+ * run short; the number of pairs actually timed is in the ops column.
+ */
+
+#define SEPARATOR_SIZE (8)
+#define MIN_FREE_SIZE (16)
+#define MAX_LIST_STEPS (2e8) /*rough budget of list nodes walked per N*/
+
+struct Options {
+    std::vector<size_t> free_blocks;
+    size_t ops;
+    size_t classes;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--free-blocks N,N,...] [--ops K] [--classes C]\n", prog);
+    exit(2);
+}
+
+static bool parseList(const char* arg, std::vector<size_t>* values)
+{
+    values->clear();
+    while (*arg != '\0') {
+        char* end;
+        size_t value = strtoul(arg, &end, 10);
+        if (end == arg || value == 0 || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        values->push_back(value);
+        arg = *end == ',' ? end + 1 : end;
+    }
+
+    return !values->empty();
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { { 1000, 100000, 10000000 }, 1000, 16 };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--free-blocks") == 0) {
+            if (!parseList(argv[++i], &options.free_blocks)) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--ops") == 0) {
+            options.ops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--classes") == 0) {
+            options.classes = strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.ops == 0 || options.classes == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static size_t classSize(size_t size_class)
+{
+    return MIN_FREE_SIZE + 8 * size_class;
+}
+
+static int measure(size_t free_blocks, size_t ops, size_t classes)
+{
+    std::vector<void*> blocks(free_blocks);
+    for (size_t i = 0; i < free_blocks; i++) {
+        /*non decreasing sizes in address order, so building the index is cheap for every engine*/
+        blocks[i] = smalloc(classSize(i * classes / free_blocks));
+        if (blocks[i] == NULL || smalloc(SEPARATOR_SIZE) == NULL) {
+            fprintf(stderr, "smalloc failed after %zu blocks\n", i);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < free_blocks; i++) {
+        sfree(blocks[i]);
+    }
+
+    if (ops > MAX_LIST_STEPS / free_blocks) {
+        ops = (size_t)(MAX_LIST_STEPS / free_blocks);
+        ops = ops < 10 ? 10 : ops;
+    }
+
+    double smalloc_ns = 0, sfree_ns = 0;
+    unsigned long rng = 0x9e3779b97f4a7c15UL;
+    for (size_t i = 0; i < ops; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t size = classSize(rng % classes);
+
+        auto start = std::chrono::steady_clock::now();
+        void* p = smalloc(size);
+        auto middle = std::chrono::steady_clock::now();
+        sfree(p);
+        auto end = std::chrono::steady_clock::now();
+        if (p == NULL) {
+            fprintf(stderr, "smalloc(%zu) failed\n", size);
+            return 1;
+        }
+
+        smalloc_ns += std::chrono::duration<double, std::nano>(middle - start).count();
+        sfree_ns += std::chrono::duration<double, std::nano>(end - middle).count();
+    }
+
+    printf("%s,%zu,smalloc,%zu,%.1f\n", BENCH_ENGINE, free_blocks, ops, smalloc_ns / (double)ops);
+    printf("%s,%zu,sfree,%zu,%.1f\n", BENCH_ENGINE, free_blocks, ops, sfree_ns / (double)ops);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    if (!engineHas(sfree)) {
+        fprintf(stderr, "%s: engine %s cannot free, nothing to measure\n", argv[0], BENCH_ENGINE);
+        return 0;
+    }
+
+    printf("engine,free_blocks,op,ops,ns_per_op\n");
+    fflush(stdout);
+    for (size_t free_blocks : options.free_blocks) {
+        /*a fresh process per size, the heap of the previous one cannot be given back*/
+        pid_t child = fork();
+        if (child == -1) {
+            perror("fork");
+            return 1;
+        }
+
+        if (child == 0) {
+            int res = measure(free_blocks, options.ops, options.classes);
+            fflush(stdout);
+            _exit(res);
+        }
+
+        int status;
+        if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: run with %zu free blocks failed\n", argv[0], free_blocks);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include <cstdlib>
+
+#include "bench_engine.h"
+
+/* glibc malloc behind the smalloc interface, the baseline for every benchmark */
+
+void* smalloc(size_t size) {
+    return malloc(size);
+}
+
+void* scalloc(size_t num, size_t size) {
+    return calloc(num, size);
+}
+
+void sfree(void* p) {
+    free(p);
+}
+
+void* srealloc(void* oldp, size_t size) {
+    return realloc(oldp, size);
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_engine.h"
+#include "size_dist.h"
+
+/*
+ * ns/op of smalloc, sfree, scalloc and srealloc for one malloc_N.cpp build
+ * (or glibc) over several size distributions.
+ *
+ *   micro_bench_malloc_3 [--ops N] [--rounds R] [--dist NAME] [--csv FILE] [--json FILE]
+ *
+ * Each round allocates --ops blocks, frees them in random order, then does the
+ * same with scalloc and srealloc. Results always go to stdout as CSV.
+ */
+
+struct Result {
+    std::string dist;
+    std::string op;
+    size_t ops;
+    double ns_per_op;
+};
+
+struct Options {
+    size_t ops;
+    size_t rounds;
+    int dist; /*-1 for all of them*/
+    const char* csv_path;
+    const char* json_path;
+};
+
+class Stopwatch {
+public:
+    void start() { begin = std::chrono::steady_clock::now(); }
+    void stop() { total += std::chrono::steady_clock::now() - begin; }
+    double nanoseconds() const { return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(total).count(); }
+
+private:
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::duration total = std::chrono::steady_clock::duration::zero();
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--ops N] [--rounds R] [--dist fixed|uniform|power_law|bimodal] [--csv FILE] [--json FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { 10000, 5, -1, NULL, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--ops") == 0) {
+            options.ops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rounds") == 0) {
+            options.rounds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dist") == 0) {
+            SizeDistribution dist;
+            if (!parseDist(argv[++i], &dist)) {
+                usage(argv[0]);
+            }
+            options.dist = dist;
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            options.csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            options.json_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.ops == 0 || options.rounds == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static void runDistribution(SizeDistribution dist, const Options& options, std::vector<Result>& results)
+{
+    SizeSampler sampler(dist, 42);
+    std::vector<size_t> sizes(options.ops), resizes(options.ops);
+    for (size_t i = 0; i < options.ops; i++) {
+        sizes[i] = sampler.next();
+        resizes[i] = sampler.next();
+    }
+
+    std::vector<size_t> free_order(options.ops);
+    std::iota(free_order.begin(), free_order.end(), 0);
+    std::shuffle(free_order.begin(), free_order.end(), std::mt19937(7));
+
+    std::vector<void*> ptrs(options.ops);
+    Stopwatch malloc_time, free_time, calloc_time, realloc_time;
+    for (size_t round = 0; round < options.rounds; round++) {
+        malloc_time.start();
+        for (size_t i = 0; i < options.ops; i++) {
+            ptrs[i] = smalloc(sizes[i]);
+        }
+        malloc_time.stop();
+
+        if (!engineHas(sfree)) {
+            /*malloc_1 cannot give anything back, so only smalloc is measured*/
+            continue;
+        }
+
+        free_time.start();
+        for (size_t i = 0; i < options.ops; i++) {
+            sfree(ptrs[free_order[i]]);
+        }
+        free_time.stop();
+
+        if (engineHas(scalloc)) {
+            calloc_time.start();
+            for (size_t i = 0; i < options.ops; i++) {
+                ptrs[i] = scalloc(1, sizes[i]);
+            }
+            calloc_time.stop();
+        } else {
+            for (size_t i = 0; i < options.ops; i++) {
+                ptrs[i] = smalloc(sizes[i]);
+            }
+        }
+
+        if (engineHas(srealloc)) {
+            realloc_time.start();
+            for (size_t i = 0; i < options.ops; i++) {
+                void* newp = srealloc(ptrs[i], resizes[i]);
+                if (newp != NULL) {
+                    ptrs[i] = newp;
+                }
+            }
+            realloc_time.stop();
+        }
+
+        for (size_t i = 0; i < options.ops; i++) {
+            sfree(ptrs[free_order[i]]);
+        }
+    }
+
+    size_t total_ops = options.ops * options.rounds;
+    results.push_back({ distName(dist), "smalloc", total_ops, malloc_time.nanoseconds() / (double)total_ops });
+    if (engineHas(sfree)) {
+        results.push_back({ distName(dist), "sfree", total_ops, free_time.nanoseconds() / (double)total_ops });
+    }
+    if (engineHas(sfree) && engineHas(scalloc)) {
+        results.push_back({ distName(dist), "scalloc", total_ops, calloc_time.nanoseconds() / (double)total_ops });
+    }
+    if (engineHas(sfree) && engineHas(srealloc)) {
+        results.push_back({ distName(dist), "srealloc", total_ops, realloc_time.nanoseconds() / (double)total_ops });
+    }
+}
+
+static void writeCsv(FILE* out, const std::vector<Result>& results)
+{
+    fprintf(out, "engine,distribution,op,ops,ns_per_op\n");
+    for (const Result& result : results) {
+        fprintf(out, "%s,%s,%s,%zu,%.2f\n", BENCH_ENGINE, result.dist.c_str(), result.op.c_str(), result.ops, result.ns_per_op);
+    }
+}
+
+static void writeJson(FILE* out, const std::vector<Result>& results)
+{
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        fprintf(out, "  {\"engine\": \"%s\", \"distribution\": \"%s\", \"op\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.2f}%s\n",
+                BENCH_ENGINE, result.dist.c_str(), result.op.c_str(), result.ops, result.ns_per_op,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+static bool writeFile(const char* path, void (*writer)(FILE*, const std::vector<Result>&), const std::vector<Result>& results)
+{
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return false;
+    }
+
+    writer(out, results);
+    fclose(out);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+
+    std::vector<Result> results;
+    for (int dist = 0; dist < DIST_COUNT; dist++) {
+        if (options.dist == -1 || options.dist == dist) {
+            runDistribution((SizeDistribution)dist, options, results);
+        }
+    }
+
+    writeCsv(stdout, results);
+    bool ok = true;
+    if (options.csv_path != NULL) {
+        ok = writeFile(options.csv_path, writeCsv, results) && ok;
+    }
+    if (options.json_path != NULL) {
+        ok = writeFile(options.json_path, writeJson, results) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,428 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "bench_engine.h"
+
+/*
+ * Multithreaded workloads modeled on the classic allocator benchmarks:
+ *
+ *   larson         server style: random free/alloc over a slot array that is
+ *                  handed to a fresh thread every round, so frees cross threads
+ *   threadtest     every thread allocates and frees its own batches
+ *   xmalloc        producers allocate, consumers free what they receive
+ *   cache-scratch  every thread frees an object the main thread allocated next
+ *                  to the others, then repeatedly allocates and writes a small one
+ *
+ *   mt_bench_malloc_3 [--workload NAME|all] [--threads N] [--ops N] [--csv FILE]
+ *
+ * Each workload runs at 1..N threads and prints ops/sec, the speedup over one
+ * thread and the resident set size. The malloc_N engines are not thread safe,
+ * so their calls are serialized by one lock here; the glibc baseline is called
+ * directly.
+ */
+
+#ifndef BENCH_ENGINE_THREAD_SAFE
+#define BENCH_ENGINE_THREAD_SAFE (0)
+#endif
+
+#define MIN_OBJECT_SIZE (8)
+#define MAX_OBJECT_SIZE (256)
+#define LARSON_SLOTS (1000)
+#define LARSON_ROUNDS (10)
+#define THREADTEST_BATCH (1000)
+#define XMALLOC_BATCH (64)
+#define XMALLOC_MAX_QUEUED (256)
+#define SCRATCH_OBJECT_SIZE (8)
+#define SCRATCH_WRITES (100)
+
+struct Options {
+    std::string workload;
+    unsigned threads;
+    size_t ops; /*per thread*/
+    const char* csv_path;
+};
+
+static std::mutex engine_lock;
+
+static void* benchMalloc(size_t size)
+{
+    if (BENCH_ENGINE_THREAD_SAFE) {
+        return smalloc(size);
+    }
+
+    std::lock_guard<std::mutex> guard(engine_lock);
+    return smalloc(size);
+}
+
+static void benchFree(void* p)
+{
+    if (BENCH_ENGINE_THREAD_SAFE) {
+        sfree(p);
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(engine_lock);
+    sfree(p);
+}
+
+static size_t randomSize(std::mt19937& rng)
+{
+    return MIN_OBJECT_SIZE + rng() % (MAX_OBJECT_SIZE - MIN_OBJECT_SIZE + 1);
+}
+
+/* Every function returns the number of allocator calls it made */
+
+static size_t larsonRound(std::vector<void*>* slots, size_t ops, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < ops; i++) {
+        size_t index = rng() % slots->size();
+        benchFree((*slots)[index]);
+        (*slots)[index] = benchMalloc(randomSize(rng));
+    }
+
+    return 2 * ops;
+}
+
+static size_t larson(unsigned threads, size_t ops)
+{
+    std::vector<std::vector<void*>> slots(threads, std::vector<void*>(LARSON_SLOTS));
+    for (unsigned t = 0; t < threads; t++) {
+        std::mt19937 rng(t);
+        for (void*& slot : slots[t]) {
+            slot = benchMalloc(randomSize(rng));
+        }
+    }
+
+    /*each round starts new threads on the previous round's slots,
+     *so most frees hit blocks another thread allocated*/
+    std::atomic<size_t> total(0);
+    for (unsigned round = 0; round < LARSON_ROUNDS; round++) {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t, round] {
+                total += larsonRound(&slots[t], ops / LARSON_ROUNDS, round * threads + t);
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    for (std::vector<void*>& thread_slots : slots) {
+        for (void* slot : thread_slots) {
+            benchFree(slot);
+        }
+    }
+
+    return total;
+}
+
+static size_t threadtest(unsigned threads, size_t ops)
+{
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::vector<void*> batch(THREADTEST_BATCH);
+            size_t done = 0;
+            while (done < ops) {
+                for (void*& p : batch) {
+                    p = benchMalloc(randomSize(rng));
+                }
+                for (void* p : batch) {
+                    benchFree(p);
+                }
+                done += 2 * batch.size();
+            }
+            total += done;
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return total;
+}
+
+class BatchQueue {
+public:
+    void push(std::vector<void*>&& batch) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_full.wait(guard, [this] { return batches.size() < XMALLOC_MAX_QUEUED; });
+        batches.push_back(std::move(batch));
+        not_empty.notify_one();
+    }
+
+    /* False once every producer finished and the queue drained */
+    bool pop(std::vector<void*>* batch) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [this] { return !batches.empty() || producers == 0; });
+        if (batches.empty()) {
+            return false;
+        }
+
+        *batch = std::move(batches.front());
+        batches.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void setProducers(unsigned count) { producers = count; }
+
+    void producerDone() {
+        std::lock_guard<std::mutex> guard(lock);
+        producers -= 1;
+        not_empty.notify_all();
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<std::vector<void*>> batches;
+    unsigned producers = 0;
+};
+
+static size_t xmalloc(unsigned threads, size_t ops)
+{
+    if (threads == 1) {
+        /*nobody to hand blocks to, produce and consume in turns*/
+        std::mt19937 rng(0);
+        std::vector<void*> batch(XMALLOC_BATCH);
+        size_t done = 0;
+        while (done < ops) {
+            for (void*& p : batch) {
+                p = benchMalloc(randomSize(rng));
+            }
+            for (void* p : batch) {
+                benchFree(p);
+            }
+            done += 2 * batch.size();
+        }
+        return done;
+    }
+
+    unsigned producers = threads / 2;
+    unsigned consumers = threads - producers;
+    BatchQueue queue;
+    queue.setProducers(producers);
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < producers; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            /*producers allocate for both halves, so every thread gets ops*/
+            size_t allocs = ops * threads / producers / 2;
+            for (size_t done = 0; done < allocs; done += XMALLOC_BATCH) {
+                std::vector<void*> batch(XMALLOC_BATCH);
+                for (void*& p : batch) {
+                    p = benchMalloc(randomSize(rng));
+                }
+                queue.push(std::move(batch));
+                total += XMALLOC_BATCH;
+            }
+            queue.producerDone();
+        });
+    }
+    for (unsigned t = 0; t < consumers; t++) {
+        workers.emplace_back([&] {
+            std::vector<void*> batch;
+            while (queue.pop(&batch)) {
+                for (void* p : batch) {
+                    benchFree(p);
+                }
+                total += batch.size();
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return total;
+}
+
+static size_t cacheScratch(unsigned threads, size_t ops)
+{
+    /*objects allocated back to back likely share cache lines; an allocator that
+     *hands a freed one back to the thread that freed it causes false sharing*/
+    std::vector<void*> initial(threads);
+    for (void*& p : initial) {
+        p = benchMalloc(SCRATCH_OBJECT_SIZE);
+    }
+
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            benchFree(initial[t]);
+            size_t done = 1;
+            while (done < ops) {
+                volatile char* p = (volatile char*)benchMalloc(SCRATCH_OBJECT_SIZE);
+                for (int i = 0; i < SCRATCH_WRITES; i++) {
+                    for (int j = 0; j < SCRATCH_OBJECT_SIZE; j++) {
+                        p[j] = p[j] + 1;
+                    }
+                }
+                benchFree((void*)p);
+                done += 2;
+            }
+            total += done;
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return total;
+}
+
+struct Workload {
+    const char* name;
+    size_t (*run)(unsigned threads, size_t ops);
+};
+
+static const Workload workloads[] = {
+    { "larson", larson },
+    { "threadtest", threadtest },
+    { "xmalloc", xmalloc },
+    { "cache-scratch", cacheScratch },
+};
+
+static size_t residentKilobytes()
+{
+    long pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%*d %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+
+    return (size_t)pages * (size_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+static size_t peakResidentKilobytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--workload larson|threadtest|xmalloc|cache-scratch|all] [--threads N] [--ops N] [--csv FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    unsigned hardware = std::thread::hardware_concurrency();
+    Options options = { "all", hardware == 0 ? 4 : hardware, 200000, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--workload") == 0) {
+            options.workload = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            options.threads = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ops") == 0) {
+            options.ops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            options.csv_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.threads == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    if (!engineHas(sfree)) {
+        fprintf(stderr, "%s cannot free, skipping the multithreaded workloads\n", BENCH_ENGINE);
+        return 1;
+    }
+
+    bool known = options.workload == "all";
+    for (const Workload& workload : workloads) {
+        known = known || options.workload == workload.name;
+    }
+    if (!known) {
+        usage(argv[0]);
+    }
+
+    FILE* csv = NULL;
+    if (options.csv_path != NULL) {
+        csv = fopen(options.csv_path, "w");
+        if (csv == NULL) {
+            perror(options.csv_path);
+            return 1;
+        }
+    }
+
+    const char* header = "engine,workload,threads,ops,seconds,ops_per_sec,speedup,rss_kb,peak_rss_kb\n";
+    printf("%s", header);
+    if (csv != NULL) {
+        fprintf(csv, "%s", header);
+    }
+
+    for (const Workload& workload : workloads) {
+        if (options.workload != "all" && options.workload != workload.name) {
+            continue;
+        }
+
+        double single_thread = 0;
+        for (unsigned threads = 1; threads <= options.threads; threads++) {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            size_t ops = workload.run(threads, options.ops);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+
+            double ops_per_sec = (double)ops / seconds.count();
+            if (threads == 1) {
+                single_thread = ops_per_sec;
+            }
+
+            char line[256];
+            snprintf(line, sizeof(line), "%s,%s,%u,%zu,%.4f,%.0f,%.2f,%zu,%zu\n",
+                     BENCH_ENGINE, workload.name, threads, ops, seconds.count(), ops_per_sec,
+                     ops_per_sec / single_thread, residentKilobytes(), peakResidentKilobytes());
+            printf("%s", line);
+            if (csv != NULL) {
+                fprintf(csv, "%s", line);
+            }
+        }
+    }
+
+    if (csv != NULL) {
+        fclose(csv);
+    }
+
+    return 0;
+}
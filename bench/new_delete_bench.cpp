@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+/*
+ * new/delete heavy object churn. Built twice: once with shim/operator_new.cpp
+ * and malloc_3.cpp linked in, once against the default (glibc backed) operators.
+ * Prints one CSV line per workload.
+ */
+
+#ifndef BENCH_ALLOCATOR
+#define BENCH_ALLOCATOR "glibc"
+#endif
+
+#define LIVE_OBJECTS (4096)
+
+struct Small { long fields[2]; };
+struct Medium { long fields[8]; };
+struct Large { long fields[32]; };
+struct alignas(64) CacheLine { long fields[8]; };
+
+struct Node {
+    long value;
+    std::unique_ptr<Node> next;
+};
+
+template <class T>
+size_t objectChurn(size_t n)
+{
+    T* live[LIVE_OBJECTS] = {};
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < n; i++) {
+        size_t slot = rng() % LIVE_OBJECTS;
+        delete live[slot];
+        live[slot] = new T();
+    }
+
+    for (size_t i = 0; i < LIVE_OBJECTS; i++) {
+        delete live[i];
+    }
+
+    return n;
+}
+
+size_t mixedChurn(size_t n)
+{
+    void* live[LIVE_OBJECTS] = {};
+    int kind[LIVE_OBJECTS] = {};
+    std::mt19937 rng(2);
+    for (size_t i = 0; i < n; i++) {
+        size_t slot = rng() % LIVE_OBJECTS;
+        switch (kind[slot]) {
+            case 1: delete (Small*)live[slot]; break;
+            case 2: delete (Medium*)live[slot]; break;
+            case 3: delete (Large*)live[slot]; break;
+            case 4: delete[] (char*)live[slot]; break;
+        }
+
+        kind[slot] = 1 + rng() % 4;
+        switch (kind[slot]) {
+            case 1: live[slot] = new Small(); break;
+            case 2: live[slot] = new Medium(); break;
+            case 3: live[slot] = new Large(); break;
+            case 4: live[slot] = new char[1 + rng() % 512]; break;
+        }
+    }
+
+    for (size_t i = 0; i < LIVE_OBJECTS; i++) {
+        switch (kind[i]) {
+            case 1: delete (Small*)live[i]; break;
+            case 2: delete (Medium*)live[i]; break;
+            case 3: delete (Large*)live[i]; break;
+            case 4: delete[] (char*)live[i]; break;
+        }
+    }
+
+    return n;
+}
+
+size_t listBuildTeardown(size_t n)
+{
+    size_t ops = 0;
+    while (ops < n) {
+        std::unique_ptr<Node> head;
+        for (size_t i = 0; i < 1000; i++, ops++) {
+            std::unique_ptr<Node> node(new Node());
+            node->value = (long)i;
+            node->next = std::move(head);
+            head = std::move(node);
+        }
+
+        /*unlink iteratively so a long list does not recurse in the destructor*/
+        while (head) {
+            head = std::move(head->next);
+        }
+    }
+
+    return ops;
+}
+
+void runWorkload(const char* workload, size_t (*fn)(size_t), size_t n)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t ops = fn(n);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    printf("%s,%s,%zu,%.2f\n", workload, BENCH_ALLOCATOR, ops, ns / (double)ops);
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 200000;
+
+    printf("workload,allocator,ops,ns_per_op\n");
+    runWorkload("small_objects", objectChurn<Small>, n);
+    runWorkload("medium_objects", objectChurn<Medium>, n);
+    runWorkload("large_objects", objectChurn<Large>, n);
+    runWorkload("aligned_objects", objectChurn<CacheLine>, n);
+    runWorkload("mixed_objects", mixedChurn, n);
+    runWorkload("list_build_teardown", listBuildTeardown, n);
+    return 0;
+}
@@ -0,0 +1,24 @@
+# Plots frag_bench CSV files side by side:
+#   gnuplot -e "files='frag_malloc_2.csv frag_malloc_3.csv'" bench/plot_fragmentation.gp
+# and writes fragmentation.png
+
+if (!exists("files")) files = "frag_malloc_3.csv"
+
+set datafile separator ","
+set key autotitle columnhead
+set terminal pngcairo size 1200,900
+set output "fragmentation.png"
+set multiplot layout 2,1
+
+set title "Heap size and live bytes"
+set xlabel "step"
+set ylabel "bytes"
+plot for [f in files] f using 2:3 with lines title f." heap", \
+     for [f in files] f using 2:4 with lines dashtype 2 title f." live"
+
+set title "External fragmentation"
+set ylabel "1 - largest free / free bytes"
+set yrange [0:1]
+plot for [f in files] f using 2:8 with lines title f
+
+unset multiplot
@@ -0,0 +1,66 @@
+#ifndef SIZE_DIST_H
+#define SIZE_DIST_H
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+/* Request size distributions shared by the benchmarks */
+
+enum SizeDistribution { DIST_FIXED, DIST_UNIFORM, DIST_POWER_LAW, DIST_BIMODAL, DIST_COUNT };
+
+#define FIXED_SIZE (64)
+#define UNIFORM_MIN (16)
+#define UNIFORM_MAX (4096)
+#define POWER_LAW_MIN (16)
+#define POWER_LAW_MAX (0x10000)
+#define POWER_LAW_ALPHA (1.2)
+
+inline const char* distName(SizeDistribution dist)
+{
+    static const char* names[DIST_COUNT] = { "fixed", "uniform", "power_law", "bimodal" };
+    return names[dist];
+}
+
+inline bool parseDist(const char* name, SizeDistribution* dist)
+{
+    for (int i = 0; i < DIST_COUNT; i++) {
+        if (strcmp(name, distName((SizeDistribution)i)) == 0) {
+            *dist = (SizeDistribution)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+class SizeSampler {
+public:
+    SizeSampler(SizeDistribution dist, unsigned seed) : dist(dist), rng(seed), unit(0.0, 1.0) {}
+
+    size_t next() {
+        switch (dist) {
+            case DIST_FIXED:
+                return FIXED_SIZE;
+            case DIST_UNIFORM:
+                return UNIFORM_MIN + rng() % (UNIFORM_MAX - UNIFORM_MIN + 1);
+            case DIST_POWER_LAW: {
+                /*pareto by inverse transform: most requests are tiny, a few are huge*/
+                double size = POWER_LAW_MIN / std::pow(1.0 - unit(rng), 1.0 / POWER_LAW_ALPHA);
+                return size > POWER_LAW_MAX ? POWER_LAW_MAX : (size_t)size;
+            }
+            case DIST_BIMODAL:
+                /*lots of small nodes mixed with a few page sized buffers*/
+                return rng() % 10 != 0 ? 16 + rng() % 49 : 4096 + rng() % 12289;
+            default:
+                return FIXED_SIZE;
+        }
+    }
+
+private:
+    SizeDistribution dist;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> unit;
+};
+
+#endif /* SIZE_DIST_H */
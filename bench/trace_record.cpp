@@ -0,0 +1,285 @@
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc_trace.h"
+
+/*
+ * Allocation trace recorder. Link it into any binary together with
+ *
+ *   -Wl,--wrap=_Z7smallocm,--wrap=_Z7scallocmm,--wrap=_Z5sfreePv,--wrap=_Z8sreallocPvm,--wrap=_Z9smemalignmm
+ *
+ * (the smalloc_trace CMake target does that) and every call is appended to
+ * the file named by $SMALLOC_TRACE, "smalloc.trace" by default.
+ * my_stdlib.h declares C++ functions, so the linker only knows their mangled
+ * names and the wrappers below have to be spelled the same way.
+ *
+ * The recorder must not allocate through the allocator it watches: the
+ * pointer to id table lives in its own mapping and records are buffered in a
+ * static array and written with write(2).
+ */
+
+extern "C" {
+void* __real__Z7smallocm(size_t size);
+void* __real__Z7scallocmm(size_t num, size_t size);
+void __real__Z5sfreePv(void* p);
+void* __real__Z8sreallocPvm(void* oldp, size_t size);
+void* __real__Z9smemalignmm(size_t alignment, size_t size);
+}
+
+#define TRACE_BUFFER_RECORDS (4096)
+#define ID_TABLE_INITIAL_CAPACITY (1 << 16)
+
+struct IdEntry {
+    void* ptr;
+    uint32_t id;
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_fd = -1;
+static bool trace_failed = false;
+static uint64_t trace_start_ns;
+static uint32_t next_id = 1;
+
+static TraceRecord buffer[TRACE_BUFFER_RECORDS];
+static size_t buffered = 0;
+
+static IdEntry* id_table = NULL;
+static size_t id_capacity = 0;
+static size_t id_count = 0;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static size_t slotOf(void* ptr, size_t capacity)
+{
+    /*blocks are 8 aligned, drop the low bits before mixing*/
+    uint64_t key = (uint64_t)ptr >> 3;
+    key *= 0x9e3779b97f4a7c15ull;
+    return (size_t)(key >> 20) & (capacity - 1);
+}
+
+static IdEntry* mapTable(size_t capacity)
+{
+    void* table = mmap(NULL, capacity * sizeof(IdEntry), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    return table == (void*)(-1) ? NULL : (IdEntry*)table;
+}
+
+static void insertId(IdEntry* table, size_t capacity, void* ptr, uint32_t id)
+{
+    size_t slot = slotOf(ptr, capacity);
+    while (table[slot].ptr != NULL && table[slot].ptr != ptr) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    table[slot].ptr = ptr;
+    table[slot].id = id;
+}
+
+static bool growIdTable()
+{
+    size_t new_capacity = id_capacity == 0 ? ID_TABLE_INITIAL_CAPACITY : 2 * id_capacity;
+    IdEntry* new_table = mapTable(new_capacity);
+    if (new_table == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < id_capacity; i++) {
+        if (id_table[i].ptr != NULL) {
+            insertId(new_table, new_capacity, id_table[i].ptr, id_table[i].id);
+        }
+    }
+
+    if (id_table != NULL) {
+        munmap(id_table, id_capacity * sizeof(IdEntry));
+    }
+    id_table = new_table;
+    id_capacity = new_capacity;
+    return true;
+}
+
+static uint32_t assignId(void* ptr)
+{
+    if (ptr == NULL) {
+        return 0;
+    }
+
+    if (4 * (id_count + 1) > 3 * id_capacity && !growIdTable()) {
+        trace_failed = true;
+        return 0;
+    }
+
+    uint32_t id = next_id++;
+    insertId(id_table, id_capacity, ptr, id);
+    id_count += 1;
+    return id;
+}
+
+static uint32_t takeId(void* ptr)
+{
+    /*linear probing delete: shift the rest of the cluster back so lookups never stop early*/
+    if (ptr == NULL || id_capacity == 0) {
+        return 0;
+    }
+
+    size_t slot = slotOf(ptr, id_capacity);
+    while (id_table[slot].ptr != ptr) {
+        if (id_table[slot].ptr == NULL) {
+            return 0;
+        }
+        slot = (slot + 1) & (id_capacity - 1);
+    }
+
+    uint32_t id = id_table[slot].id;
+    size_t hole = slot;
+    size_t next = (slot + 1) & (id_capacity - 1);
+    while (id_table[next].ptr != NULL) {
+        size_t home = slotOf(id_table[next].ptr, id_capacity);
+        /*move the entry into the hole unless its home lies cyclically in (hole, next]*/
+        bool stays = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stays) {
+            id_table[hole] = id_table[next];
+            hole = next;
+        }
+        next = (next + 1) & (id_capacity - 1);
+    }
+    id_table[hole].ptr = NULL;
+    id_count -= 1;
+    return id;
+}
+
+static void flushBuffer()
+{
+    const char* data = (const char*)buffer;
+    size_t left = buffered * sizeof(TraceRecord);
+    while (left > 0 && !trace_failed) {
+        ssize_t written = write(trace_fd, data, left);
+        if (written <= 0) {
+            trace_failed = true;
+            break;
+        }
+        data += written;
+        left -= (size_t)written;
+    }
+    buffered = 0;
+}
+
+static void flushAtExit()
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != -1) {
+        flushBuffer();
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+__attribute__((destructor)) static void closeTrace()
+{
+    flushAtExit();
+}
+
+static bool openTrace()
+{
+    const char* path = getenv("SMALLOC_TRACE");
+    if (path == NULL || path[0] == '\0') {
+        path = "smalloc.trace";
+    }
+
+    trace_fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if (trace_fd == -1) {
+        trace_failed = true;
+        return false;
+    }
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    if (write(trace_fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        trace_failed = true;
+        return false;
+    }
+
+    trace_start_ns = nowNs();
+    return true;
+}
+
+static void record(TraceOp op, size_t size, void* result, void* old_ptr, size_t alignment)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_failed || (trace_fd == -1 && !openTrace())) {
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+
+    TraceRecord& rec = buffer[buffered++];
+    rec.timestamp_ns = nowNs() - trace_start_ns;
+    rec.size = size;
+    rec.old_id = 0;
+    rec.id = 0;
+    if (op == TRACE_SFREE || op == TRACE_SREALLOC) {
+        /*a failed srealloc leaves the old block alive, keep its id*/
+        rec.old_id = (op == TRACE_SREALLOC && result == NULL) ? 0 : takeId(old_ptr);
+    }
+    if (op != TRACE_SFREE) {
+        rec.id = assignId(result);
+    }
+    rec.thread = (uint32_t)syscall(SYS_gettid);
+    rec.alignment = (uint16_t)(alignment == 0 ? 0 : __builtin_ctzl(alignment));
+    rec.op = (uint8_t)op;
+    rec.reserved = 0;
+
+    if (buffered == TRACE_BUFFER_RECORDS) {
+        flushBuffer();
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+extern "C" {
+
+void* __wrap__Z7smallocm(size_t size)
+{
+    void* result = __real__Z7smallocm(size);
+    record(TRACE_SMALLOC, size, result, NULL, 0);
+    return result;
+}
+
+void* __wrap__Z7scallocmm(size_t num, size_t size)
+{
+    void* result = __real__Z7scallocmm(num, size);
+    record(TRACE_SCALLOC, num * size, result, NULL, 0);
+    return result;
+}
+
+void __wrap__Z5sfreePv(void* p)
+{
+    __real__Z5sfreePv(p);
+    if (p != NULL) {
+        record(TRACE_SFREE, 0, NULL, p, 0);
+    }
+}
+
+void* __wrap__Z8sreallocPvm(void* oldp, size_t size)
+{
+    void* result = __real__Z8sreallocPvm(oldp, size);
+    record(TRACE_SREALLOC, size, result, oldp, 0);
+    return result;
+}
+
+void* __wrap__Z9smemalignmm(size_t alignment, size_t size)
+{
+    void* result = __real__Z9smemalignmm(alignment, size);
+    record(TRACE_SMEMALIGN, size, result, NULL, alignment);
+    return result;
+}
+
+} /* extern "C" */
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "alloc_trace.h"
+#include "bench_engine.h"
+
+/*
+ * Replays a trace written by trace_record.cpp against one engine.
+ *
+ *   trace_replay_malloc_3 TRACE [--timeline FILE] [--sample-every N] [--heap-map FILE]
+ *
+ * Reports total time, latency percentiles per op, the peak program break
+ * growth and the peak heap size: break growth plus the bytes the engine has
+ * mmapped, when it can report them. With --timeline, every N ops a CSV line
+ * with the break growth, the mmapped bytes and the _num_* stats is written. With --heap-map, the final heap is walked: every
+ * block goes to FILE as CSV and histograms of free and used block sizes are
+ * printed. Ops the engine does not have are skipped (malloc_1 cannot free,
+ * glibc has no stats).
+ */
+
+struct Trace {
+    const TraceRecord* records;
+    size_t count;
+};
+
+struct Options {
+    const char* trace_path;
+    const char* timeline_path;
+    size_t sample_every;
+    const char* heap_map_path;
+};
+
+#define SIZE_CLASSES (64)
+
+/* Per power of two size class */
+struct SizeHistogram {
+    size_t blocks[SIZE_CLASSES];
+    size_t bytes[SIZE_CLASSES];
+};
+
+struct HeapMap {
+    FILE* out;
+    const char* base;
+    SizeHistogram free_sizes;
+    SizeHistogram used_sizes;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s TRACE [--timeline FILE] [--sample-every N] [--heap-map FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { NULL, NULL, 1000, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            options.timeline_path = argv[++i];
+        } else if (strcmp(argv[i], "--sample-every") == 0 && i + 1 < argc) {
+            options.sample_every = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--heap-map") == 0 && i + 1 < argc) {
+            options.heap_map_path = argv[++i];
+        } else if (argv[i][0] != '-' && options.trace_path == NULL) {
+            options.trace_path = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.trace_path == NULL || options.sample_every == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static bool mapTrace(const char* path, Trace* trace)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == (void*)(-1)) {
+        perror(path);
+        return false;
+    }
+
+    const TraceHeader* header = (const TraceHeader*)data;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || header->version != TRACE_VERSION ||
+        header->record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: unsupported trace format\n", path);
+        return false;
+    }
+
+    trace->records = (const TraceRecord*)(header + 1);
+    trace->count = ((size_t)st.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    return true;
+}
+
+static size_t breakGrowth(void* base)
+{
+    return (size_t)((char*)sbrk(0) - (char*)base);
+}
+
+static size_t mappedBytes()
+{
+    return engineHas(_num_mapped_bytes) ? _num_mapped_bytes() : 0;
+}
+
+static void writeTimelineLine(FILE* timeline, size_t op_index, double elapsed_ns, void* base)
+{
+    fprintf(timeline, "%zu,%.0f,%zu,%zu", op_index, elapsed_ns, breakGrowth(base), mappedBytes());
+    if (engineHas(_num_allocated_blocks)) {
+        fprintf(timeline, ",%zu,%zu,%zu,%zu,%zu\n", _num_allocated_blocks(), _num_allocated_bytes(),
+                _num_free_blocks(), _num_free_bytes(), _num_meta_data_bytes());
+    } else {
+        fprintf(timeline, ",,,,,\n");
+    }
+}
+
+static int sizeClass(size_t size)
+{
+    return size == 0 ? 0 : 63 - __builtin_clzll((unsigned long long)size);
+}
+
+static int mapBlock(void* ptr, size_t size, bool is_free, bool is_mmapped, void* ctx)
+{
+    /*only the map file and fixed arrays are touched, nothing here allocates from the engine*/
+    HeapMap* map = (HeapMap*)ctx;
+    long offset = is_mmapped ? -1 : (long)((const char*)ptr - map->base);
+    fprintf(map->out, "%p,%ld,%zu,%s,%d\n", ptr, offset, size, is_free ? "free" : "used", is_mmapped ? 1 : 0);
+
+    SizeHistogram* histogram = is_free ? &map->free_sizes : &map->used_sizes;
+    histogram->blocks[sizeClass(size)] += 1;
+    histogram->bytes[sizeClass(size)] += size;
+    return 0;
+}
+
+static void printSizeHistogram(const char* title, const SizeHistogram& histogram)
+{
+    size_t most = 0;
+    for (int c = 0; c < SIZE_CLASSES; c++) {
+        most = std::max(most, histogram.blocks[c]);
+    }
+
+    printf("%s block sizes:\n", title);
+    for (int c = 0; c < SIZE_CLASSES; c++) {
+        if (histogram.blocks[c] == 0) {
+            continue;
+        }
+
+        char bar[41];
+        size_t width = histogram.blocks[c] * 40 / most;
+        width = width == 0 ? 1 : width;
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        printf("  [%10zu, %10zu) %8zu blocks %12zu bytes %s\n", (size_t)1 << c, (size_t)2 << c,
+               histogram.blocks[c], histogram.bytes[c], bar);
+    }
+}
+
+static bool dumpHeapMap(const char* path, void* base)
+{
+    if (!engineHas(_heap_walk)) {
+        fprintf(stderr, "%s cannot walk its heap, no heap map\n", BENCH_ENGINE);
+        return true;
+    }
+
+    static HeapMap map;
+    map.out = fopen(path, "w");
+    if (map.out == NULL) {
+        perror(path);
+        return false;
+    }
+    map.base = (const char*)base;
+    fprintf(map.out, "address,heap_offset,size,status,mmapped\n");
+
+    size_t blocks = _heap_walk(mapBlock, &map);
+    fclose(map.out);
+
+    printf("heap map: %zu blocks written to %s\n", blocks, path);
+    printSizeHistogram("free", map.free_sizes);
+    printSizeHistogram("used", map.used_sizes);
+    return true;
+}
+
+static double percentile(std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    size_t index = (size_t)(p * (double)(sorted.size() - 1));
+    return (double)sorted[index];
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    Trace trace;
+    if (!mapTrace(options.trace_path, &trace)) {
+        return 1;
+    }
+
+    /*everything the loop needs is allocated up front, so glibc does not move the break mid replay*/
+    uint32_t max_id = 0;
+    size_t op_counts[TRACE_OP_COUNT] = {};
+    for (size_t i = 0; i < trace.count; i++) {
+        max_id = std::max(max_id, trace.records[i].id);
+        if (trace.records[i].op < TRACE_OP_COUNT) {
+            op_counts[trace.records[i].op] += 1;
+        }
+    }
+
+    std::vector<void*> ptrs(max_id + 1, NULL);
+    std::vector<uint64_t> latencies[TRACE_OP_COUNT];
+    for (int op = 0; op < TRACE_OP_COUNT; op++) {
+        latencies[op].reserve(op_counts[op]);
+    }
+
+    FILE* timeline = NULL;
+    if (options.timeline_path != NULL) {
+        timeline = fopen(options.timeline_path, "w");
+        if (timeline == NULL) {
+            perror(options.timeline_path);
+            return 1;
+        }
+        fprintf(timeline, "op,elapsed_ns,break_bytes,mapped_bytes,allocated_blocks,allocated_bytes,free_blocks,free_bytes,meta_data_bytes\n");
+    }
+
+    void* base = sbrk(0);
+    size_t mapped_base = mappedBytes();
+    size_t peak_break = 0;
+    size_t peak_heap = 0;
+    size_t skipped = 0;
+    uint64_t total_ns = 0;
+    for (size_t i = 0; i < trace.count; i++) {
+        const TraceRecord& rec = trace.records[i];
+        void* result = NULL;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        switch (rec.op) {
+            case TRACE_SMALLOC:
+                result = smalloc(rec.size);
+                break;
+            case TRACE_SCALLOC:
+                result = engineHas(scalloc) ? scalloc(1, rec.size) : smalloc(rec.size);
+                break;
+            case TRACE_SFREE:
+                if (engineHas(sfree) && rec.old_id != 0) {
+                    sfree(ptrs[rec.old_id]);
+                    ptrs[rec.old_id] = NULL;
+                } else {
+                    skipped += 1;
+                }
+                break;
+            case TRACE_SREALLOC:
+                if (engineHas(srealloc)) {
+                    result = srealloc(ptrs[rec.old_id], rec.size);
+                    ptrs[rec.old_id] = NULL;
+                } else {
+                    result = smalloc(rec.size);
+                }
+                break;
+            case TRACE_SMEMALIGN:
+                result = engineHas(smemalign) ? smemalign((size_t)1 << rec.alignment, rec.size) : smalloc(rec.size);
+                break;
+            default:
+                skipped += 1;
+                break;
+        }
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        if (rec.id != 0) {
+            ptrs[rec.id] = result;
+        }
+        if (rec.op < TRACE_OP_COUNT) {
+            latencies[rec.op].push_back(ns);
+        }
+        total_ns += ns;
+        size_t break_bytes = breakGrowth(base);
+        peak_break = std::max(peak_break, break_bytes);
+        peak_heap = std::max(peak_heap, break_bytes + mappedBytes() - mapped_base);
+
+        if (timeline != NULL && i % options.sample_every == 0) {
+            writeTimelineLine(timeline, i, (double)total_ns, base);
+        }
+    }
+
+    if (timeline != NULL) {
+        fclose(timeline);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("engine: %s\n", BENCH_ENGINE);
+    printf("records: %zu (skipped %zu)\n", trace.count, skipped);
+    printf("total time: %.3f ms\n", (double)total_ns / 1e6);
+    printf("peak program break growth: %zu bytes\n", peak_break);
+    if (engineHas(_num_mapped_bytes)) {
+        printf("peak heap growth (break + mmapped): %zu bytes\n", peak_heap);
+    }
+    printf("max rss: %ld KB\n", usage.ru_maxrss);
+    if (engineHas(_num_allocated_bytes)) {
+        printf("final stats: allocated %zu blocks / %zu bytes, free %zu blocks / %zu bytes\n",
+               _num_allocated_blocks(), _num_allocated_bytes(), _num_free_blocks(), _num_free_bytes());
+    }
+
+    printf("op,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (int op = 0; op < TRACE_OP_COUNT; op++) {
+        std::vector<uint64_t>& samples = latencies[op];
+        if (samples.empty()) {
+            continue;
+        }
+
+        uint64_t sum = 0;
+        for (uint64_t sample : samples) {
+            sum += sample;
+        }
+        std::sort(samples.begin(), samples.end());
+        printf("%s,%zu,%.1f,%.0f,%.0f,%.0f,%.0f\n", traceOpName(op), samples.size(), (double)sum / (double)samples.size(),
+               percentile(samples, 0.5), percentile(samples, 0.99), percentile(samples, 0.999), (double)samples.back());
+    }
+
+    if (options.heap_map_path != NULL && !dumpHeapMap(options.heap_map_path, base)) {
+        return 1;
+    }
+
+    return 0;
+}
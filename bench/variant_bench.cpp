@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "../engine_variants.h"
+#include "size_dist.h"
+
+/*
+ * Every engine variant of a malloc_3 build with -DMALLOC_ENGINE_VARIANTS, in one
+ * process, on the same requests.
+ *
+ *   variant_bench_malloc_3 [--ops N] [--rounds R] [--steps N] [--slots S] [--dist NAME] [--csv FILE]
+ *
+ * Per variant and size distribution: ns/op of smalloc and sfree when --ops
+ * blocks are allocated and freed in random order (as in micro_bench), then
+ * ns/step of --steps random smalloc/sfree/srealloc steps over --slots live
+ * blocks (as in frag_bench) and the free blocks and external fragmentation
+ * left at the end of those. Results always go to stdout as CSV.
+ */
+
+struct Options {
+    size_t ops;
+    size_t rounds;
+    size_t steps;
+    size_t slots;
+    int dist; /*-1 for all of them*/
+    const char* csv_path;
+};
+
+struct Result {
+    const char* variant;
+    const char* dist;
+    double smalloc_ns;
+    double sfree_ns;
+    double mix_ns;
+    size_t free_blocks;
+    double fragmentation;
+};
+
+static double nanosecondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--ops N] [--rounds R] [--steps N] [--slots S] [--dist fixed|uniform|power_law|bimodal] [--csv FILE]\n", prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options = { 10000, 5, 100000, 10000, -1, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--ops") == 0) {
+            options.ops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rounds") == 0) {
+            options.rounds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--steps") == 0) {
+            options.steps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--slots") == 0) {
+            options.slots = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dist") == 0) {
+            SizeDistribution dist;
+            if (!parseDist(argv[++i], &dist)) {
+                usage(argv[0]);
+            }
+            options.dist = dist;
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            options.csv_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.ops == 0 || options.rounds == 0 || options.steps == 0 || options.slots == 0) {
+        usage(argv[0]);
+    }
+
+    return options;
+}
+
+static void timeOps(const EngineVariant& variant, SizeDistribution dist, const Options& options, Result& result)
+{
+    SizeSampler sampler(dist, 42);
+    std::vector<size_t> sizes(options.ops);
+    for (size_t i = 0; i < options.ops; i++) {
+        sizes[i] = sampler.next();
+    }
+
+    std::vector<size_t> free_order(options.ops);
+    std::iota(free_order.begin(), free_order.end(), 0);
+    std::shuffle(free_order.begin(), free_order.end(), std::mt19937(7));
+
+    std::vector<void*> ptrs(options.ops);
+    double malloc_ns = 0, free_ns = 0;
+    for (size_t round = 0; round < options.rounds; round++) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < options.ops; i++) {
+            ptrs[i] = variant.smalloc(sizes[i]);
+        }
+        malloc_ns += nanosecondsSince(begin);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < options.ops; i++) {
+            variant.sfree(ptrs[free_order[i]]);
+        }
+        free_ns += nanosecondsSince(begin);
+    }
+
+    result.smalloc_ns = malloc_ns / (double)(options.ops * options.rounds);
+    result.sfree_ns = free_ns / (double)(options.ops * options.rounds);
+}
+
+static void runMix(const EngineVariant& variant, SizeDistribution dist, const Options& options, Result& result)
+{
+    std::vector<void*> slots(options.slots, NULL);
+    std::vector<size_t> live;
+    live.reserve(options.slots);
+    std::mt19937_64 rng(1);
+    SizeSampler sampler(dist, 2);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (size_t step = 0; step < options.steps; step++) {
+        unsigned action = rng() % 100;
+        if (live.empty() || (action < 50 && live.size() < options.slots)) {
+            size_t index = 0;
+            while (slots[(step + index) % options.slots] != NULL) {
+                index++;
+            }
+            index = (step + index) % options.slots;
+            slots[index] = variant.smalloc(sampler.next());
+            if (slots[index] != NULL) {
+                live.push_back(index);
+            }
+        } else if (action < 85) {
+            size_t pick = rng() % live.size();
+            variant.sfree(slots[live[pick]]);
+            slots[live[pick]] = NULL;
+            live[pick] = live.back();
+            live.pop_back();
+        } else {
+            void*& slot = slots[live[rng() % live.size()]];
+            void* newp = variant.srealloc(slot, sampler.next());
+            if (newp != NULL) {
+                slot = newp;
+            }
+        }
+    }
+    result.mix_ns = nanosecondsSince(begin) / (double)options.steps;
+
+    size_t free_bytes = variant.num_free_bytes();
+    result.free_blocks = variant.num_free_blocks();
+    result.fragmentation = free_bytes != 0 ? 1.0 - (double)variant.largest_free_block() / (double)free_bytes : 0;
+    for (size_t index : live) {
+        variant.sfree(slots[index]);
+    }
+}
+
+static void writeCsv(FILE* out, const std::vector<Result>& results)
+{
+    fprintf(out, "variant,distribution,smalloc_ns,sfree_ns,mix_ns_per_step,free_blocks,external_fragmentation\n");
+    for (const Result& result : results) {
+        fprintf(out, "%s,%s,%.2f,%.2f,%.2f,%zu,%.4f\n", result.variant, result.dist, result.smalloc_ns, result.sfree_ns,
+                result.mix_ns, result.free_blocks, result.fragmentation);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+    const EngineVariant* variants;
+    size_t count = _engine_variants(&variants);
+
+    std::vector<Result> results;
+    for (int dist = 0; dist < DIST_COUNT; dist++) {
+        if (options.dist != -1 && options.dist != dist) {
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            Result result = { variants[i].name, distName((SizeDistribution)dist), 0, 0, 0, 0, 0 };
+            timeOps(variants[i], (SizeDistribution)dist, options, result);
+            runMix(variants[i], (SizeDistribution)dist, options, result);
+            results.push_back(result);
+        }
+    }
+
+    writeCsv(stdout, results);
+    if (options.csv_path != NULL) {
+        FILE* out = fopen(options.csv_path, "w");
+        if (out == NULL) {
+            perror(options.csv_path);
+            return 1;
+        }
+        writeCsv(out, results);
+        fclose(out);
+    }
+
+    return 0;
+}
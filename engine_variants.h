@@ -0,0 +1,24 @@
+#ifndef ENGINE_VARIANTS_H
+#define ENGINE_VARIANTS_H
+
+#include <stddef.h>
+
+/* One engine configuration of malloc_3 built with -DMALLOC_ENGINE_VARIANTS, called
+ * through these so that several of them can run in one process. The first is
+ * smalloc and friends themselves, every other one has a heap of its own, and a
+ * block has to go back to the variant it came from */
+struct EngineVariant {
+    const char* name;
+    void* (*smalloc)(size_t size);
+    void (*sfree)(void* p);
+    void* (*srealloc)(void* oldp, size_t size);
+    size_t (*num_free_blocks)();
+    size_t (*num_free_bytes)();
+    size_t (*num_allocated_bytes)();
+    size_t (*largest_free_block)();
+};
+
+/* Points *variants at the built in variants and returns how many there are */
+size_t _engine_variants(const EngineVariant** variants);
+
+#endif /* ENGINE_VARIANTS_H */
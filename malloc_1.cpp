@@ -1,14 +1,92 @@
 #include <unistd.h>
+#include <stdint.h>
+
+#define ALIGNMENT (16)
+#define CHUNK_SIZE (0x100000)
+#define TRIM_THRESHOLD (4 * CHUNK_SIZE)
+
+/*
+ * A bump allocator over the program break. The break is grown CHUNK_SIZE bytes
+ * at a time and smalloc only moves a pointer inside what is already reserved.
+ * Nothing is freed one by one: smark() remembers the bump pointer and
+ * srelease() rolls it back, giving the break back once more than
+ * TRIM_THRESHOLD bytes are unused past it.
+ */
+struct BumpArena {
+    char* start; /*first byte handed out since the break was last taken over*/
+    char* bump; /*next byte to hand out*/
+    char* end; /*the program break as we left it*/
+};
+
+static BumpArena arena = {NULL, NULL, NULL};
+
+static uintptr_t alignUp(uintptr_t value, uintptr_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/* Makes room for size bytes at the bump pointer, false if sbrk fails */
+static bool reserve(size_t size) {
+    char* brk = (char*)sbrk(0);
+    if (brk == (char*)(-1)) {
+        return false;
+    }
+
+    /*someone else moved the break, start over at the new one*/
+    if (brk != arena.end) {
+        arena.start = (char*)alignUp((uintptr_t)brk, ALIGNMENT);
+        arena.bump = arena.start;
+        arena.end = brk;
+    }
+
+    size_t missing = (size_t)(arena.bump + size - arena.end);
+    size_t grow = alignUp(missing, CHUNK_SIZE);
+    if (sbrk((intptr_t)grow) == (void*)(-1)) {
+        return false;
+    }
+
+    arena.end += grow;
+    return true;
+}
 
 void* smalloc(size_t size) {
     if (size == 0 || size > 1e8) {
         return NULL;
     }
 
-    void* ret_ptr = sbrk((intptr_t)size);
-    if (ret_ptr == (void*)(-1)) {
-        return NULL;
+    size = alignUp(size, ALIGNMENT);
+    if (arena.bump == NULL || (size_t)(arena.end - arena.bump) < size) {
+        if (!reserve(size)) {
+            return NULL;
+        }
     }
 
+    void* ret_ptr = arena.bump;
+    arena.bump += size;
     return ret_ptr;
 }
+
+void* smark() {
+    if (arena.bump == NULL && !reserve(0)) {
+        return NULL;
+    }
+
+    return arena.bump;
+}
+
+void srelease(void* mark) {
+    char* to = (char*)mark;
+    if (to == NULL || to < arena.start || to > arena.bump) {
+        return;
+    }
+
+    arena.bump = to;
+    if ((size_t)(arena.end - arena.bump) <= TRIM_THRESHOLD || sbrk(0) != arena.end) {
+        return;
+    }
+
+    /*keep a chunk of slack so the next smalloc does not grow the break right away*/
+    size_t trim = (size_t)(arena.end - arena.bump) - CHUNK_SIZE;
+    if (sbrk(-(intptr_t)trim) != (void*)(-1)) {
+        arena.end -= trim;
+    }
+}
@@ -3,17 +3,28 @@
 
 #define META_TO_DATA_PTR(block_ptr) ((void*)((MallocMetadata*)block_ptr+1))
 #define DATA_TO_META_PTR(data_ptr) ((MallocMetadata*)data_ptr-1)
+#define SPLIT_THRESHOLD (4096)
 
-
+/*
+ * Only free blocks are linked, in address order, so smalloc never visits an
+ * allocated one. A free block big enough to leave a header and SPLIT_THRESHOLD
+ * bytes behind is split, the rest takes its place in the list. Nothing is merged
+ * back, so a smaller threshold cuts big blocks into slivers that every large
+ * request has to walk past.
+ * -DMALLOC_2_NEXT_FIT starts every search where the last one stopped instead of
+ * at the lowest address.
+ */
 struct MallocMetadata {
     size_t block_size;
     bool is_free;
-    MallocMetadata* next;
-    MallocMetadata* prev;
+    MallocMetadata* next; /*next free block*/
+    MallocMetadata* prev; /*previous free block*/
 };
 
 struct GlobalMetadata {
-    MallocMetadata* head;
+    MallocMetadata* head; /*lowest free block*/
+    MallocMetadata* tail; /*highest free block*/
+    MallocMetadata* rover; /*where the next fit search starts*/
     size_t free_blocks;
     size_t free_bytes;
     size_t allocated_blocks;
@@ -21,53 +32,127 @@ struct GlobalMetadata {
 };
 
 /* TODO: is it okay if we make this static? */
-GlobalMetadata global_ptr = {NULL, 0, 0, 0, 0};
-//global_ptr.head = NULL;
-//global_ptr.free_blocks = 0;
-//global_ptr.free_bytes = 0;
-//global_ptr.allocated_blocks = 0;
-//global_ptr.allocated_bytes = 0;
+GlobalMetadata global_ptr = {NULL, NULL, NULL, 0, 0, 0, 0};
 
-/*
-void alignInitialProgBreak() {
-    void* sbrk_ptr = sbrk(sizeof(*global_ptr));
-    if (sbrk_ptr != (void*)(-1)) {
-        global_ptr = (GlobalMetadata*)sbrk_ptr;
-        global_ptr.head = NULL;
-        global_ptr.free_blocks = 0;
-        global_ptr.free_bytes = 0;
-        global_ptr.allocated_blocks = 0;
-        global_ptr.allocated_bytes = 0;
+/* Links a free block between prev and next */
+static void freeListLink(MallocMetadata* block, MallocMetadata* prev, MallocMetadata* next) {
+    block->prev = prev;
+    block->next = next;
+
+    if (prev != NULL) {
+        prev->next = block;
+    } else {
+        global_ptr.head = block;
+    }
+
+    if (next != NULL) {
+        next->prev = block;
+    } else {
+        global_ptr.tail = block;
     }
 }
-*/
 
-void* smalloc(size_t size) {
-    if (size == 0 || size > (size_t)1e8) {
-        return NULL;
+/* Adds a block to the free list, keeping the address order */
+static void freeListInsert(MallocMetadata* block) {
+    /*blocks freed in allocation order land at the end, check there first*/
+    if (global_ptr.tail == NULL || global_ptr.tail < block) {
+        freeListLink(block, global_ptr.tail, NULL);
+        return;
     }
 
-    /*
-    if (global_ptr == NULL) {
-        alignInitialProgBreak();
-        if (global_ptr == NULL) {
-            return NULL;
+    /*with next fit the block was most likely taken right before the rover, start there*/
+    MallocMetadata* next = global_ptr.rover != NULL ? global_ptr.rover : global_ptr.head;
+    while (next->prev != NULL && next->prev > block) {
+        next = next->prev;
+    }
+    while (next < block) {
+        next = next->next;
+    }
+    freeListLink(block, next->prev, next);
+}
+
+static void freeListRemove(MallocMetadata* block) {
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        global_ptr.head = block->next;
+    }
+
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    } else {
+        global_ptr.tail = block->prev;
+    }
+
+    if (global_ptr.rover == block) {
+        global_ptr.rover = block->next;
+    }
+}
+
+/* Returns the first free block of at least size bytes, NULL if there is none */
+static MallocMetadata* findFit(size_t size) {
+#ifdef MALLOC_2_NEXT_FIT
+    MallocMetadata* start = global_ptr.rover != NULL ? global_ptr.rover : global_ptr.head;
+    for (MallocMetadata* curr = start; curr != NULL; curr = curr->next) {
+        if (curr->block_size >= size) {
+            return curr;
         }
     }
-     */
 
-    MallocMetadata* curr = global_ptr.head;
-    MallocMetadata* prev = NULL;
-    while (curr != NULL) {
-        if (curr->is_free == true && curr->block_size >= size) {
-            curr->is_free = false;
-            global_ptr.free_bytes -= curr->block_size;
-            global_ptr.free_blocks -= 1;
-            return META_TO_DATA_PTR(curr);
+    for (MallocMetadata* curr = global_ptr.head; curr != start; curr = curr->next) {
+        if (curr->block_size >= size) {
+            return curr;
+        }
+    }
+#else
+    for (MallocMetadata* curr = global_ptr.head; curr != NULL; curr = curr->next) {
+        if (curr->block_size >= size) {
+            return curr;
         }
+    }
+#endif
+
+    return NULL;
+}
+
+/* Takes a free block out of the free list for size bytes, splitting off what is left */
+static void takeBlock(MallocMetadata* block, size_t size) {
+    global_ptr.free_bytes -= block->block_size;
+    global_ptr.free_blocks -= 1;
+    block->is_free = false;
 
-        prev = curr;
-        curr = curr->next;
+    if (block->block_size < size + sizeof(MallocMetadata) + SPLIT_THRESHOLD) {
+        freeListRemove(block);
+        return;
+    }
+
+    MallocMetadata* rest = (MallocMetadata*)((char*)META_TO_DATA_PTR(block) + size);
+    rest->block_size = block->block_size - size - sizeof(MallocMetadata);
+    rest->is_free = true;
+    freeListLink(rest, block->prev, block->next);
+    if (global_ptr.rover == block) {
+        global_ptr.rover = rest;
+    }
+    block->block_size = size;
+
+    global_ptr.free_bytes += rest->block_size;
+    global_ptr.free_blocks += 1;
+    global_ptr.allocated_bytes -= sizeof(MallocMetadata);
+    global_ptr.allocated_blocks += 1;
+}
+
+void* smalloc(size_t size) {
+    if (size == 0 || size > (size_t)1e8) {
+        return NULL;
+    }
+
+    MallocMetadata* curr = findFit(size);
+    if (curr != NULL) {
+#ifdef MALLOC_2_NEXT_FIT
+        global_ptr.rover = curr;
+#endif
+        takeBlock(curr, size);
+        return META_TO_DATA_PTR(curr);
     }
 
     curr = (MallocMetadata*)sbrk((intptr_t)(sizeof(MallocMetadata) + size));
@@ -77,17 +162,9 @@ void* smalloc(size_t size) {
 
     curr->is_free = false;
     curr->block_size = size;
-    curr->prev = prev;
+    curr->prev = NULL;
     curr->next = NULL;
 
-    if (prev != NULL) {
-        prev->next = curr;
-    }
-
-    if (global_ptr.head == NULL) {
-        global_ptr.head = curr;
-    }
-
     global_ptr.allocated_bytes += size;
     global_ptr.allocated_blocks += 1;
 
@@ -111,6 +188,7 @@ void sfree(void* p) {
     MallocMetadata* metadata_ptr = DATA_TO_META_PTR(p);
     if (metadata_ptr->is_free == false) {
         metadata_ptr->is_free = true;
+        freeListInsert(metadata_ptr);
         global_ptr.free_bytes += metadata_ptr->block_size;
         global_ptr.free_blocks += 1;
     }
@@ -134,7 +212,7 @@ void* srealloc(void* oldp, size_t size) {
             return NULL;
         }
 
-        void* move_ret = memmove(newp, oldp, size);
+        void* move_ret = memmove(newp, oldp, old_meta_ptr->block_size);
         if (move_ret != newp) {
             /* TODO: Should we somehow undo the allocation of newp? */
             return NULL;
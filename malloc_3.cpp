@@ -3,27 +3,41 @@
 #include <sys/mman.h>
 #include <cassert>
 #include <exception>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <time.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <type_traits>
 
 #include <stdio.h>
 
+#include "malloc_stats.h"
+#include "engine_variants.h"
+
 #define META_TO_DATA_PTR(block_ptr) ((void*)((MallocMetadata*)block_ptr+1))
 #define DATA_TO_META_PTR(data_ptr) ((MallocMetadata*)data_ptr-1)
-#define SPLIT_THRESHOLD (128)
-#define MMAP_THRESHOLD (0x20000)
 #define IS_MMAP (true)
 #define NOT_MMAP (false)
+#define REGION_DEFAULT_CHUNK_SIZE (0x10000)
 
 
 class OutOfMemory : public std::exception {};
 
 
-typedef enum { FREE , OCCUPIED} block_status;
+/*DEFERRED blocks were freed but are neither merged nor in the size list yet*/
+typedef enum { FREE , OCCUPIED, DEFERRED} block_status;
 
 
 struct MallocMetadata {
     size_t block_size;  /* 8 bytes */
     block_status status; /* 4 bytes */
     bool is_mmapped; /* 1 byte */
+    bool is_sampled; /* 1 byte, fits in the padding. Set while the heap profiler tracks the block */
+    unsigned char dirty_slot; /* 1 byte, also padding. 1 + the index of a free block in the dirty set, else 0 */
     MallocMetadata* next; /* 8 bytes */
     MallocMetadata* prev; /* 8 bytes */
     MallocMetadata* free_by_size_next; /* 8 bytes */
@@ -31,11 +45,10 @@ struct MallocMetadata {
     /*TODO: ask is we should enforce our struck to by *8 or can we rely on compilers padding */
 };
 
-struct GlobalMetadata {
+/*the block lists and counters of one engine*/
+struct HeapMetadata {
     MallocMetadata* head; /*head of the memory sorted list*/
     MallocMetadata* tail; /*the last node of memory list - wilderness*/
-    MallocMetadata* free_by_size_head; /*head of the size sorted list*/
-    MallocMetadata* free_by_size_tail; /*the last node of size sorted list*/
     MallocMetadata* mmap_head; /*head of the mmapped list*/
     size_t free_blocks;
     size_t free_bytes;
@@ -43,14 +56,601 @@ struct GlobalMetadata {
     size_t allocated_bytes;
 };
 
-GlobalMetadata global_ptr = { NULL, NULL, NULL, NULL, NULL, 0,  0, 0, 0};
-bool do_setup = true;
+/*------------------engine configuration--------------*/
+
+typedef enum { FIT_FIRST, FIT_NEXT, FIT_BEST } fit_policy;
+
+class SizeOrderedList;
+class PackedSizeIndex;
+class AddressOrderedList;
+
+/* The tunables of an engine as compile time constants. The fit policy, the free
+ * index and the alignment are fixed per configuration, the two thresholds are
+ * only the defaults of the run time Tunables further down. FIT_BEST takes the
+ * smallest block from the free index, FIT_FIRST the lowest free block that fits
+ * and FIT_NEXT the first one that fits after where the last search stopped.
+ * FreeIndex is SizeOrderedList or PackedSizeIndex for FIT_BEST and
+ * AddressOrderedList for the other two, see the free indexes below.
+ * Block headers sit right before the data, so the alignment has to divide the
+ * header size as well as be a power of two. */
+template <fit_policy Fit, class FreeIndex, size_t SplitThreshold, size_t MmapThreshold, size_t Alignment>
+struct EngineConfig {
+    static_assert(Alignment >= 8 && (Alignment & (Alignment - 1)) == 0, "alignment must be a power of two of at least 8");
+    static_assert(sizeof(MallocMetadata) % Alignment == 0, "the block header must keep the data aligned");
+    static_assert(MmapThreshold % Alignment == 0, "the mmap threshold must be aligned");
+    static_assert(FreeIndex::address_ordered == (Fit != FIT_BEST), "best fit needs a size ordered free index, first and next fit an address ordered one");
+
+    typedef FreeIndex free_index;
+
+    static constexpr fit_policy fit() { return Fit; }
+    static constexpr size_t splitThreshold() { return SplitThreshold; }
+    static constexpr size_t mmapThreshold() { return MmapThreshold; }
+    static constexpr size_t alignment() { return Alignment; }
+
+    /* Rounds size up to the alignment, sizes within the alignment of SIZE_MAX wrap to 0 */
+    static constexpr size_t alignSize(size_t size) { return (size + Alignment - 1) & ~(Alignment - 1); }
+};
+
+/* The configuration of smalloc and friends, picked with -DMALLOC_FIT_POLICY=FIT_FIRST etc.
+ * and -DMALLOC_PACKED_FREE_INDEX, which only applies to best fit */
+#ifndef MALLOC_FIT_POLICY
+#define MALLOC_FIT_POLICY FIT_BEST
+#endif
+#ifndef MALLOC_SPLIT_THRESHOLD
+#define MALLOC_SPLIT_THRESHOLD 128
+#endif
+#ifndef MALLOC_MMAP_THRESHOLD
+#define MALLOC_MMAP_THRESHOLD 0x20000
+#endif
+#ifndef MALLOC_ALIGNMENT
+#define MALLOC_ALIGNMENT 8
+#endif
+#ifdef MALLOC_PACKED_FREE_INDEX
+#define MALLOC_SIZE_INDEX PackedSizeIndex
+#else
+#define MALLOC_SIZE_INDEX SizeOrderedList
+#endif
+
+typedef std::conditional<MALLOC_FIT_POLICY == FIT_BEST, MALLOC_SIZE_INDEX, AddressOrderedList>::type DefaultFreeIndex;
+typedef EngineConfig<MALLOC_FIT_POLICY, DefaultFreeIndex, MALLOC_SPLIT_THRESHOLD, MALLOC_MMAP_THRESHOLD, MALLOC_ALIGNMENT> Config;
+
+/*where _heap_walk_step resumes: the next block to visit, NULL at the end of the
+ *list it is in. Merges and unmaps move it on*/
+struct HeapWalkCursor {
+    MallocMetadata* next;
+    bool in_mmap_list;
+    bool active;
+};
+
+typedef int (*heap_walk_callback)(void* ptr, size_t size, bool is_free, bool is_mmapped, void* ctx);
+
+/*------------------runtime tuning--------------*/
+
+/* smallopt parameters. Each can also be set with the environment variable in
+ * its comment, read once when the allocator is first used */
+typedef enum {
+    SMALLOPT_MMAP_THRESHOLD, /*SMALLOC_MMAP_THRESHOLD: requests of at least this many bytes are mmapped*/
+    SMALLOPT_SPLIT_THRESHOLD, /*SMALLOC_SPLIT_THRESHOLD: smallest leftover worth splitting off*/
+    SMALLOPT_TRIM_THRESHOLD, /*SMALLOC_TRIM_THRESHOLD: free top of the heap given back past this, -1 never*/
+    SMALLOPT_TOP_PAD, /*SMALLOC_TOP_PAD: extra bytes taken whenever the heap grows*/
+    SMALLOPT_ARENA_MAX, /*SMALLOC_ARENA_MAX: there is a single arena, so only 1*/
+    SMALLOPT_PURGE_DECAY_MS, /*SMALLOC_PURGE_DECAY_MS: how often free pages are madvised away, -1 never*/
+    SMALLOPT_PARAMS
+} smallopt_param;
+
+/* The run time values of the thresholds, starting from the engine's Config. Blocks keep what
+ * they were given, so a new value only applies to later allocations and frees */
+struct Tunables {
+    size_t mmap_threshold;
+    size_t split_threshold;
+    long trim_threshold;
+    size_t top_pad;
+    long arena_max;
+    long purge_decay_ms;
+    long last_purge_ms;
+};
+
+/*------------------engine--------------*/
+
+/* Free blocks whose pages were written since they were last purged, so a decayed
+ * purge only madvises these instead of every free block. Every member is in the
+ * free index, and forgetDirty is called for each block the index gives up */
+
+#define DIRTY_SET_MAX (64)
+
+struct DirtySet {
+    MallocMetadata* blocks[DIRTY_SET_MAX];
+    size_t count;
+};
+
+#ifdef MALLOC_DEFERRED_COALESCE
+#define DEFERRED_BIN_MAX (64)
+
+/*see deferred coalescing below*/
+struct DeferredBin {
+    MallocMetadata* head;
+    size_t count;
+};
+#endif
+
+#ifdef MALLOC_QUICK_LISTS
+#define QUICK_LIST_SIZES (4)
+#define QUICK_LIST_MAX (64) /*blocks per list*/
+
+/*see quick lists below*/
+struct QuickLists {
+    MallocMetadata* heads[QUICK_LIST_SIZES];
+    size_t counts[QUICK_LIST_SIZES];
+    size_t blocks; /*on all lists*/
+};
+#endif
+
+/* Where an engine's heap grows: the program break, or a private break inside an
+ * address range reserved with mmap. Only one engine may use the program break */
+typedef enum { PROGRAM_BREAK, MAPPED_ARENA } heap_source;
+
+#define MAPPED_ARENA_RESERVE (1UL << 32) /*address space of one arena, only pages below its break are touched*/
+
+/* One heap of one configuration: its block lists and counters, free index, fit
+ * tunables, dirty set and bins. smalloc and friends are thin wrappers
+ * around heap_engine, the instance on the program break; more instances, each
+ * in an arena of its own, can run other configurations in the same process.
+ * The page map, the syscall counters, the heap profiler and the latency
+ * histograms stay per process. The constructor is constexpr so heap_engine is
+ * ready before any constructor runs, an LD_PRELOAD shim may call it that early */
+template <class Config>
+class Engine {
+public:
+    constexpr explicit Engine(heap_source source)
+        : heap{ NULL, NULL, NULL, 0, 0, 0, 0 },
+          free_index(),
+          heap_walk_cursor{ NULL, false, false },
+          tunables{ Config::mmapThreshold(), Config::splitThreshold(), -1, 0, 1, -1, 0 },
+          dirty_set{ { NULL }, 0 },
+#ifdef MALLOC_DEFERRED_COALESCE
+          deferred_bin{ NULL, 0 },
+#endif
+#ifdef MALLOC_QUICK_LISTS
+          quick_lists{ { NULL, NULL, NULL, NULL }, { 0, 0, 0, 0 }, 0 },
+#endif
+          source(source),
+          arena_start(NULL),
+          arena_break(NULL),
+          arena_end(NULL),
+          do_setup(true) {}
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    void* allocate(size_t size);
+    void* allocateBlock(size_t size);
+    void* allocateAligned(size_t alignment, size_t size);
+    void* reallocate(void* oldp, size_t size);
+    void deallocate(void* p);
+    bool owns(void* p, void* owner);
+    void freeBlock(void* p);
+    void shrinkTop(MallocMetadata* block, size_t size);
+
+    const HeapMetadata& blockStats();
+    size_t largestFreeBlock();
+    bool setOption(int param, long value);
+    bool option(int param, long* value);
+    size_t walk(heap_walk_callback callback, void* ctx);
+    size_t walkStep(heap_walk_callback callback, void* ctx, size_t max_blocks);
+    void rewindWalk();
+
+private:
+    int setup();
+    int reserveArena();
+    int alignHeapEnd();
+    void* growHeap(intptr_t increment);
+    char* heapEnd();
+    bool setTunable(int param, long value);
+    void readTunablesFromEnvironment();
+
+    void updateStats(long free_blocks, long free_bytes, long allocated_blocks, long allocated_bytes);
+    void forgetDirty(MallocMetadata* block);
+    void markDirty(MallocMetadata* block);
+    void purgeDirtyBlocks();
+    void purgeFreeBlocks(MallocMetadata* freed);
+    void insertToFreeIndex(MallocMetadata* meta);
+    void removeFromFreeIndex(MallocMetadata* meta);
+
+    void appendToMemoryList(MallocMetadata* meta);
+    bool isWilderness(MallocMetadata* block);
+    MallocMetadata* findFit(size_t size);
+    void mergeWithUpper(MallocMetadata* block, block_status status);
+    void mergeWithLower(MallocMetadata* block, block_status status);
+    void splitBlock(MallocMetadata* block_to_split, size_t new_size);
+    MallocMetadata* freeAndMergeAdjacent(MallocMetadata* block);
+    void trimWilderness();
+    void splitTopPad(MallocMetadata* block, size_t size);
+    MallocMetadata* tryToReuseOrMerge(MallocMetadata* block, size_t size);
+    void prependToMmapList(MallocMetadata* block);
+    void removeFromMmapList(MallocMetadata* meta);
+    void* mmapAligned(size_t alignment, size_t aligned_size);
+
+#ifdef MALLOC_DEFERRED_COALESCE
+    void unlinkDeferred(MallocMetadata* block);
+    void consolidateDeferred();
+    void deferFree(MallocMetadata* block);
+    MallocMetadata* takeDeferred(size_t size);
+#endif
+#ifdef MALLOC_QUICK_LISTS
+    void consolidateQuickLists();
+    bool pushQuickList(MallocMetadata* block);
+    MallocMetadata* popQuickList(size_t size);
+#endif
+
+    HeapMetadata heap;
+    typename Config::free_index free_index;
+    HeapWalkCursor heap_walk_cursor;
+    Tunables tunables;
+    DirtySet dirty_set;
+#ifdef MALLOC_DEFERRED_COALESCE
+    DeferredBin deferred_bin;
+#endif
+#ifdef MALLOC_QUICK_LISTS
+    QuickLists quick_lists;
+#endif
+    heap_source source;
+    char* arena_start; /*the reservation of a MAPPED_ARENA engine, NULL until its setup*/
+    char* arena_break;
+    char* arena_end;
+    bool do_setup;
+};
+
+static const char* smallopt_env_names[SMALLOPT_PARAMS] = { "SMALLOC_MMAP_THRESHOLD", "SMALLOC_SPLIT_THRESHOLD",
+                                                           "SMALLOC_TRIM_THRESHOLD", "SMALLOC_TOP_PAD",
+                                                           "SMALLOC_ARENA_MAX", "SMALLOC_PURGE_DECAY_MS" };
+
+/* Validates and stores one parameter, false leaves it unchanged */
+template <class Config>
+bool Engine<Config>::setTunable(int param, long value)
+{
+    switch (param) {
+        case SMALLOPT_MMAP_THRESHOLD:
+            if (value <= 0 || value > (long)1e8 + (long)Config::alignment()) {
+                return false;
+            }
+            tunables.mmap_threshold = Config::alignSize((size_t)value);
+            return true;
+        case SMALLOPT_SPLIT_THRESHOLD:
+            if (value < 0 || value > (long)1e8) {
+                return false;
+            }
+            tunables.split_threshold = (size_t)value;
+            return true;
+        case SMALLOPT_TRIM_THRESHOLD:
+            if (value < -1) {
+                return false;
+            }
+            tunables.trim_threshold = value;
+            return true;
+        case SMALLOPT_TOP_PAD:
+            if (value < 0 || value > (long)1e8) {
+                return false;
+            }
+            tunables.top_pad = Config::alignSize((size_t)value);
+            return true;
+        case SMALLOPT_ARENA_MAX:
+            if (value != 1) {
+                return false;
+            }
+            tunables.arena_max = value;
+            return true;
+        case SMALLOPT_PURGE_DECAY_MS:
+            if (value < -1) {
+                return false;
+            }
+            tunables.purge_decay_ms = value;
+            return true;
+        default:
+            return false;
+    }
+}
+
+template <class Config>
+void Engine<Config>::readTunablesFromEnvironment()
+{
+    for (int param = 0; param < SMALLOPT_PARAMS; param++) {
+        const char* text = getenv(smallopt_env_names[param]);
+        if (text == NULL) {
+            continue;
+        }
+
+        /*malformed values keep the default, like rejected ones*/
+        char* end;
+        long value = strtol(text, &end, 0);
+        if (end != text && *end == '\0') {
+            setTunable(param, value);
+        }
+    }
+}
+
+/*------------------USDT probes--------------*/
+
+/* Static tracepoints for perf/bpftrace under the provider malloc_3, e.g.
+ *   bpftrace -e 'usdt:./a.out:malloc_3:srealloc_case { @[arg1] = count(); }'
+ * A probe is a single nop until a tracer attaches. Without <sys/sdt.h> (or with
+ * -DMALLOC_NO_USDT) they compile to nothing and their arguments are not evaluated. */
+
+#if !defined(MALLOC_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MALLOC_USDT
+#endif
+#endif
+
+#ifdef MALLOC_USDT
+#define PROBE1(name, a) DTRACE_PROBE1(malloc_3, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(malloc_3, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(malloc_3, name, a, b, c)
+#else
+#define PROBE1(name, a) do {} while (0)
+#define PROBE2(name, a, b) do {} while (0)
+#define PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+/*------------------page map--------------*/
+
+/* Which heap span owns an address: a 3 level radix tree over the 48 bit user
+ * address space, one entry per 4K page (12 bits per level). A page of an
+ * engine's heap maps to that Engine, a page of an mmapped block to that block's
+ * header, anything else to NULL. Moving an engine's break and heapMunmap keep
+ * the heap pages up to date, mmapped blocks are recorded once their header is placed.
+ * Nodes are allocated on first use and never freed, so pageMapGet needs no lock. */
+
+#define PAGE_MAP_PAGE_SHIFT (12)
+#define PAGE_MAP_LEVEL_BITS (12)
+#define PAGE_MAP_FANOUT (1UL << PAGE_MAP_LEVEL_BITS)
+#define PAGE_MAP_ADDRESS_BITS (PAGE_MAP_PAGE_SHIFT + 3 * PAGE_MAP_LEVEL_BITS)
+
+struct PageMapNode {
+    void* entries[PAGE_MAP_FANOUT]; /*child nodes, or owners in the leaves*/
+};
+
+PageMapNode page_map_root = { { NULL } };
+
+inline size_t pageMapIndex(unsigned long page, int level)
+{
+    /*level 0 is the root*/
+    return (page >> ((2 - level) * PAGE_MAP_LEVEL_BITS)) & (PAGE_MAP_FANOUT - 1);
+}
+
+void* pageMapGet(const void* addr)
+{
+    if ((unsigned long)addr >> PAGE_MAP_ADDRESS_BITS) {
+        return NULL;
+    }
+
+    unsigned long page = (unsigned long)addr >> PAGE_MAP_PAGE_SHIFT;
+    PageMapNode* node = &page_map_root;
+    for (int level = 0; level < 2; level++) {
+        node = (PageMapNode*)__atomic_load_n(&node->entries[pageMapIndex(page, level)], __ATOMIC_ACQUIRE);
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+
+    return __atomic_load_n(&node->entries[pageMapIndex(page, 2)], __ATOMIC_ACQUIRE);
+}
+
+PageMapNode* pageMapLeaf(unsigned long page, bool create)
+{
+    PageMapNode* node = &page_map_root;
+    for (int level = 0; level < 2; level++) {
+        void** slot = &node->entries[pageMapIndex(page, level)];
+        PageMapNode* child = (PageMapNode*)__atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (child == NULL) {
+            if (!create) {
+                return NULL;
+            }
+
+            /*not a heap mapping, so it stays out of the syscall counters*/
+            child = (PageMapNode*)mmap(NULL, sizeof(PageMapNode), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if ((void*)child == (void*)(-1)) {
+                return NULL;
+            }
+            __atomic_store_n(slot, (void*)child, __ATOMIC_RELEASE);
+        }
+        node = child;
+    }
+
+    return node;
+}
+
+/* Sets every page overlapping [start, end) to owner. Fails only when a node for a
+ * non NULL owner cannot be mapped; pages set before that keep the new owner */
+bool pageMapSet(const void* start, const void* end, void* owner)
+{
+    unsigned long first = (unsigned long)start >> PAGE_MAP_PAGE_SHIFT;
+    unsigned long last = ((unsigned long)end - 1) >> PAGE_MAP_PAGE_SHIFT;
+    if (end <= start || ((unsigned long)end - 1) >> PAGE_MAP_ADDRESS_BITS) {
+        return end <= start;
+    }
+
+    for (unsigned long page = first; page <= last; page++) {
+        PageMapNode* leaf = pageMapLeaf(page, owner != NULL);
+        if (leaf == NULL) {
+            if (owner != NULL) {
+                return false;
+            }
+            /*nothing recorded in this whole leaf, skip to the next one*/
+            page |= PAGE_MAP_FANOUT - 1;
+            continue;
+        }
+        __atomic_store_n(&leaf->entries[pageMapIndex(page, 2)], owner, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+/* Forgets the pages lying completely inside [start, end) */
+void pageMapClear(const void* start, const void* end)
+{
+    unsigned long page_mask = (1UL << PAGE_MAP_PAGE_SHIFT) - 1;
+    unsigned long first = ((unsigned long)start + page_mask) & ~page_mask;
+    unsigned long last = (unsigned long)end & ~page_mask;
+    if (first < last) {
+        pageMapSet((void*)first, (void*)last, NULL);
+    }
+}
+
+/*------------------system calls--------------*/
+
+/* Every program break move and every mapping of the allocator goes through these,
+ * so they can be traced and counted */
+
+struct SyscallCounters {
+    size_t sbrk_calls;
+    size_t sbrk_bytes_grown;
+    size_t sbrk_bytes_shrunk;
+    size_t mmap_calls;
+    size_t mmap_bytes;
+    size_t munmap_calls;
+    size_t munmap_bytes;
+    size_t madvise_calls;
+    long last_minor_faults; /*at the previous _malloc_stats call*/
+    long last_major_faults;
+};
+
+SyscallCounters syscall_counters = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+/* Records the pages a heap grew by for owner */
+bool ownHeapGrowth(void* old_break, intptr_t increment, void* owner)
+{
+    /*the page the old break is in was recorded with the heap below it, unless the
+     *heap starts there, and may belong to a small object span by now*/
+    unsigned long page_mask = (1UL << PAGE_MAP_PAGE_SHIFT) - 1;
+    char* first_new = (char*)old_break;
+    if (pageMapGet(old_break) != NULL) {
+        first_new = (char*)(((unsigned long)old_break + page_mask) & ~page_mask);
+    }
+    return pageMapSet(first_new, (char*)old_break + increment, owner);
+}
+
+void* heapSbrk(intptr_t increment, void* owner)
+{
+    void* old_break = sbrk(increment);
+    PROBE2(sbrk, increment, old_break);
+    syscall_counters.sbrk_calls += 1;
+    if (old_break == (void*)(-1)) {
+        return old_break;
+    }
+
+    if (increment >= 0) {
+        syscall_counters.sbrk_bytes_grown += increment;
+        if (!ownHeapGrowth(old_break, increment, owner)) {
+            /*memory that sfree would not recognize is of no use*/
+            sbrk(-increment);
+            syscall_counters.sbrk_calls += 1;
+            syscall_counters.sbrk_bytes_shrunk += increment;
+            return (void*)(-1);
+        }
+    } else {
+        syscall_counters.sbrk_bytes_shrunk += -increment;
+        /*a page shared with the new break stays recorded*/
+        pageMapClear((char*)old_break + increment, old_break);
+    }
+    return old_break;
+}
+
+void* heapMmap(size_t size)
+{
+    void* region = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    PROBE2(mmap, region, size);
+    syscall_counters.mmap_calls += 1;
+    if (region != (void*)(-1)) {
+        syscall_counters.mmap_bytes += size;
+    }
+    return region;
+}
+
+int heapMunmap(void* addr, size_t size)
+{
+    int res = munmap(addr, size);
+    PROBE2(munmap, addr, size);
+    syscall_counters.munmap_calls += 1;
+    if (res != -1) {
+        syscall_counters.munmap_bytes += size;
+        /*munmap takes the partial last page too*/
+        unsigned long page_mask = (1UL << PAGE_MAP_PAGE_SHIFT) - 1;
+        pageMapClear(addr, (void*)(((unsigned long)addr + size + page_mask) & ~page_mask));
+    }
+    return res;
+}
+
+int heapMadvise(void* addr, size_t size, int advice)
+{
+    int res = madvise(addr, size, advice);
+    PROBE2(madvise, addr, size);
+    syscall_counters.madvise_calls += 1;
+    return res;
+}
+
+/*------------------heap growth--------------*/
+
+/* Moves the end of the engine's heap like sbrk, returns the old end or (void*)(-1) */
+template <class Config>
+void* Engine<Config>::growHeap(intptr_t increment)
+{
+    if (source == PROGRAM_BREAK) {
+        return heapSbrk(increment, this);
+    }
+
+    if (increment > arena_end - arena_break || increment < arena_start - arena_break) {
+        return (void*)(-1);
+    }
+
+    char* old_break = arena_break;
+    if (increment >= 0) {
+        if (!ownHeapGrowth(old_break, increment, this)) {
+            return (void*)(-1);
+        }
+    } else {
+        /*a page shared with the new break stays recorded and backed*/
+        unsigned long page_mask = (1UL << PAGE_MAP_PAGE_SHIFT) - 1;
+        unsigned long first = ((unsigned long)old_break + increment + page_mask) & ~page_mask;
+        pageMapClear(old_break + increment, old_break);
+        if (first < (unsigned long)old_break) {
+            heapMadvise((void*)first, (unsigned long)old_break - first, MADV_DONTNEED);
+        }
+    }
+    arena_break += increment;
+    return old_break;
+}
+
+template <class Config>
+char* Engine<Config>::heapEnd()
+{
+    return source == PROGRAM_BREAK ? (char*)sbrk(0) : arena_break;
+}
+
+/* A MAPPED_ARENA engine grows inside one MAP_NORESERVE reservation. Like the page
+ * map nodes it stays out of the syscall counters, only the pages handed to the
+ * heap are of interest */
+template <class Config>
+int Engine<Config>::reserveArena()
+{
+    char* start = (char*)mmap(NULL, MAPPED_ARENA_RESERVE, PROT_READ|PROT_WRITE,
+                              MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if ((void*)start == (void*)(-1)) {
+        return -1;
+    }
+
+    arena_start = start;
+    arena_break = start;
+    arena_end = start + MAPPED_ARENA_RESERVE;
+    return 1;
+}
 
-int alignInitialProgBreak() {
-    unsigned long init_sbrk_ptr = (unsigned long)sbrk(0);
-    size_t aligned_size = (init_sbrk_ptr%8 == 0 ? 0 : (8-init_sbrk_ptr%8) );
+template <class Config>
+int Engine<Config>::alignHeapEnd() {
+    unsigned long init_sbrk_ptr = (unsigned long)heapEnd();
+    size_t aligned_size = Config::alignSize(init_sbrk_ptr) - init_sbrk_ptr;
 
-    void* sbrk_ptr = sbrk(aligned_size);
+    void* sbrk_ptr = growHeap(aligned_size);
     if (sbrk_ptr == (void*)(-1)) {
         return -1;
     }
@@ -58,6 +658,310 @@ int alignInitialProgBreak() {
     return 1;
 }
 
+/*------------------latency histograms--------------*/
+
+/* Optional instrumentation (build with -DMALLOC_LATENCY_HIST): every public entry
+ * point times itself and records the cycle count in a log-linear histogram per
+ * operation and per path taken. Without the flag the macros compile to nothing. */
+
+typedef enum { LATENCY_SMALLOC, LATENCY_SCALLOC, LATENCY_SFREE, LATENCY_SREALLOC, LATENCY_SMEMALIGN, LATENCY_OPS } latency_op;
+
+typedef enum {
+    LATENCY_PATH_OTHER, /*failed or trivial calls*/
+    LATENCY_PATH_BIN_HIT, /*free block reused as is*/
+    LATENCY_PATH_SPLIT, /*free block reused and split*/
+    LATENCY_PATH_WILDERNESS, /*free wilderness block enlarged*/
+    LATENCY_PATH_SBRK, /*new block at the program break*/
+    LATENCY_PATH_MMAP,
+    LATENCY_PATH_IN_PLACE, /*srealloc grew or kept the block where it is*/
+    LATENCY_PATH_FREE, /*block freed and coalesced*/
+    LATENCY_PATH_MUNMAP,
+    LATENCY_PATHS
+} latency_path;
+
+#ifdef MALLOC_LATENCY_HIST
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define readCycles() (__rdtsc())
+#else
+#include <time.h>
+static inline unsigned long long readCycles()
+{
+    /*no cycle counter, nanoseconds are the next best thing*/
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+#endif
+
+/* 8 linear sub buckets per power of two, so every bucket is at most 12.5% wide */
+#define LATENCY_SUB_BITS (3)
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+struct LatencyHistograms {
+    unsigned long counts[LATENCY_OPS][LATENCY_PATHS][LATENCY_BUCKETS];
+    unsigned long long max[LATENCY_OPS][LATENCY_PATHS];
+    int depth; /*only the outermost public call is timed*/
+    latency_path path; /*the first path set inside a call wins*/
+};
+
+LatencyHistograms latency_hist;
+
+int latencyBucket(unsigned long long cycles)
+{
+    if (cycles < LATENCY_SUB_BUCKETS) {
+        return (int)cycles;
+    }
+
+    int exponent = 63 - __builtin_clzll(cycles);
+    int sub = (int)(cycles >> (exponent - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+    return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+unsigned long long latencyBucketUpperBound(int bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return (unsigned long long)bucket;
+    }
+
+    int exponent = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+    unsigned long long sub = (unsigned long long)(bucket % LATENCY_SUB_BUCKETS);
+    unsigned long long width = 1ULL << (exponent - LATENCY_SUB_BITS);
+    return ((LATENCY_SUB_BUCKETS + sub) << (exponent - LATENCY_SUB_BITS)) + width - 1;
+}
+
+class LatencyScope {
+public:
+    explicit LatencyScope(latency_op op) : op(op), start(0) {
+        if (latency_hist.depth++ == 0) {
+            latency_hist.path = LATENCY_PATH_OTHER;
+            start = readCycles();
+        }
+    }
+
+    ~LatencyScope() {
+        if (--latency_hist.depth != 0) {
+            return;
+        }
+
+        unsigned long long cycles = readCycles() - start;
+        latency_hist.counts[op][latency_hist.path][latencyBucket(cycles)] += 1;
+        if (cycles > latency_hist.max[op][latency_hist.path]) {
+            latency_hist.max[op][latency_hist.path] = cycles;
+        }
+    }
+
+private:
+    latency_op op;
+    unsigned long long start;
+};
+
+#define LATENCY_SCOPE(op) LatencyScope latency_scope(op)
+#define LATENCY_PATH(p)                                  \
+    do {                                                 \
+        if (latency_hist.path == LATENCY_PATH_OTHER) {   \
+            latency_hist.path = (p);                     \
+        }                                                \
+    } while (0)
+
+#else
+
+#define LATENCY_SCOPE(op) do {} while (0)
+#define LATENCY_PATH(p) do {} while (0)
+
+#endif /* MALLOC_LATENCY_HIST */
+
+/*------------------heap profiler--------------*/
+
+/* Sampling heap profiler. Once started, about one allocation per sample period
+ * bytes records its stack: the gaps between samples are drawn from an exponential
+ * distribution, so every allocated byte has the same chance to be picked and
+ * pprof can scale the samples back up. Sampled blocks carry is_sampled in their
+ * header, so sfree only searches the sample table for them.
+ * While the profiler is off the countdown is parked at SIZE_MAX, which keeps the
+ * cost per allocation at one compare. */
+
+#define HEAP_PROFILE_DEFAULT_PERIOD (0x80000)
+#define HEAP_PROFILE_MAX_DEPTH (32)
+#define HEAP_PROFILE_SKIP_FRAMES (2) /*recordSample and heapProfileSlowPath*/
+#define HEAP_PROFILE_BUCKETS (0x1000) /*distinct stacks*/
+#define HEAP_PROFILE_SLOTS (0x10000) /*live samples, a power of two*/
+#define HEAP_PROFILE_PATH_MAX (256)
+
+struct StackBucket {
+    unsigned long hash; /*0 for an unused bucket*/
+    int depth;
+    void* frames[HEAP_PROFILE_MAX_DEPTH];
+    size_t in_use_objects;
+    size_t in_use_bytes;
+    size_t alloc_objects;
+    size_t alloc_bytes;
+};
+
+struct SampleSlot {
+    void* ptr; /*NULL for an empty slot*/
+    size_t size;
+    StackBucket* bucket;
+};
+
+struct HeapProfile {
+    size_t bytes_until_sample;
+    size_t period;
+    bool enabled;
+    unsigned long rng;
+    StackBucket* buckets; /*both tables are mmapped on the first start*/
+    SampleSlot* slots;
+    size_t live_samples;
+    size_t dropped_samples;
+    volatile sig_atomic_t dump_pending;
+    int dump_count;
+    char dump_path[HEAP_PROFILE_PATH_MAX];
+};
+
+HeapProfile heap_profile = { SIZE_MAX, 0, false, 0x9e3779b97f4a7c15UL, NULL, NULL, 0, 0, 0, 0, "" };
+
+size_t nextSampleGap()
+{
+    /*xorshift64, then inverse transform of a uniform (0, 1] sample*/
+    heap_profile.rng ^= heap_profile.rng << 13;
+    heap_profile.rng ^= heap_profile.rng >> 7;
+    heap_profile.rng ^= heap_profile.rng << 17;
+    double uniform = (double)((heap_profile.rng >> 11) + 1) / 9007199254740992.0;
+    return (size_t)(-std::log(uniform) * (double)heap_profile.period) + 1;
+}
+
+unsigned long hashPointer(void* ptr)
+{
+    unsigned long hash = (unsigned long)ptr * 0x9e3779b97f4a7c15UL;
+    return hash ^ (hash >> 29);
+}
+
+StackBucket* findStackBucket(void** frames, int depth)
+{
+    unsigned long hash = 0xcbf29ce484222325UL;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (unsigned long)frames[i]) * 0x100000001b3UL;
+    }
+    hash |= 1;
+
+    for (size_t probe = 0; probe < HEAP_PROFILE_BUCKETS; probe++) {
+        StackBucket* bucket = &heap_profile.buckets[(hash + probe) % HEAP_PROFILE_BUCKETS];
+        if (bucket->hash == 0) {
+            bucket->hash = hash;
+            bucket->depth = depth;
+            memcpy(bucket->frames, frames, depth * sizeof(void*));
+            return bucket;
+        }
+
+        if (bucket->hash == hash && bucket->depth == depth && memcmp(bucket->frames, frames, depth * sizeof(void*)) == 0) {
+            return bucket;
+        }
+    }
+
+    return NULL;
+}
+
+__attribute__((noinline)) void recordSample(void* ptr, size_t size)
+{
+    void* frames[HEAP_PROFILE_MAX_DEPTH + HEAP_PROFILE_SKIP_FRAMES];
+    int depth = backtrace(frames, HEAP_PROFILE_MAX_DEPTH + HEAP_PROFILE_SKIP_FRAMES) - HEAP_PROFILE_SKIP_FRAMES;
+    StackBucket* bucket = findStackBucket(frames + HEAP_PROFILE_SKIP_FRAMES, depth < 0 ? 0 : depth);
+
+    /*keep the table at most 3/4 full so probes stay short*/
+    if (bucket == NULL || heap_profile.live_samples >= HEAP_PROFILE_SLOTS / 4 * 3) {
+        heap_profile.dropped_samples += 1;
+        return;
+    }
+
+    size_t index = hashPointer(ptr) & (HEAP_PROFILE_SLOTS - 1);
+    while (heap_profile.slots[index].ptr != NULL) {
+        index = (index + 1) & (HEAP_PROFILE_SLOTS - 1);
+    }
+    heap_profile.slots[index].ptr = ptr;
+    heap_profile.slots[index].size = size;
+    heap_profile.slots[index].bucket = bucket;
+    heap_profile.live_samples += 1;
+
+    bucket->in_use_objects += 1;
+    bucket->in_use_bytes += size;
+    bucket->alloc_objects += 1;
+    bucket->alloc_bytes += size;
+    DATA_TO_META_PTR(ptr)->is_sampled = true;
+}
+
+void forgetSample(void* ptr)
+{
+    size_t mask = HEAP_PROFILE_SLOTS - 1;
+    size_t index = hashPointer(ptr) & mask;
+    while (heap_profile.slots[index].ptr != ptr) {
+        if (heap_profile.slots[index].ptr == NULL) {
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+
+    StackBucket* bucket = heap_profile.slots[index].bucket;
+    bucket->in_use_objects -= 1;
+    bucket->in_use_bytes -= heap_profile.slots[index].size;
+    heap_profile.live_samples -= 1;
+
+    /*backward shift deletion: pull later entries into the hole unless that would
+     *move them in front of their home slot, so no probe sequence gets cut*/
+    size_t hole = index;
+    for (size_t next = (hole + 1) & mask; heap_profile.slots[next].ptr != NULL; next = (next + 1) & mask) {
+        size_t home = hashPointer(heap_profile.slots[next].ptr) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            heap_profile.slots[hole] = heap_profile.slots[next];
+            hole = next;
+        }
+    }
+    heap_profile.slots[hole].ptr = NULL;
+}
+
+int _heap_profile_dump(int fd);
+
+void dumpRequestedProfile()
+{
+    char path[HEAP_PROFILE_PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s.%04d.heap", heap_profile.dump_path, heap_profile.dump_count++);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd != -1) {
+        _heap_profile_dump(fd);
+        close(fd);
+    }
+}
+
+__attribute__((noinline)) void heapProfileSlowPath(void* ptr, size_t size)
+{
+    /*parking the countdown first also stops backtrace from recursing into here
+     *if it allocates through us*/
+    heap_profile.bytes_until_sample = SIZE_MAX;
+    if (heap_profile.dump_pending) {
+        heap_profile.dump_pending = 0;
+        dumpRequestedProfile();
+    }
+
+    if (heap_profile.enabled) {
+        if (ptr != NULL) {
+            recordSample(ptr, size);
+        }
+        heap_profile.bytes_until_sample = nextSampleGap();
+    }
+}
+
+inline void* profileAllocation(void* ptr, size_t size)
+{
+    if (size >= heap_profile.bytes_until_sample) {
+        heapProfileSlowPath(ptr, size);
+    } else {
+        heap_profile.bytes_until_sample -= size;
+    }
+
+    return ptr;
+}
+
 /*------------------helper functions--------------*/
 
 void updateMetaData(MallocMetadata* meta, block_status stat, size_t new_size, bool is_mmap=false)
@@ -65,40 +969,85 @@ void updateMetaData(MallocMetadata* meta, block_status stat, size_t new_size, bo
     meta->status = stat;
     meta->block_size = new_size;
     meta->is_mmapped = is_mmap;
+    meta->is_sampled = false;
+    meta->dirty_slot = 0;
+}
+
+template <class Config>
+void Engine<Config>::updateStats(long free_blocks, long free_bytes, long allocated_blocks, long allocated_bytes) {
+    heap.free_blocks += free_blocks;
+    heap.free_bytes += free_bytes;
+    heap.allocated_blocks += allocated_blocks;
+    heap.allocated_bytes += allocated_bytes;
 }
 
-void updateStats(long free_blocks, long free_bytes, long allocated_blocks, long allocated_bytes) {
-    global_ptr.free_blocks += free_blocks;
-    global_ptr.free_bytes += free_bytes;
-    global_ptr.allocated_blocks += allocated_blocks;
-    global_ptr.allocated_bytes += allocated_bytes;
+template <class Config>
+void Engine<Config>::forgetDirty(MallocMetadata* block)
+{
+    if (block->dirty_slot == 0) {
+        return;
+    }
+
+    /*move the last member into the hole*/
+    size_t slot = block->dirty_slot - 1;
+    MallocMetadata* last = dirty_set.blocks[--dirty_set.count];
+    dirty_set.blocks[slot] = last;
+    last->dirty_slot = (unsigned char)(slot + 1);
+    block->dirty_slot = 0;
 }
 
-void removeFromSizeFreeList(MallocMetadata* meta)
+/*------------------free indexes--------------*/
+
+/* An engine finds free blocks through its Config's free index: insert and remove
+ * a FREE block, largest for the size of the biggest one, and the search of the
+ * fit policy. The size ordered indexes have findBest for the smallest block of
+ * at least size (lowest address first among equal sizes), the address ordered
+ * one findFirst and findNext. setup runs with the engine's. Blocks are given by
+ * their header, the index does no stats */
+
+/* The default index, the free blocks in a list sorted by (size, address) */
+class SizeOrderedList {
+public:
+    static constexpr bool address_ordered = false;
+
+    constexpr SizeOrderedList() : head(NULL), tail(NULL) {}
+
+    int setup() { return 1; }
+    void insert(MallocMetadata* meta);
+    void remove(MallocMetadata* meta);
+    MallocMetadata* findBest(size_t size);
+    size_t largest();
+
+private:
+    MallocMetadata* head; /*head of the size sorted list*/
+    MallocMetadata* tail; /*the last node of size sorted list*/
+};
+
+void SizeOrderedList::remove(MallocMetadata* meta)
 {
     /*just take out, no stats needed */
     MallocMetadata* prev = meta->free_by_size_prev, *next = meta->free_by_size_next;
     if (prev != NULL) {
         prev->free_by_size_next = next;
     } else {
-        global_ptr.free_by_size_head = next;
+        head = next;
     }
 
     if (next != NULL) {
         next->free_by_size_prev = prev;
     } else {
-        global_ptr.free_by_size_tail = prev;
+        tail = prev;
     }
 }
 
-MallocMetadata* findBestFit(size_t size)
+MallocMetadata* SizeOrderedList::findBest(size_t size)
 {
     /*finds smallest large enough block*/
-    if (global_ptr.free_by_size_tail == NULL || global_ptr.free_by_size_tail->block_size < size) {
+    if (tail == NULL || tail->block_size < size) {
         return NULL;
     }
 
-    MallocMetadata* curr = global_ptr.free_by_size_head;
+    MallocMetadata* curr = head;
     while (curr != NULL && size > curr->block_size) {
         curr = curr->free_by_size_next;
     }
@@ -106,50 +1055,35 @@ MallocMetadata* findBestFit(size_t size)
     return curr;
 }
 
-void appendToMemoryList(MallocMetadata* meta)
-{
-    /*just insert, no stats needed */
-    MallocMetadata* curr_tail = global_ptr.tail;
-    if (curr_tail != NULL) {
-        curr_tail->next = meta;
-        meta->prev = curr_tail;
-    } else {
-        meta->prev = NULL;
-        global_ptr.head = meta;
-    }
-
-    meta->next = NULL;
-    global_ptr.tail = meta;
-}
 /* Return true if a < b
  * Both assumed to be not NULL */
 bool isLowerInFreeList(MallocMetadata* a, MallocMetadata* b) {
     return ((a->block_size < b->block_size) || ((a->block_size == b->block_size) && (a < b)));
 }
 
-void insertToSizeFreeList(MallocMetadata* meta)
+void SizeOrderedList::insert(MallocMetadata* meta)
 {
     /*just insert, no stats needed */
-    if (global_ptr.free_by_size_tail == NULL) {
-        global_ptr.free_by_size_head = meta;
-        global_ptr.free_by_size_tail = meta;
+    if (tail == NULL) {
+        head = meta;
+        tail = meta;
         meta->free_by_size_prev = NULL;
         meta->free_by_size_next = NULL;
         return;
-    } else if (isLowerInFreeList(global_ptr.free_by_size_tail, meta)) {
-        global_ptr.free_by_size_tail->free_by_size_next = meta;
-        meta->free_by_size_prev = global_ptr.free_by_size_tail;
+    } else if (isLowerInFreeList(tail, meta)) {
+        tail->free_by_size_next = meta;
+        meta->free_by_size_prev = tail;
         meta->free_by_size_next = NULL;
-        global_ptr.free_by_size_tail = meta;
+        tail = meta;
         return;
     }
 
     /* If we got here the list should be non-empty
      * And meta will never be inserted at the tail */
-    assert(global_ptr.free_by_size_head != NULL);
+    assert(head != NULL);
 
     /* After break meta should be inserted BEFORE curr */
-    MallocMetadata* curr = global_ptr.free_by_size_head;
+    MallocMetadata* curr = head;
     while (curr->free_by_size_next != NULL) {
         if (isLowerInFreeList(meta, curr)) {
             break;
@@ -163,7 +1097,7 @@ void insertToSizeFreeList(MallocMetadata* meta)
     meta->free_by_size_next = curr;
 
     if (curr->free_by_size_prev == NULL) {
-        global_ptr.free_by_size_head = meta;
+        head = meta;
     } else {
         curr->free_by_size_prev->free_by_size_next = meta;
     }
@@ -171,44 +1105,575 @@ void insertToSizeFreeList(MallocMetadata* meta)
     curr->free_by_size_prev = meta;
 }
 
-void mergeWithUpper(MallocMetadata* block, block_status status) {
-    MallocMetadata* upper = block->next;
-    if (upper->status == FREE) {
-        removeFromSizeFreeList(upper);
-    }
+size_t SizeOrderedList::largest()
+{
+    /*the size sorted free list keeps the largest block at its tail*/
+    return tail != NULL ? tail->block_size : 0;
+}
 
-    block->next = upper->next;
-    if (upper->next != NULL) {
-        upper->next->prev = block;
-    } else {
-        global_ptr.tail = block;
-    }
+/* The index of first and next fit, the free blocks in a list sorted by address
+ * through the same links. findFirst takes the lowest block that fits, findNext
+ * the first one that fits from where its last search stopped, wrapping around.
+ * The largest size is kept with the number of blocks of that size, the list is
+ * only scanned again when the last of them leaves */
+class AddressOrderedList {
+public:
+    static constexpr bool address_ordered = true;
+
+    constexpr AddressOrderedList()
+        : head(NULL), tail(NULL), rover(NULL), rover_mark(NULL), largest_size(0), largest_count(0) {}
+
+    int setup() { return 1; }
+    void insert(MallocMetadata* meta);
+    void remove(MallocMetadata* meta);
+    MallocMetadata* findFirst(size_t size);
+    MallocMetadata* findNext(size_t size);
+    size_t largest();
+
+private:
+    void link(MallocMetadata* meta, MallocMetadata* prev, MallocMetadata* next);
+    void findLargest();
+
+    MallocMetadata* head; /*lowest free block*/
+    MallocMetadata* tail; /*highest free block*/
+    MallocMetadata* rover; /*where findNext starts, NULL for the head*/
+    char* rover_mark; /*the block findNext returned last, the rover is the first free block ending above it*/
+    size_t largest_size;
+    size_t largest_count; /*free blocks of largest_size*/
+};
 
-    updateMetaData(block, status, block->block_size + sizeof(MallocMetadata) + upper->block_size);
-}
+void AddressOrderedList::link(MallocMetadata* meta, MallocMetadata* prev, MallocMetadata* next)
+{
+    meta->free_by_size_prev = prev;
+    meta->free_by_size_next = next;
 
-void mergeWithLower(MallocMetadata* block, block_status status) {
-    MallocMetadata* lower = block->prev;
-    if (lower->status == FREE) {
-        removeFromSizeFreeList(lower);
+    if (prev != NULL) {
+        prev->free_by_size_next = meta;
+    } else {
+        head = meta;
     }
 
-    lower->next = block->next;
-    if (block->next != NULL) {
-        block->next->prev = lower;
+    if (next != NULL) {
+        next->free_by_size_prev = meta;
     } else {
-        global_ptr.tail = lower;
+        tail = meta;
     }
-
-    updateMetaData(lower, status, block->block_size + sizeof(MallocMetadata) + lower->block_size);
 }
 
-void splitBlock(MallocMetadata* block_to_split, size_t new_size)
+void AddressOrderedList::insert(MallocMetadata* meta)
 {
-    /*remember to update all metadata and stats*/
-    MallocMetadata* other_part = (MallocMetadata*)((char*)(block_to_split) + sizeof(MallocMetadata) + new_size);
+    if (tail == NULL || tail < meta) {
+        /*blocks freed in allocation order land at the end, check there first*/
+        link(meta, tail, NULL);
+    } else {
+        /*a block is most likely freed or split near where the rover stopped, start there*/
+        MallocMetadata* next = rover != NULL ? rover : head;
+        while (next->free_by_size_prev != NULL && next->free_by_size_prev > meta) {
+            next = next->free_by_size_prev;
+        }
+        while (next < meta) {
+            next = next->free_by_size_next;
+        }
+        link(meta, next->free_by_size_prev, next);
+    }
+
+    /*a split remainder or a block merged over the mark comes before the rover*/
+    if ((char*)META_TO_DATA_PTR(meta) + meta->block_size > rover_mark && (rover == NULL || meta < rover)) {
+        rover = meta;
+    }
+
+    if (meta->block_size > largest_size) {
+        largest_size = meta->block_size;
+        largest_count = 1;
+    } else if (meta->block_size == largest_size) {
+        largest_count += 1;
+    }
+}
+
+void AddressOrderedList::remove(MallocMetadata* meta)
+{
+    MallocMetadata* prev = meta->free_by_size_prev, *next = meta->free_by_size_next;
+    if (prev != NULL) {
+        prev->free_by_size_next = next;
+    } else {
+        head = next;
+    }
+
+    if (next != NULL) {
+        next->free_by_size_prev = prev;
+    } else {
+        tail = prev;
+    }
+
+    if (rover == meta) {
+        rover = next;
+    }
+
+    if (meta->block_size == largest_size && --largest_count == 0) {
+        findLargest();
+    }
+}
+
+MallocMetadata* AddressOrderedList::findFirst(size_t size)
+{
+    if (largest_size < size) {
+        return NULL;
+    }
+
+    for (MallocMetadata* curr = head; curr != NULL; curr = curr->free_by_size_next) {
+        if (curr->block_size >= size) {
+            return curr;
+        }
+    }
+
+    return NULL;
+}
+
+MallocMetadata* AddressOrderedList::findNext(size_t size)
+{
+    MallocMetadata* start = rover != NULL ? rover : head;
+    if (start == NULL || largest_size < size) {
+        return NULL;
+    }
+
+    MallocMetadata* curr = start;
+    do {
+        if (curr->block_size >= size) {
+            rover = curr;
+            rover_mark = (char*)curr;
+            return curr;
+        }
+        curr = curr->free_by_size_next != NULL ? curr->free_by_size_next : head;
+    } while (curr != start);
+
+    return NULL;
+}
+
+void AddressOrderedList::findLargest()
+{
+    largest_size = 0;
+    largest_count = 0;
+    for (MallocMetadata* curr = head; curr != NULL; curr = curr->free_by_size_next) {
+        if (curr->block_size > largest_size) {
+            largest_size = curr->block_size;
+            largest_count = 1;
+        } else if (curr->block_size == largest_size) {
+            largest_count += 1;
+        }
+    }
+}
+
+size_t AddressOrderedList::largest()
+{
+    return largest_size;
+}
+
+
+/*------------------packed free index--------------*/
+
+/* PackedSizeIndex, the alternative to the size sorted free list (smalloc's with
+ * -DMALLOC_PACKED_FREE_INDEX). Free blocks are kept ordered by (size, address)
+ * in fixed size segments holding a packed array of sizes next to the block
+ * pointers. A directory of the last key of every segment is binary searched
+ * for the segment, inside it the sizes are scanned with AVX-512/AVX2 compares
+ * (scalar elsewhere), so no block header is read while searching. Insert and
+ * remove move at most one segment's entries; a full segment is split in two
+ * and an empty one is dropped from the directory.
+ * Everything is one MAP_NORESERVE reservation made at setup. */
+
+#define FREE_INDEX_SEGMENT (64) /*entries per segment, a multiple of 8 for the vector scans*/
+#define FREE_INDEX_MAX_SEGMENTS (1 << 20)
+
+struct FreeIndexSegment {
+    uint64_t sizes[FREE_INDEX_SEGMENT];
+    MallocMetadata* blocks[FREE_INDEX_SEGMENT];
+    size_t count;
+    FreeIndexSegment* next_unused;
+};
+
+class PackedSizeIndex {
+public:
+    static constexpr bool address_ordered = false;
+
+    constexpr PackedSizeIndex()
+        : segments(NULL), last_sizes(NULL), last_blocks(NULL), segment_count(0), pool(NULL), pool_used(0),
+          unused(NULL), first_at_least(NULL) {}
+
+    int setup();
+    void insert(MallocMetadata* meta);
+    void remove(MallocMetadata* meta);
+    MallocMetadata* findBest(size_t size);
+    size_t largest();
+
+private:
+    size_t findSegment(uint64_t size, MallocMetadata* block);
+    size_t findInSegment(FreeIndexSegment* segment, uint64_t size, MallocMetadata* block);
+    void updateLastKey(size_t index);
+    FreeIndexSegment* newSegment(size_t index);
+    void dropSegment(size_t index);
+
+    FreeIndexSegment** segments; /*in key order*/
+    uint64_t* last_sizes; /*the key of the last entry of every segment*/
+    MallocMetadata** last_blocks;
+    size_t segment_count;
+    FreeIndexSegment* pool; /*segments past pool_used were never touched*/
+    size_t pool_used;
+    FreeIndexSegment* unused; /*segments given back by empty ones*/
+    size_t (*first_at_least)(const uint64_t* sizes, size_t count, uint64_t size);
+};
+
+size_t firstAtLeastScalar(const uint64_t* sizes, size_t count, uint64_t size)
+{
+    size_t i = 0;
+    while (i < count && sizes[i] < size) {
+        i++;
+    }
+
+    return i;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+/* Both scan whole vectors; entries past count may be stale, so a hit there means none */
+__attribute__((target("avx2")))
+size_t firstAtLeastAvx2(const uint64_t* sizes, size_t count, uint64_t size)
+{
+    /*sizes stay far below 2^63, so the signed compare is fine*/
+    __m256i limit = _mm256_set1_epi64x((long long)size - 1);
+    for (size_t i = 0; i < count; i += 4) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(sizes + i));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(chunk, limit)));
+        if (mask != 0) {
+            size_t found = i + __builtin_ctz(mask);
+            return found < count ? found : count;
+        }
+    }
+
+    return count;
+}
+
+__attribute__((target("avx512f")))
+size_t firstAtLeastAvx512(const uint64_t* sizes, size_t count, uint64_t size)
+{
+    __m512i limit = _mm512_set1_epi64((long long)size);
+    for (size_t i = 0; i < count; i += 8) {
+        __mmask8 mask = _mm512_cmpge_epu64_mask(_mm512_loadu_si512((const void*)(sizes + i)), limit);
+        if (mask != 0) {
+            size_t found = i + __builtin_ctz(mask);
+            return found < count ? found : count;
+        }
+    }
+
+    return count;
+}
+#endif
+
+int PackedSizeIndex::setup()
+{
+    size_t directory_size = FREE_INDEX_MAX_SEGMENTS * (sizeof(FreeIndexSegment*) + sizeof(uint64_t) + sizeof(MallocMetadata*));
+    size_t pool_size = FREE_INDEX_MAX_SEGMENTS * sizeof(FreeIndexSegment);
+    char* tables = (char*)mmap(NULL, directory_size + pool_size, PROT_READ|PROT_WRITE,
+                               MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if ((void*)tables == (void*)(-1)) {
+        return -1;
+    }
+
+    segments = (FreeIndexSegment**)tables;
+    last_sizes = (uint64_t*)(segments + FREE_INDEX_MAX_SEGMENTS);
+    last_blocks = (MallocMetadata**)(last_sizes + FREE_INDEX_MAX_SEGMENTS);
+    pool = (FreeIndexSegment*)(tables + directory_size);
+
+    first_at_least = firstAtLeastScalar;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx512f")) {
+        first_at_least = firstAtLeastAvx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        first_at_least = firstAtLeastAvx2;
+    }
+#endif
+    return 1;
+}
+
+/* Return true if the key (a_size, a) < (b_size, b) */
+inline bool isLowerKey(uint64_t a_size, MallocMetadata* a, uint64_t b_size, MallocMetadata* b)
+{
+    return a_size < b_size || (a_size == b_size && a < b);
+}
+
+/* Index of the first segment whose last key is not lower than (size, block),
+ * segment_count if there is none. A NULL block only compares the size */
+size_t PackedSizeIndex::findSegment(uint64_t size, MallocMetadata* block)
+{
+    size_t low = 0, high = segment_count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (isLowerKey(last_sizes[mid], last_blocks[mid], size, block)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/* Position of the first entry of segment that is not lower than (size, block) */
+size_t PackedSizeIndex::findInSegment(FreeIndexSegment* segment, uint64_t size, MallocMetadata* block)
+{
+    size_t i = first_at_least(segment->sizes, segment->count, size);
+    while (i < segment->count && segment->sizes[i] == size && segment->blocks[i] < block) {
+        i++;
+    }
+
+    return i;
+}
+
+void PackedSizeIndex::updateLastKey(size_t index)
+{
+    FreeIndexSegment* segment = segments[index];
+    last_sizes[index] = segment->sizes[segment->count - 1];
+    last_blocks[index] = segment->blocks[segment->count - 1];
+}
+
+FreeIndexSegment* PackedSizeIndex::newSegment(size_t index)
+{
+    /*the new segment goes to the directory at index, its entries are up to the caller*/
+    FreeIndexSegment* segment = unused;
+    if (segment != NULL) {
+        unused = segment->next_unused;
+    } else if (pool_used < FREE_INDEX_MAX_SEGMENTS) {
+        segment = &pool[pool_used++];
+    } else {
+        return NULL;
+    }
+
+    size_t moved = segment_count - index;
+    memmove(&segments[index + 1], &segments[index], moved * sizeof(FreeIndexSegment*));
+    memmove(&last_sizes[index + 1], &last_sizes[index], moved * sizeof(uint64_t));
+    memmove(&last_blocks[index + 1], &last_blocks[index], moved * sizeof(MallocMetadata*));
+    segments[index] = segment;
+    segment_count += 1;
+    segment->count = 0;
+    return segment;
+}
+
+void PackedSizeIndex::dropSegment(size_t index)
+{
+    FreeIndexSegment* segment = segments[index];
+    size_t moved = segment_count - index - 1;
+    memmove(&segments[index], &segments[index + 1], moved * sizeof(FreeIndexSegment*));
+    memmove(&last_sizes[index], &last_sizes[index + 1], moved * sizeof(uint64_t));
+    memmove(&last_blocks[index], &last_blocks[index + 1], moved * sizeof(MallocMetadata*));
+    segment_count -= 1;
+    segment->next_unused = unused;
+    unused = segment;
+}
+
+void PackedSizeIndex::remove(MallocMetadata* meta)
+{
+    /*just take out, no stats needed */
+    size_t index = findSegment(meta->block_size, meta);
+    if (index == segment_count) {
+        return;
+    }
+
+    FreeIndexSegment* segment = segments[index];
+    size_t i = findInSegment(segment, meta->block_size, meta);
+    if (i == segment->count || segment->blocks[i] != meta) {
+        /*never made it into a full index*/
+        return;
+    }
+
+    segment->count -= 1;
+    memmove(&segment->sizes[i], &segment->sizes[i + 1], (segment->count - i) * sizeof(uint64_t));
+    memmove(&segment->blocks[i], &segment->blocks[i + 1], (segment->count - i) * sizeof(MallocMetadata*));
+    if (segment->count == 0) {
+        dropSegment(index);
+    } else if (i == segment->count) {
+        updateLastKey(index);
+    }
+}
+
+MallocMetadata* PackedSizeIndex::findBest(size_t size)
+{
+    /*finds smallest large enough block*/
+    size_t index = findSegment(size, NULL);
+    if (index == segment_count) {
+        return NULL;
+    }
+
+    FreeIndexSegment* segment = segments[index];
+    return segment->blocks[first_at_least(segment->sizes, segment->count, size)];
+}
+
+void PackedSizeIndex::insert(MallocMetadata* meta)
+{
+    /*just insert, no stats needed. If no segment can be had the block stays
+     *unindexed: still free and counted, but never reused until it merges*/
+    uint64_t size = meta->block_size;
+    size_t index = findSegment(size, meta);
+    if (index == segment_count) {
+        /*higher than everything, goes to the end of the last segment*/
+        if (index == 0) {
+            if (newSegment(0) == NULL) {
+                return;
+            }
+        } else {
+            index -= 1;
+        }
+    }
+
+    FreeIndexSegment* segment = segments[index];
+    if (segment->count == FREE_INDEX_SEGMENT) {
+        FreeIndexSegment* upper = newSegment(index + 1);
+        if (upper == NULL) {
+            return;
+        }
+
+        size_t half = FREE_INDEX_SEGMENT / 2;
+        memcpy(upper->sizes, &segment->sizes[half], half * sizeof(uint64_t));
+        memcpy(upper->blocks, &segment->blocks[half], half * sizeof(MallocMetadata*));
+        upper->count = half;
+        segment->count = half;
+        updateLastKey(index);
+        updateLastKey(index + 1);
+        if (isLowerKey(last_sizes[index], last_blocks[index], size, meta)) {
+            index += 1;
+            segment = upper;
+        }
+    }
+
+    size_t i = findInSegment(segment, size, meta);
+    memmove(&segment->sizes[i + 1], &segment->sizes[i], (segment->count - i) * sizeof(uint64_t));
+    memmove(&segment->blocks[i + 1], &segment->blocks[i], (segment->count - i) * sizeof(MallocMetadata*));
+    segment->sizes[i] = size;
+    segment->blocks[i] = meta;
+    segment->count += 1;
+    if (i == segment->count - 1) {
+        updateLastKey(index);
+    }
+}
+
+size_t PackedSizeIndex::largest()
+{
+    return segment_count != 0 ? last_sizes[segment_count - 1] : 0;
+}
+
+template <class Config>
+void Engine<Config>::insertToFreeIndex(MallocMetadata* meta)
+{
+    free_index.insert(meta);
+}
+
+template <class Config>
+void Engine<Config>::removeFromFreeIndex(MallocMetadata* meta)
+{
+    /*a block leaving the index leaves the dirty set too*/
+    forgetDirty(meta);
+    free_index.remove(meta);
+}
+
+template <class Config>
+void Engine<Config>::appendToMemoryList(MallocMetadata* meta)
+{
+    /*just insert, no stats needed */
+    MallocMetadata* curr_tail = heap.tail;
+    if (curr_tail != NULL) {
+        curr_tail->next = meta;
+        meta->prev = curr_tail;
+    } else {
+        meta->prev = NULL;
+        heap.head = meta;
+    }
+
+    meta->next = NULL;
+    heap.tail = meta;
+}
+/* The memory list is contiguous unless someone else moved the program break
+ * between two of our sbrk calls, so physical neighbours must be checked before merging */
+bool isAdjacent(MallocMetadata* lower, MallocMetadata* upper)
+{
+    return (char*)META_TO_DATA_PTR(lower) + lower->block_size == (char*)upper;
+}
+
+template <class Config>
+bool Engine<Config>::isWilderness(MallocMetadata* block)
+{
+    return block == heap.tail && (char*)META_TO_DATA_PTR(block) + block->block_size == heapEnd();
+}
+
+/* The free block Config::fit() picks for size bytes, NULL if there is none */
+template <class Config>
+MallocMetadata* Engine<Config>::findFit(size_t size)
+{
+    if constexpr (Config::fit() == FIT_BEST) {
+        return free_index.findBest(size);
+    } else if constexpr (Config::fit() == FIT_FIRST) {
+        return free_index.findFirst(size);
+    } else {
+        return free_index.findNext(size);
+    }
+}
+
+template <class Config>
+void Engine<Config>::mergeWithUpper(MallocMetadata* block, block_status status) {
+    MallocMetadata* upper = block->next;
+    PROBE3(merge, block, upper, block->block_size + sizeof(MallocMetadata) + upper->block_size);
+    if (upper->status == FREE) {
+        removeFromFreeIndex(upper);
+    }
+    if (heap_walk_cursor.next == upper) {
+        /*block is behind the cursor, it was visited already*/
+        heap_walk_cursor.next = upper->next;
+    }
+
+    block->next = upper->next;
+    if (upper->next != NULL) {
+        upper->next->prev = block;
+    } else {
+        heap.tail = block;
+    }
+
+    updateMetaData(block, status, block->block_size + sizeof(MallocMetadata) + upper->block_size);
+}
+
+template <class Config>
+void Engine<Config>::mergeWithLower(MallocMetadata* block, block_status status) {
+    MallocMetadata* lower = block->prev;
+    PROBE3(merge, lower, block, block->block_size + sizeof(MallocMetadata) + lower->block_size);
+    if (lower->status == FREE) {
+        removeFromFreeIndex(lower);
+    }
+    if (heap_walk_cursor.next == block) {
+        heap_walk_cursor.next = block->next;
+    }
+
+    lower->next = block->next;
+    if (block->next != NULL) {
+        block->next->prev = lower;
+    } else {
+        heap.tail = lower;
+    }
+
+    updateMetaData(lower, status, block->block_size + sizeof(MallocMetadata) + lower->block_size);
+}
+
+template <class Config>
+void Engine<Config>::splitBlock(MallocMetadata* block_to_split, size_t new_size)
+{
+    /*remember to update all metadata and stats*/
+    MallocMetadata* other_part = (MallocMetadata*)((char*)(block_to_split) + sizeof(MallocMetadata) + new_size);
     block_status orig_status = block_to_split->status;
     size_t orig_size = block_to_split->block_size;
+    PROBE3(split, block_to_split, orig_size, new_size);
+    /*the tail of a purged free block is still clean*/
+    bool tail_dirty = orig_status != FREE || block_to_split->dirty_slot != 0;
+
+    if (orig_status == FREE) {
+        /*the free index finds blocks by their size, so take it out before that changes*/
+        removeFromFreeIndex(block_to_split);
+    }
 
     updateMetaData(block_to_split, OCCUPIED, new_size);
     updateMetaData(other_part, FREE, (orig_size - new_size - sizeof(MallocMetadata)));
@@ -216,17 +1681,16 @@ void splitBlock(MallocMetadata* block_to_split, size_t new_size)
     other_part->next = block_to_split->next;
     other_part->prev = block_to_split;
     if (block_to_split->next == NULL) {
-        global_ptr.tail = other_part;
+        heap.tail = other_part;
     } else {
         block_to_split->next->prev = other_part;
     }
     block_to_split->next = other_part;
 
     if (orig_status == FREE) {
-        removeFromSizeFreeList(block_to_split);
         updateStats(0, -(long)(new_size + sizeof(MallocMetadata)), 1, -((long)sizeof(MallocMetadata)));
     } else {
-        if (other_part->next != NULL && other_part->next->status == FREE) {
+        if (other_part->next != NULL && other_part->next->status == FREE && isAdjacent(other_part, other_part->next)) {
             mergeWithUpper(other_part, FREE);
             updateStats(0, orig_size - new_size, 0, 0);
         } else {
@@ -234,366 +1698,1985 @@ void splitBlock(MallocMetadata* block_to_split, size_t new_size)
         }
     }
 
-    insertToSizeFreeList(other_part);
+    insertToFreeIndex(other_part);
+    if (tail_dirty) {
+        markDirty(other_part);
+    }
 }
 
-void freeAndMergeAdjacent(MallocMetadata* block)
+template <class Config>
+MallocMetadata* Engine<Config>::freeAndMergeAdjacent(MallocMetadata* block)
 {
-    /*mark as free, try to merge with neighbors and handle stats*/
+    /*mark as free, try to merge with neighbors and handle stats, returns the merged block*/
     updateMetaData(block, FREE, block->block_size);
     updateStats(1, block->block_size, 0, 0);
 
     MallocMetadata* prev = block->prev, *next = block->next;
-    if (next != NULL && next->status == FREE) {
+    if (next != NULL && next->status == FREE && isAdjacent(block, next)) {
         mergeWithUpper(block, FREE);
         updateStats(-1, sizeof(MallocMetadata), -1, sizeof(MallocMetadata));
     }
 
-    if (prev != NULL && prev->status == FREE) {
+    if (prev != NULL && prev->status == FREE && isAdjacent(prev, block)) {
         mergeWithLower(block, FREE);
         updateStats(-1, sizeof(MallocMetadata), -1, sizeof(MallocMetadata));
         block = prev;
     }
 
-    insertToSizeFreeList(block);
+    insertToFreeIndex(block);
+    return block;
 }
 
-MallocMetadata* tryToReuseOrMerge(MallocMetadata* block, size_t size)
-{/*will handle a-f and do split if necessary and handle stats if needed*/
-    size_t next_size = block->next != NULL ? block->next->block_size : 0;
-    size_t prev_size = block->prev != NULL ? block->prev->block_size : 0;
-    bool prev_free = (block->prev != NULL && block->prev->status == FREE);
-    bool next_free = (block->next != NULL && block->next->status == FREE);
+/* Gives the top of a free wilderness block back to the OS once it is larger than
+ * the trim threshold, keeping top_pad bytes for the next growth */
+template <class Config>
+void Engine<Config>::trimWilderness()
+{
+    MallocMetadata* top = heap.tail;
+    if (tunables.trim_threshold < 0 || top == NULL || top->status != FREE || !isWilderness(top) ||
+        top->block_size <= (size_t)tunables.trim_threshold || top->block_size <= tunables.top_pad) {
+        return;
+    }
 
-    /* a */
-    if (block->block_size >= size) {
-        return block;
+    size_t release = top->block_size - tunables.top_pad;
+    if (growHeap(-(intptr_t)release) == (void*)(-1)) {
+        return;
     }
 
-    /* b */
-    if (prev_free) {
-        size_t merged_size = block->block_size + prev_size + sizeof(MallocMetadata);
-        size_t diff = size - merged_size;
-        if (merged_size >= size) {
-            mergeWithLower(block, OCCUPIED);
-            block = block->prev;
-            updateStats(-1, -(prev_size), -1, sizeof(MallocMetadata));
-            return block;
-        } else if (block == global_ptr.tail) {
-            /* current block is wilderness */
-            void* prev_prog_break = sbrk((intptr_t)(diff));
-            if (prev_prog_break == (void*)(-1)) {
-                throw OutOfMemory();
-            }
-            mergeWithLower(block, OCCUPIED);
-            block = block->prev;
-            updateMetaData(block, OCCUPIED, block->block_size + diff);
-            updateStats(-1, -(prev_size), -1, sizeof(MallocMetadata) + diff);
-            return block;
+    bool top_dirty = top->dirty_slot != 0;
+    removeFromFreeIndex(top);
+    updateMetaData(top, FREE, tunables.top_pad);
+    insertToFreeIndex(top);
+    if (top_dirty) {
+        markDirty(top);
+    }
+    updateStats(0, -(long)release, 0, -(long)release);
+}
+
+long monotonicMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Drops the whole pages inside a free block, they read as zero when touched again */
+void purgeBlock(MallocMetadata* block)
+{
+    unsigned long page_mask = (unsigned long)sysconf(_SC_PAGESIZE) - 1;
+    unsigned long start = ((unsigned long)META_TO_DATA_PTR(block) + page_mask) & ~page_mask;
+    unsigned long end = ((unsigned long)META_TO_DATA_PTR(block) + block->block_size) & ~page_mask;
+    if (start < end) {
+        heapMadvise((void*)start, end - start, MADV_DONTNEED);
+    }
+}
+
+/* Purges the dirty set and empties it */
+template <class Config>
+void Engine<Config>::purgeDirtyBlocks()
+{
+    for (size_t i = 0; i < dirty_set.count; i++) {
+        purgeBlock(dirty_set.blocks[i]);
+        dirty_set.blocks[i]->dirty_slot = 0;
+    }
+    dirty_set.count = 0;
+}
+
+/* Adds a free block to the dirty set while purging is decayed. A full set is
+ * purged early, so the work per purge stays bounded */
+template <class Config>
+void Engine<Config>::markDirty(MallocMetadata* block)
+{
+    if (tunables.purge_decay_ms <= 0 || block->dirty_slot != 0) {
+        return;
+    }
+
+    if (dirty_set.count == DIRTY_SET_MAX) {
+        purgeDirtyBlocks();
+        tunables.last_purge_ms = monotonicMs();
+    }
+    dirty_set.blocks[dirty_set.count++] = block;
+    block->dirty_slot = (unsigned char)dirty_set.count;
+}
+
+/* With a purge decay of 0 the block just freed is purged right away, with more
+ * the blocks freed since the last purge are purged at most once per decay period */
+template <class Config>
+void Engine<Config>::purgeFreeBlocks(MallocMetadata* freed)
+{
+    if (tunables.purge_decay_ms < 0) {
+        return;
+    }
+
+    if (tunables.purge_decay_ms == 0) {
+        /*left over from a decay set before*/
+        purgeDirtyBlocks();
+        purgeBlock(freed);
+        return;
+    }
+
+    markDirty(freed);
+    long now = monotonicMs();
+    if (now - tunables.last_purge_ms < tunables.purge_decay_ms) {
+        return;
+    }
+
+    tunables.last_purge_ms = now;
+    purgeDirtyBlocks();
+}
+
+#ifdef MALLOC_DEFERRED_COALESCE
+
+/*------------------deferred coalescing--------------*/
+
+/* Optional lazy coalescing (build with -DMALLOC_DEFERRED_COALESCE). sfree only
+ * pushes the block on an unsorted LIFO bin, linked through its size list
+ * pointers. smalloc first looks there for a block it can take without a split;
+ * on a miss, or once the bin is full, every binned block is merged and sorted
+ * into the size list in one go. Binned blocks count as free in the stats, but
+ * are not merged with until then. */
+
+template <class Config>
+void Engine<Config>::unlinkDeferred(MallocMetadata* block)
+{
+    if (block->free_by_size_prev != NULL) {
+        block->free_by_size_prev->free_by_size_next = block->free_by_size_next;
+    } else {
+        deferred_bin.head = block->free_by_size_next;
+    }
+
+    if (block->free_by_size_next != NULL) {
+        block->free_by_size_next->free_by_size_prev = block->free_by_size_prev;
+    }
+    deferred_bin.count -= 1;
+}
+
+template <class Config>
+void Engine<Config>::consolidateDeferred()
+{
+    if (deferred_bin.head == NULL) {
+        return;
+    }
+
+    while (deferred_bin.head != NULL) {
+        MallocMetadata* block = deferred_bin.head;
+        unlinkDeferred(block);
+        /*freeAndMergeAdjacent counts the block as free again*/
+        updateStats(-1, -(long)(block->block_size), 0, 0);
+        purgeFreeBlocks(freeAndMergeAdjacent(block));
+    }
+    /*what sfree skipped, so trimming and purging work as in the eager build*/
+    trimWilderness();
+}
+
+template <class Config>
+void Engine<Config>::deferFree(MallocMetadata* block)
+{
+    if (deferred_bin.count == DEFERRED_BIN_MAX) {
+        consolidateDeferred();
+    }
+
+    updateMetaData(block, DEFERRED, block->block_size);
+    updateStats(1, block->block_size, 0, 0);
+    block->free_by_size_prev = NULL;
+    block->free_by_size_next = deferred_bin.head;
+    if (deferred_bin.head != NULL) {
+        deferred_bin.head->free_by_size_prev = block;
+    }
+    deferred_bin.head = block;
+    deferred_bin.count += 1;
+}
+
+/* A binned block of at least size that would not be split, NULL if there is none */
+template <class Config>
+MallocMetadata* Engine<Config>::takeDeferred(size_t size)
+{
+    for (MallocMetadata* block = deferred_bin.head; block != NULL; block = block->free_by_size_next) {
+        if (block->block_size >= size && block->block_size - size < tunables.split_threshold + sizeof(MallocMetadata)) {
+            unlinkDeferred(block);
+            updateMetaData(block, OCCUPIED, block->block_size);
+            updateStats(-1, -(long)(block->block_size), 0, 0);
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/* The stats and the heap walk describe the heap as if every free had merged,
+ * like glibc's mallinfo consolidating its fastbins first */
+#define SETTLE_DEFERRED() consolidateDeferred()
+#else
+#define SETTLE_DEFERRED() do {} while (0)
+#endif /* MALLOC_DEFERRED_COALESCE */
+
+#ifdef MALLOC_QUICK_LISTS
+
+/*------------------quick lists--------------*/
+
+/* Optional LIFO lists for a few hot exact block sizes (build with
+ * -DMALLOC_QUICK_LISTS). sfree of such a block pushes it on its list, linked
+ * through free_by_size_next, and leaves it DEFERRED so nothing merges with it;
+ * smalloc of that size pops it again. The blocks count as free in the stats.
+ * They are merged back into the heap when a list outgrows QUICK_LIST_MAX and
+ * before the heap would have to grow for a request nothing else fits. */
+
+const size_t quick_list_sizes[QUICK_LIST_SIZES] = { 24, 48, 96, 256 };
+
+inline int quickListIndex(size_t block_size)
+{
+    for (int i = 0; i < QUICK_LIST_SIZES; i++) {
+        if (block_size == quick_list_sizes[i]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+template <class Config>
+void Engine<Config>::consolidateQuickLists()
+{
+    for (int i = 0; i < QUICK_LIST_SIZES; i++) {
+        while (quick_lists.heads[i] != NULL) {
+            MallocMetadata* block = quick_lists.heads[i];
+            quick_lists.heads[i] = block->free_by_size_next;
+            /*freeAndMergeAdjacent counts the block as free again*/
+            updateStats(-1, -(long)(block->block_size), 0, 0);
+            purgeFreeBlocks(freeAndMergeAdjacent(block));
+        }
+        quick_lists.counts[i] = 0;
+    }
+    quick_lists.blocks = 0;
+    trimWilderness();
+}
+
+/* Returns false if the block is not of a quick list size */
+template <class Config>
+bool Engine<Config>::pushQuickList(MallocMetadata* block)
+{
+    int index = quickListIndex(block->block_size);
+    if (index == -1) {
+        return false;
+    }
+
+    if (quick_lists.counts[index] == QUICK_LIST_MAX) {
+        consolidateQuickLists();
+    }
+
+    updateMetaData(block, DEFERRED, block->block_size);
+    updateStats(1, block->block_size, 0, 0);
+    block->free_by_size_next = quick_lists.heads[index];
+    quick_lists.heads[index] = block;
+    quick_lists.counts[index] += 1;
+    quick_lists.blocks += 1;
+    return true;
+}
+
+template <class Config>
+MallocMetadata* Engine<Config>::popQuickList(size_t size)
+{
+    int index = quickListIndex(size);
+    if (index == -1 || quick_lists.heads[index] == NULL) {
+        return NULL;
+    }
+
+    MallocMetadata* block = quick_lists.heads[index];
+    quick_lists.heads[index] = block->free_by_size_next;
+    quick_lists.counts[index] -= 1;
+    quick_lists.blocks -= 1;
+    updateMetaData(block, OCCUPIED, block->block_size);
+    updateStats(-1, -(long)(block->block_size), 0, 0);
+    return block;
+}
+
+#endif /* MALLOC_QUICK_LISTS */
+
+template <class Config>
+MallocMetadata* Engine<Config>::tryToReuseOrMerge(MallocMetadata* block, size_t size)
+{/*will handle a-f and do split if necessary and handle stats if needed*/
+    size_t next_size = block->next != NULL ? block->next->block_size : 0;
+    size_t prev_size = block->prev != NULL ? block->prev->block_size : 0;
+    bool prev_free = (block->prev != NULL && block->prev->status == FREE && isAdjacent(block->prev, block));
+    bool next_free = (block->next != NULL && block->next->status == FREE && isAdjacent(block, block->next));
+
+    /* a */
+    if (block->block_size >= size) {
+        PROBE2(srealloc_case, block, 'a');
+        return block;
+    }
+
+    /* b */
+    if (prev_free) {
+        size_t merged_size = block->block_size + prev_size + sizeof(MallocMetadata);
+        size_t diff = size - merged_size;
+        if (merged_size >= size) {
+            mergeWithLower(block, OCCUPIED);
+            block = block->prev;
+            updateStats(-1, -(prev_size), -1, sizeof(MallocMetadata));
+            PROBE2(srealloc_case, block, 'b');
+            return block;
+        } else if (isWilderness(block)) {
+            /* current block is wilderness */
+            void* prev_prog_break = growHeap((intptr_t)(diff));
+            if (prev_prog_break == (void*)(-1)) {
+                throw OutOfMemory();
+            }
+            mergeWithLower(block, OCCUPIED);
+            block = block->prev;
+            updateMetaData(block, OCCUPIED, block->block_size + diff);
+            updateStats(-1, -(prev_size), -1, sizeof(MallocMetadata) + diff);
+            PROBE2(srealloc_case, block, 'b');
+            return block;
+        }
+    }
+
+    /* c */
+    if (isWilderness(block)) {
+        size_t diff = size - block->block_size;
+        void* prev_prog_break = growHeap((intptr_t)(diff));
+        if (prev_prog_break == (void*)(-1)) {
+            throw OutOfMemory();
+        }
+        updateMetaData(block, OCCUPIED, block->block_size + diff);
+        updateStats(0,0,0,diff);
+        PROBE2(srealloc_case, block, 'c');
+        return block;
+    }
+
+    /* d */
+    if (next_free && (size <= (block->block_size + next_size + sizeof(MallocMetadata)))) {
+        mergeWithUpper(block, OCCUPIED);
+        updateStats(-1, -(next_size), -1, sizeof(MallocMetadata));
+        PROBE2(srealloc_case, block, 'd');
+        return block;
+    }
+
+    /* e */
+    if (prev_free && next_free && (prev_size + next_size + block->block_size + 2* sizeof(MallocMetadata) >= size)) {
+        mergeWithUpper(block, OCCUPIED);
+        mergeWithLower(block, OCCUPIED);
+        block = block->prev;
+        updateStats(-2, -(prev_size + next_size), -2, 2*sizeof(MallocMetadata));
+        PROBE2(srealloc_case, block, 'e');
+        return block;
+    }
+
+    /* f */
+    if (next_free && isWilderness(block->next)) {
+        if (prev_free) {
+            size_t merged_size = prev_size + next_size + block->block_size + 2 * sizeof(MallocMetadata);
+            size_t diff = size - merged_size;
+
+            void *prev_prog_break = growHeap((intptr_t) (diff));
+            if (prev_prog_break == (void *) (-1)) {
+                throw OutOfMemory();
+            }
+
+            mergeWithUpper(block, OCCUPIED);
+            mergeWithLower(block, OCCUPIED);
+            block = block->prev;
+
+            updateMetaData(block, OCCUPIED, block->block_size + diff);
+            updateStats(-2, -(prev_size + next_size), -2,
+                        2 * sizeof(MallocMetadata) + diff);
+            PROBE2(srealloc_case, block, 'f');
+            return block;
+        } else {
+            size_t merged_size = next_size + block->block_size + sizeof(MallocMetadata);
+            size_t diff = size - merged_size;
+
+            void *prev_prog_break = growHeap((intptr_t) (diff));
+            if (prev_prog_break == (void *) (-1)) {
+                throw OutOfMemory();
+            }
+
+            mergeWithUpper(block, OCCUPIED);
+            updateMetaData(block, OCCUPIED, block->block_size + diff);
+            updateStats(-1, -(next_size), -1,sizeof(MallocMetadata) + diff);
+            PROBE2(srealloc_case, block, 'f');
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/* Records the pages of a newly mapped block in the page map, or gives the
+ * mapping back if that is not possible */
+bool ownMappedPages(MallocMetadata* block, size_t block_size, void* map_start, size_t map_size)
+{
+    if (pageMapSet(block, (char*)META_TO_DATA_PTR(block) + block_size, block)) {
+        return true;
+    }
+
+    heapMunmap(map_start, map_size);
+    return false;
+}
+
+template <class Config>
+void Engine<Config>::prependToMmapList(MallocMetadata* block)
+{
+    /*just insert, no stats needed */
+    block->next = heap.mmap_head;
+    block->prev = NULL;
+    if (heap.mmap_head != NULL) {
+        heap.mmap_head->prev = block;
+    }
+
+    heap.mmap_head = block;
+}
+
+template <class Config>
+void Engine<Config>::removeFromMmapList(MallocMetadata* meta)
+{
+    /*just take out, no stats needed */
+    MallocMetadata* prev = meta->prev, *next = meta->next;
+    if (heap_walk_cursor.next == meta) {
+        heap_walk_cursor.next = next;
+    }
+    if (prev != NULL) {
+        prev->next = next;
+    } else {
+        heap.mmap_head = next;
+    }
+
+    if (next != NULL) {
+        next->prev = prev;
+    }
+}
+
+/*----------------------------------------------------*/
+
+/* Runs once before the engine's first allocation or option call */
+template <class Config>
+int Engine<Config>::setup()
+{
+    if (source == MAPPED_ARENA && -1 == reserveArena()) {
+        return -1;
+    }
+    if (-1 == alignHeapEnd() || -1 == free_index.setup()) {
+        return -1;
+    }
+    /*the environment configures smalloc, other engines start from their Config alone*/
+    if (source == PROGRAM_BREAK) {
+        readTunablesFromEnvironment();
+    }
+    do_setup = false;
+    return 1;
+}
+
+/* The heap grew top_pad bytes more than size, leave them as a free block if they are worth one */
+template <class Config>
+void Engine<Config>::splitTopPad(MallocMetadata* block, size_t size)
+{
+    if (block->block_size >= size + tunables.split_threshold + sizeof(MallocMetadata)) {
+        splitBlock(block, size);
+    }
+}
+
+/* allocate without the profiler hook, for callers that report the allocation themselves */
+template <class Config>
+void* Engine<Config>::allocateBlock(size_t size) {
+    size_t aligned_size = Config::alignSize(size);
+
+    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
+        return NULL;
+    }
+
+    if (do_setup && -1 == setup()) {
+        return NULL;
+    }
+
+#ifdef MALLOC_QUICK_LISTS
+    MallocMetadata* quick = popQuickList(aligned_size);
+    if (quick != NULL) {
+        LATENCY_PATH(LATENCY_PATH_BIN_HIT);
+        return META_TO_DATA_PTR(quick);
+    }
+#endif
+
+#ifdef MALLOC_DEFERRED_COALESCE
+    if (aligned_size < tunables.mmap_threshold) {
+        MallocMetadata* recent = takeDeferred(aligned_size);
+        if (recent != NULL) {
+            LATENCY_PATH(LATENCY_PATH_BIN_HIT);
+            return META_TO_DATA_PTR(recent);
+        }
+    }
+    consolidateDeferred();
+#endif
+
+    MallocMetadata* place = findFit(aligned_size);
+#ifdef MALLOC_QUICK_LISTS
+    if (place == NULL && quick_lists.blocks != 0) {
+        /*the heap would have to grow, see if the quick-listed blocks merge into a fit first*/
+        consolidateQuickLists();
+        place = findFit(aligned_size);
+    }
+#endif
+
+    /*------------------no place in the list-------------------------*/
+    if (place == NULL){ 
+        if(aligned_size >= tunables.mmap_threshold)
+        {
+            MallocMetadata* new_region = (MallocMetadata*)heapMmap(aligned_size + sizeof(MallocMetadata));
+            if((void*)new_region == (void*)(-1) ||
+               !ownMappedPages(new_region, aligned_size, new_region, aligned_size + sizeof(MallocMetadata)))
+            {
+                return NULL;
+            }
+            updateMetaData(new_region, OCCUPIED, aligned_size, true);
+            updateStats(0,0,1,aligned_size);
+            prependToMmapList(new_region);
+            LATENCY_PATH(LATENCY_PATH_MMAP);
+
+            return META_TO_DATA_PTR(new_region);
+        }
+
+        if(heap.tail != NULL && heap.tail->status == FREE && isWilderness(heap.tail))
+        { //wilderness block is free but not big enough, so will enlarge it
+            long diff = (long)(aligned_size + tunables.top_pad - heap.tail->block_size);
+            MallocMetadata* curr = (MallocMetadata*)growHeap((intptr_t)(diff));
+            if ((void*)curr == (void*)(-1)) {
+                return NULL;
+            }
+
+            updateStats(-1, -(long)(heap.tail->block_size), 0, diff);
+            removeFromFreeIndex(heap.tail);
+            updateMetaData(heap.tail, OCCUPIED, heap.tail->block_size + diff); //will change status to the given one and update free stats
+            MallocMetadata* grown = heap.tail;
+            splitTopPad(grown, aligned_size);
+            LATENCY_PATH(LATENCY_PATH_WILDERNESS);
+
+            return META_TO_DATA_PTR(grown);
+        }
+
+        if (heap.tail != NULL && !isWilderness(heap.tail) && -1 == alignHeapEnd()) {
+            /*the break was moved by someone else and may be unaligned now*/
+            return NULL;
+        }
+
+        MallocMetadata* new_block = (MallocMetadata*)growHeap((intptr_t)(aligned_size + tunables.top_pad + sizeof(MallocMetadata)));
+        if ((void*)new_block == (void*)(-1)) {
+            return NULL;
+        }
+
+        updateMetaData(new_block, OCCUPIED, aligned_size + tunables.top_pad);
+        updateStats(0,0,1,aligned_size + tunables.top_pad);
+        appendToMemoryList(new_block);
+        splitTopPad(new_block, aligned_size);
+        LATENCY_PATH(LATENCY_PATH_SBRK);
+
+        return META_TO_DATA_PTR(new_block);
+    }
+    /*-------------------------------------------------------------------------------------*/
+
+
+    /*---------------------found place---------------------------*/
+    size_t diff = place->block_size - aligned_size;
+    if(diff >= tunables.split_threshold + sizeof(MallocMetadata))
+    {
+        splitBlock(place, aligned_size);
+        LATENCY_PATH(LATENCY_PATH_SPLIT);
+        return META_TO_DATA_PTR(place);
+    }
+    else{
+        removeFromFreeIndex(place);
+        updateMetaData(place, OCCUPIED, place->block_size);
+        updateStats(-1, -(long)(place->block_size), 0, 0);
+        LATENCY_PATH(LATENCY_PATH_BIN_HIT);
+        return META_TO_DATA_PTR(place);
+    }
+}
+
+/* smalloc of this engine, bypassing the small object pages */
+template <class Config>
+void* Engine<Config>::allocate(size_t size)
+{
+    return profileAllocation(allocateBlock(size), size);
+}
+
+/* Shrinks an occupied block at the top of the heap to size, giving the rest back */
+template <class Config>
+void Engine<Config>::shrinkTop(MallocMetadata* block, size_t size)
+{
+    size_t tail = block->block_size - size;
+    if (tail != 0 && isWilderness(block) && growHeap(-(intptr_t)tail) != (void*)(-1)) {
+        block->block_size = size;
+        updateStats(0, 0, 0, -(long)tail);
+    }
+}
+
+/* The engine of smalloc and friends, the one on the program break */
+Engine<Config> heap_engine(PROGRAM_BREAK);
+
+#ifdef MALLOC_SMALL_BITMAP
+
+/*------------------small object pages--------------*/
+
+/* Optional allocator for 1..128 byte requests (build with -DMALLOC_SMALL_BITMAP).
+ * Every size class (multiples of 8) takes 4K pages from spans of 16 pages, which
+ * come from the main heap with smemalign. A span is one block header short of
+ * its 16 pages, so the next span's data starts page aligned right behind it and
+ * spans carved in a row leave no alignment gap between them. A page starts with a SmallPage header followed by equal slots, and
+ * a bit set in its bitmap marks a free slot, so an object has no header and
+ * no free list pointer: smalloc takes the lowest set bit, sfree sets it again.
+ * The page map points the page at its SmallPage (tagged with the low bit),
+ * which is how sfree/srealloc/susable_size tell small objects apart.
+ * Pages with a free slot are linked per class; a page that empties goes back to
+ * its span unless it is the only one of its class, and a span whose pages are
+ * all back goes back to the main heap.
+ * The block stats and the heap walk see the spans, not the objects in them. */
+
+#define SMALL_PAGE_SIZE (1UL << PAGE_MAP_PAGE_SHIFT)
+#define SMALL_MAX_SIZE (128)
+#define SMALL_CLASSES (SMALL_MAX_SIZE / 8)
+#define SMALL_BITMAP_WORDS (SMALL_PAGE_SIZE / 8 / 64)
+#define SMALL_OWNER_TAG (1UL)
+#define SMALL_SPAN_PAGES (16)
+#define SMALL_SPAN_BYTES (SMALL_SPAN_PAGES * SMALL_PAGE_SIZE - sizeof(MallocMetadata))
+
+static_assert(Config::alignment() == 8, "the small object classes are only 8 bytes apart");
+
+struct SmallSpan;
+
+struct SmallPage {
+    SmallPage* next; /*pages of the same class with a free slot, or free pages of the span*/
+    SmallPage* prev;
+    SmallSpan* span;
+    uint32_t object_size;
+    uint32_t capacity;
+    uint32_t live;
+    bool is_listed;
+    uint64_t free_slots[SMALL_BITMAP_WORDS];
+};
+
+/* Sits at the end of the last page of its span */
+struct SmallSpan {
+    SmallSpan* next; /*spans with a page to give*/
+    SmallSpan* prev;
+    SmallPage* free_pages; /*given back by their class*/
+    void* owner; /*what the page map said about the pages before*/
+    uint32_t carved; /*pages handed out at least once, the rest was never touched*/
+    uint32_t pages_in_use;
+    bool is_listed;
+};
+
+struct SmallClass {
+    SmallPage* pages; /*the ones with a free slot*/
+    size_t page_count;
+};
+
+SmallClass small_classes[SMALL_CLASSES];
+SmallSpan* small_spans = NULL; /*the ones with a page to give*/
+size_t small_span_count = 0;
+size_t small_live_objects = 0;
+
+void* smemalign(size_t alignment, size_t size);
+void sfree(void* p);
+
+inline SmallPage* smallPageOf(void* owner)
+{
+    return ((unsigned long)owner & SMALL_OWNER_TAG) ? (SmallPage*)((unsigned long)owner & ~SMALL_OWNER_TAG) : NULL;
+}
+
+inline char* firstSlot(SmallPage* page)
+{
+    return (char*)page + sizeof(SmallPage);
+}
+
+void listSmallPage(SmallClass* small_class, SmallPage* page)
+{
+    page->prev = NULL;
+    page->next = small_class->pages;
+    if (small_class->pages != NULL) {
+        small_class->pages->prev = page;
+    }
+    small_class->pages = page;
+    page->is_listed = true;
+}
+
+void unlistSmallPage(SmallClass* small_class, SmallPage* page)
+{
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        small_class->pages = page->next;
+    }
+
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    }
+    page->is_listed = false;
+}
+
+inline char* spanPages(SmallSpan* span)
+{
+    return (char*)(span + 1) - SMALL_SPAN_BYTES;
+}
+
+void listSmallSpan(SmallSpan* span)
+{
+    span->prev = NULL;
+    span->next = small_spans;
+    if (small_spans != NULL) {
+        small_spans->prev = span;
+    }
+    small_spans = span;
+    span->is_listed = true;
+}
+
+void unlistSmallSpan(SmallSpan* span)
+{
+    if (span->prev != NULL) {
+        span->prev->next = span->next;
+    } else {
+        small_spans = span->next;
+    }
+
+    if (span->next != NULL) {
+        span->next->prev = span->prev;
+    }
+    span->is_listed = false;
+}
+
+SmallSpan* newSmallSpan()
+{
+    char* pages = (char*)smemalign(SMALL_PAGE_SIZE, SMALL_SPAN_BYTES);
+    if (pages == NULL) {
+        return NULL;
+    }
+
+    /*smemalign may leave a tail too small to split, at the top of the heap it goes
+     *back so that the next span starts page aligned right here*/
+    heap_engine.shrinkTop(DATA_TO_META_PTR(pages), SMALL_SPAN_BYTES);
+
+    SmallSpan* span = (SmallSpan*)(pages + SMALL_SPAN_BYTES) - 1;
+    span->free_pages = NULL;
+    span->owner = pageMapGet(pages);
+    span->carved = 0;
+    span->pages_in_use = 0;
+    small_span_count += 1;
+    listSmallSpan(span);
+    return span;
+}
+
+/* Gives a page back to its span, and the span back to the heap once it has all its pages */
+void releaseSmallPage(SmallPage* page)
+{
+    SmallSpan* span = page->span;
+    page->next = span->free_pages;
+    span->free_pages = page;
+    span->pages_in_use -= 1;
+    if (span->pages_in_use != 0) {
+        if (!span->is_listed) {
+            listSmallSpan(span);
+        }
+        return;
+    }
+
+    if (span->is_listed) {
+        unlistSmallSpan(span);
+    }
+    small_span_count -= 1;
+    pageMapSet(spanPages(span), spanPages(span) + SMALL_SPAN_BYTES, span->owner);
+    sfree(spanPages(span));
+}
+
+SmallPage* newSmallPage(size_t class_index)
+{
+    SmallSpan* span = small_spans != NULL ? small_spans : newSmallSpan();
+    if (span == NULL) {
+        return NULL;
+    }
+
+    SmallPage* page = span->free_pages;
+    if (page != NULL) {
+        span->free_pages = page->next;
+    } else {
+        page = (SmallPage*)(spanPages(span) + span->carved * SMALL_PAGE_SIZE);
+        if (!pageMapSet(page, (char*)page + SMALL_PAGE_SIZE, (void*)((unsigned long)page | SMALL_OWNER_TAG))) {
+            if (span->pages_in_use == 0 && span->carved == 0) {
+                unlistSmallSpan(span);
+                small_span_count -= 1;
+                sfree(spanPages(span));
+            }
+            return NULL;
+        }
+        span->carved += 1;
+    }
+
+    span->pages_in_use += 1;
+    if (span->free_pages == NULL && span->carved == SMALL_SPAN_PAGES) {
+        unlistSmallSpan(span);
+    }
+
+    /*the last page holds the span and lends its end to the next block's header*/
+    size_t page_bytes = (char*)page + SMALL_PAGE_SIZE > (char*)span ? (char*)span - (char*)page : SMALL_PAGE_SIZE;
+    page->span = span;
+    page->object_size = (uint32_t)((class_index + 1) * 8);
+    page->capacity = (uint32_t)((page_bytes - sizeof(SmallPage)) / page->object_size);
+    page->live = 0;
+    memset(page->free_slots, 0, sizeof(page->free_slots));
+    for (uint32_t word = 0; word < page->capacity / 64; word++) {
+        page->free_slots[word] = ~0UL;
+    }
+    if (page->capacity % 64 != 0) {
+        page->free_slots[page->capacity / 64] = (1UL << (page->capacity % 64)) - 1;
+    }
+
+    small_classes[class_index].page_count += 1;
+    listSmallPage(&small_classes[class_index], page);
+    return page;
+}
+
+void* smallAlloc(size_t size)
+{
+    size_t class_index = (size - 1) / 8;
+    SmallPage* page = small_classes[class_index].pages;
+    if (page == NULL) {
+        page = newSmallPage(class_index);
+        if (page == NULL) {
+            return NULL;
+        }
+    }
+
+    /*a listed page always has a set bit*/
+    size_t word = 0;
+    while (page->free_slots[word] == 0) {
+        word++;
+    }
+
+    size_t slot = word * 64 + __builtin_ctzl(page->free_slots[word]);
+    page->free_slots[word] &= page->free_slots[word] - 1;
+    page->live += 1;
+    small_live_objects += 1;
+    if (page->live == page->capacity) {
+        unlistSmallPage(&small_classes[class_index], page);
+    }
+
+    return firstSlot(page) + slot * page->object_size;
+}
+
+void smallFree(SmallPage* page, void* p)
+{
+    size_t offset = (char*)p - firstSlot(page);
+    size_t slot = offset / page->object_size;
+    if ((char*)p < firstSlot(page) || offset % page->object_size != 0 || slot >= page->capacity ||
+        (page->free_slots[slot / 64] & (1UL << (slot % 64)))) {
+        /*not the start of a slot, or already free*/
+        return;
+    }
+
+    page->free_slots[slot / 64] |= 1UL << (slot % 64);
+    page->live -= 1;
+    small_live_objects -= 1;
+
+    SmallClass* small_class = &small_classes[page->object_size / 8 - 1];
+    if (!page->is_listed) {
+        listSmallPage(small_class, page);
+    }
+
+    if (page->live == 0 && small_class->page_count > 1) {
+        unlistSmallPage(small_class, page);
+        small_class->page_count -= 1;
+        releaseSmallPage(page);
+    }
+}
+
+size_t _num_small_pages() {
+    size_t pages = 0;
+    for (size_t i = 0; i < SMALL_CLASSES; i++) {
+        pages += small_classes[i].page_count;
+    }
+
+    return pages;
+}
+
+size_t _num_small_objects() {
+    return small_live_objects;
+}
+
+size_t _num_small_spans() {
+    return small_span_count;
+}
+
+size_t _num_small_free_slots() {
+    /*full pages are not listed, and have no free slot to count anyway*/
+    size_t slots = 0;
+    for (size_t i = 0; i < SMALL_CLASSES; i++) {
+        for (SmallPage* page = small_classes[i].pages; page != NULL; page = page->next) {
+            for (size_t word = 0; word < SMALL_BITMAP_WORDS; word++) {
+                slots += __builtin_popcountl(page->free_slots[word]);
+            }
+        }
+    }
+
+    return slots;
+}
+
+#endif /* MALLOC_SMALL_BITMAP */
+
+void* smalloc(size_t size) {
+    LATENCY_SCOPE(LATENCY_SMALLOC);
+    PROBE1(smalloc_entry, size);
+#ifdef MALLOC_SMALL_BITMAP
+    if (size != 0 && size <= SMALL_MAX_SIZE) {
+        /*not sampled one by one, the heap profiler sees the pages they live in*/
+        void* small_ptr = smallAlloc(size);
+        PROBE2(smalloc_return, small_ptr, size);
+        return small_ptr;
+    }
+#endif
+    void* ret_ptr = heap_engine.allocate(size);
+    PROBE2(smalloc_return, ret_ptr, size);
+    return ret_ptr;
+}
+
+size_t susable_size(void* p);
+
+void* scalloc(size_t num, size_t size) {
+    LATENCY_SCOPE(LATENCY_SCALLOC);
+    void* ret_ptr = smalloc(num*size);
+    if (ret_ptr != NULL) {
+        memset(ret_ptr, 0, susable_size(ret_ptr));
+    }
+
+    return ret_ptr;
+}
+
+/* Frees a block deallocate or sfree_sized already know to be one of ours */
+template <class Config>
+void Engine<Config>::freeBlock(void* p) {
+    MallocMetadata* metadata_ptr = DATA_TO_META_PTR(p);
+    PROBE3(sfree, p, metadata_ptr->block_size, metadata_ptr->is_mmapped);
+
+    if (metadata_ptr->status == OCCUPIED) {
+        if (metadata_ptr->is_sampled) {
+            forgetSample(p);
+        }
+
+        if(metadata_ptr->is_mmapped == true)
+        {
+//            updateMetaData(metadata_ptr, FREE, metadata_ptr->block_size, true);
+            updateStats(0,0,-1,-(long)(metadata_ptr->block_size));
+            removeFromMmapList(metadata_ptr);
+            /*aligned mmapped blocks may start inside the first page of their mapping*/
+            char* map_start = (char*)((unsigned long)metadata_ptr & ~((unsigned long)sysconf(_SC_PAGESIZE) - 1));
+            size_t map_size = (char*)metadata_ptr - map_start + sizeof(MallocMetadata) + metadata_ptr->block_size;
+            int res = heapMunmap(map_start, map_size);
+            /*as long as metadata_ptr was mmapped it should not fail*/
+            assert(res != -1);
+            LATENCY_PATH(LATENCY_PATH_MUNMAP);
+        }
+        else{
+#ifdef MALLOC_QUICK_LISTS
+            if (pushQuickList(metadata_ptr)) {
+                LATENCY_PATH(LATENCY_PATH_FREE);
+                return;
+            }
+#endif
+#ifdef MALLOC_DEFERRED_COALESCE
+            deferFree(metadata_ptr);
+#else
+            MallocMetadata* merged = freeAndMergeAdjacent(metadata_ptr);
+            trimWilderness();
+            purgeFreeBlocks(merged);
+#endif
+            LATENCY_PATH(LATENCY_PATH_FREE);
+        }
+    }
+}
+
+/* Whether p is a block of this engine, given the page map's owner of p. Only
+ * pointers into its own pages are trusted, and mmapped blocks must be freed by their start */
+template <class Config>
+bool Engine<Config>::owns(void* p, void* owner)
+{
+    return owner == this || (owner != NULL && owner == DATA_TO_META_PTR(p));
+}
+
+/* sfree of this engine */
+template <class Config>
+void Engine<Config>::deallocate(void* p)
+{
+    if (p != NULL && owns(p, pageMapGet(p))) {
+        freeBlock(p);
+    }
+}
+
+void sfree(void* p) {
+    LATENCY_SCOPE(LATENCY_SFREE);
+    if (p == NULL) {
+        return;
+    }
+
+    void* owner = pageMapGet(p);
+#ifdef MALLOC_SMALL_BITMAP
+    if (smallPageOf(owner) != NULL) {
+        smallFree(smallPageOf(owner), p);
+        return;
+    }
+#endif
+    if (heap_engine.owns(p, owner)) {
+        heap_engine.freeBlock(p);
+    }
+}
+
+/* sfree for a p that smalloc or scalloc returned for size bytes, like a sized
+ * operator delete. The caller vouches for p, so the page map is not asked and
+ * a small object is found from the address of its page alone */
+void sfree_sized(void* p, size_t size) {
+    LATENCY_SCOPE(LATENCY_SFREE);
+    if (p == NULL) {
+        return;
+    }
+
+#ifdef MALLOC_SMALL_BITMAP
+    if (size != 0 && size <= SMALL_MAX_SIZE) {
+        smallFree((SmallPage*)((unsigned long)p & ~(SMALL_PAGE_SIZE - 1)), p);
+        return;
+    }
+#else
+    (void)size;
+#endif
+
+    heap_engine.freeBlock(p);
+}
+
+/* srealloc without the probes and the latency scope, every exit returns through srealloc */
+void* reallocateBlock(void* oldp, size_t size) {
+    size_t aligned_size = Config::alignSize(size);
+    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
+        return NULL;
+    }
+
+    if (oldp == NULL) {
+        return smalloc(aligned_size);
+    }
+
+#ifdef MALLOC_SMALL_BITMAP
+    SmallPage* small_page = smallPageOf(pageMapGet(oldp));
+    if (small_page != NULL) {
+        if (aligned_size <= small_page->object_size) {
+            return oldp;
+        }
+
+        void* newp = smalloc(aligned_size);
+        if (newp != NULL) {
+            memcpy(newp, oldp, small_page->object_size);
+            smallFree(small_page, oldp);
+        }
+        return newp;
+    }
+#endif
+
+    return heap_engine.reallocate(oldp, aligned_size);
+}
+
+/* srealloc of this engine */
+template <class Config>
+void* Engine<Config>::reallocate(void* oldp, size_t size) {
+    size_t aligned_size = Config::alignSize(size);
+    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
+        return NULL;
+    }
+
+    if (oldp == NULL) {
+        return allocate(aligned_size);
+    }
+
+    MallocMetadata* old_meta_ptr = DATA_TO_META_PTR(oldp);
+    if (old_meta_ptr->block_size == aligned_size) {
+        LATENCY_PATH(LATENCY_PATH_IN_PLACE);
+        return oldp;
+    } 
+    if (old_meta_ptr->is_mmapped == IS_MMAP)
+    {
+        MallocMetadata* new_region = (MallocMetadata*)heapMmap(aligned_size + sizeof(MallocMetadata));
+        if( (void*)new_region == (void*)(-1) ||
+            !ownMappedPages(new_region, aligned_size, new_region, aligned_size + sizeof(MallocMetadata)))
+        {
+            return NULL;
+        }
+        LATENCY_PATH(LATENCY_PATH_MMAP);
+
+        size_t min_copy_size = old_meta_ptr->block_size <= aligned_size ? old_meta_ptr->block_size : aligned_size;
+        void* move_ret = memmove(META_TO_DATA_PTR(new_region), oldp, min_copy_size);
+        if( move_ret != META_TO_DATA_PTR(new_region))
+        {
+            return NULL;
+        }
+        updateMetaData(new_region, OCCUPIED, aligned_size, true);
+        updateStats(0, 0, 1, aligned_size);
+        prependToMmapList(new_region);
+        
+        deallocate(oldp);
+        return profileAllocation(META_TO_DATA_PTR(new_region), aligned_size);
+    }
+    else {
+        MallocMetadata* newp_meta;
+        void* address;
+        bool used_malloc = false;
+        /*merging may overwrite the old header, so remember this now*/
+        bool was_sampled = old_meta_ptr->is_sampled;
+        try{
+            newp_meta = tryToReuseOrMerge(old_meta_ptr,aligned_size);
+        }
+        catch(OutOfMemory& err){
+            return NULL;
+        }
+        if ( newp_meta == NULL)
+        { /*could not reuse any existing blocks*/
+            address = allocateBlock(aligned_size);
+            if(address == NULL)
+            {
+                return NULL;
+            }
+            used_malloc = true;
+        }else {
+            LATENCY_PATH(LATENCY_PATH_IN_PLACE);
+            address = META_TO_DATA_PTR(newp_meta);
+        }
+
+        size_t min_copy_size = old_meta_ptr->block_size <= aligned_size ? old_meta_ptr->block_size : aligned_size;
+        void* move_ret = memmove(address, oldp, min_copy_size);
+        if (move_ret != address) {
+            /* TODO: Should we somehow undo the allocation of newp? */
+            return NULL;
+        }
+
+        if(used_malloc == true)
+        {
+            deallocate(oldp);
+        } else {
+            if (was_sampled) {
+                forgetSample(oldp);
+                newp_meta->is_sampled = false;
+            }
+            if (newp_meta->block_size >= aligned_size + tunables.split_threshold + sizeof(MallocMetadata)) {
+                splitBlock(newp_meta, aligned_size);
+            }
+        }
+        return profileAllocation(address, aligned_size);
+    }
+}
+
+void* srealloc(void* oldp, size_t size) {
+    LATENCY_SCOPE(LATENCY_SREALLOC);
+    PROBE2(srealloc_entry, oldp, size);
+    void* newp = reallocateBlock(oldp, size);
+    PROBE2(srealloc_return, newp, size);
+    return newp;
+}
+
+template <class Config>
+void* Engine<Config>::mmapAligned(size_t alignment, size_t aligned_size)
+{
+    /*over-map, place the header right before the first aligned address and
+     *give back whole pages in front of the header*/
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = aligned_size + sizeof(MallocMetadata) + alignment;
+    char* region = (char*)heapMmap(map_size);
+    if ((void*)region == (void*)(-1)) {
+        return NULL;
+    }
+
+    unsigned long aligned_data = ((unsigned long)region + sizeof(MallocMetadata) + alignment - 1) & ~(alignment - 1);
+    MallocMetadata* block = DATA_TO_META_PTR(aligned_data);
+    size_t lead_size = ((char*)block - region) & ~(page_size - 1);
+    if (lead_size != 0) {
+        int res = heapMunmap(region, lead_size);
+        assert(res != -1);
+        (void)res;
+    }
+
+    if (!ownMappedPages(block, region + map_size - (char*)aligned_data, region + lead_size, map_size - lead_size)) {
+        return NULL;
+    }
+
+    updateMetaData(block, OCCUPIED, region + map_size - (char*)aligned_data, true);
+    updateStats(0, 0, 1, block->block_size);
+    prependToMmapList(block);
+    LATENCY_PATH(LATENCY_PATH_MMAP);
+
+    return (void*)aligned_data;
+}
+
+/* smemalign of this engine */
+template <class Config>
+void* Engine<Config>::allocateAligned(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    void* ret_ptr = allocateBlock(size);
+    if (ret_ptr == NULL || (unsigned long)ret_ptr % alignment == 0) {
+        return profileAllocation(ret_ptr, size);
+    }
+    deallocate(ret_ptr);
+
+    size_t aligned_size = Config::alignSize(size);
+    if (aligned_size >= tunables.mmap_threshold) {
+        return profileAllocation(mmapAligned(alignment, aligned_size), size);
+    }
+
+    ret_ptr = allocateBlock(aligned_size + alignment + sizeof(MallocMetadata));
+    if (ret_ptr == NULL) {
+        return NULL;
+    }
+
+    MallocMetadata* block = DATA_TO_META_PTR(ret_ptr);
+    if (block->is_mmapped == IS_MMAP) {
+        deallocate(ret_ptr);
+        return profileAllocation(mmapAligned(alignment, aligned_size), size);
+    }
+
+    MallocMetadata* aligned_block = block;
+    unsigned long aligned_data = (unsigned long)ret_ptr;
+    if (aligned_data % alignment != 0) {
+        /*carve the block into a free front part and an aligned occupied part.
+         *The front must hold at least one byte, when the header alone fills the
+         *gap move on to the next aligned address, the extra alignment bytes
+         *asked for above leave room for that*/
+        aligned_data = ((unsigned long)ret_ptr + sizeof(MallocMetadata) + alignment - 1) & ~(alignment - 1);
+        if (aligned_data == (unsigned long)ret_ptr + sizeof(MallocMetadata)) {
+            aligned_data += alignment;
+        }
+        aligned_block = DATA_TO_META_PTR(aligned_data);
+        size_t front_size = (char*)aligned_block - (char*)ret_ptr;
+
+        updateMetaData(aligned_block, OCCUPIED, block->block_size - front_size - sizeof(MallocMetadata));
+        aligned_block->next = block->next;
+        aligned_block->prev = block;
+        if (block->next == NULL) {
+            heap.tail = aligned_block;
+        } else {
+            block->next->prev = aligned_block;
+        }
+        block->next = aligned_block;
+
+        updateMetaData(block, OCCUPIED, front_size);
+        updateStats(0, 0, 1, -((long)sizeof(MallocMetadata)));
+        freeAndMergeAdjacent(block);
+    }
+
+    if (aligned_block->block_size >= aligned_size + tunables.split_threshold + sizeof(MallocMetadata)) {
+        splitBlock(aligned_block, aligned_size);
+    }
+
+    return profileAllocation((void*)aligned_data, size);
+}
+
+void* smemalign(size_t alignment, size_t size) {
+    LATENCY_SCOPE(LATENCY_SMEMALIGN);
+    return heap_engine.allocateAligned(alignment, size);
+}
+
+size_t susable_size(void* p) {
+    if (p == NULL) {
+        return 0;
+    }
+
+    void* owner = pageMapGet(p);
+#ifdef MALLOC_SMALL_BITMAP
+    SmallPage* small_page = smallPageOf(owner);
+    if (small_page != NULL) {
+        return small_page->object_size;
+    }
+#endif
+
+    /*a pointer sfree would ignore has no header to read*/
+    if (!heap_engine.owns(p, owner)) {
+        return 0;
+    }
+
+    return DATA_TO_META_PTR(p)->block_size;
+}
+
+/* The block counters of the engine */
+template <class Config>
+const HeapMetadata& Engine<Config>::blockStats() {
+    SETTLE_DEFERRED();
+    return heap;
+}
+
+template <class Config>
+size_t Engine<Config>::largestFreeBlock() {
+    SETTLE_DEFERRED();
+    return free_index.largest();
+}
+
+size_t _num_free_blocks() {
+    return heap_engine.blockStats().free_blocks;
+}
+
+size_t _num_free_bytes() {
+    return heap_engine.blockStats().free_bytes;
+}
+
+size_t _num_allocated_blocks() {
+    return heap_engine.blockStats().allocated_blocks;
+}
+
+size_t _num_allocated_bytes() {
+    return heap_engine.blockStats().allocated_bytes;
+}
+
+size_t _num_meta_data_bytes() {
+    return (heap_engine.blockStats().allocated_blocks * sizeof(MallocMetadata));
+}
+
+size_t _largest_free_block() {
+    return heap_engine.largestFreeBlock();
+}
+
+/* Bytes currently mapped with mmap (big blocks, regions, pools), the part of
+ * the heap the program break does not show */
+size_t _num_mapped_bytes() {
+    return syscall_counters.mmap_bytes - syscall_counters.munmap_bytes;
+}
+
+double _external_fragmentation() {
+    /*0 when all free bytes are in one block, close to 1 when they are scattered in small holes*/
+    size_t free_bytes = _num_free_bytes();
+    if (free_bytes == 0) {
+        return 0;
+    }
+
+    return 1.0 - (double)_largest_free_block() / (double)free_bytes;
+}
+size_t _size_meta_data() {
+    return sizeof(MallocMetadata);
+}
+
+/* smallopt of this engine */
+template <class Config>
+bool Engine<Config>::setOption(int param, long value) {
+    if (do_setup && -1 == setup()) {
+        return false;
+    }
+
+    return setTunable(param, value);
+}
+
+/* _smallopt_value of this engine */
+template <class Config>
+bool Engine<Config>::option(int param, long* value) {
+    if (do_setup && -1 == setup()) {
+        return false;
+    }
+
+    switch (param) {
+        case SMALLOPT_MMAP_THRESHOLD:
+            *value = (long)tunables.mmap_threshold;
+            return true;
+        case SMALLOPT_SPLIT_THRESHOLD:
+            *value = (long)tunables.split_threshold;
+            return true;
+        case SMALLOPT_TRIM_THRESHOLD:
+            *value = tunables.trim_threshold;
+            return true;
+        case SMALLOPT_TOP_PAD:
+            *value = (long)tunables.top_pad;
+            return true;
+        case SMALLOPT_ARENA_MAX:
+            *value = tunables.arena_max;
+            return true;
+        case SMALLOPT_PURGE_DECAY_MS:
+            *value = tunables.purge_decay_ms;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Sets a smallopt_param for the allocations and frees that follow, 1 on success
+ * and 0 for an unknown parameter or a value out of its range */
+int smallopt(int param, long value) {
+    return heap_engine.setOption(param, value) ? 1 : 0;
+}
+
+/* Reads a smallopt_param back into value, 0 for an unknown parameter */
+int _smallopt_value(int param, long* value) {
+    return heap_engine.option(param, value) ? 1 : 0;
+}
+
+void _malloc_stats(MallocStats* stats) {
+    const HeapMetadata& heap = heap_engine.blockStats();
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->free_blocks = heap.free_blocks;
+    stats->free_bytes = heap.free_bytes;
+    stats->allocated_blocks = heap.allocated_blocks;
+    stats->allocated_bytes = heap.allocated_bytes;
+    stats->meta_data_bytes = _num_meta_data_bytes();
+    stats->sbrk_calls = syscall_counters.sbrk_calls;
+    stats->sbrk_bytes_grown = syscall_counters.sbrk_bytes_grown;
+    stats->sbrk_bytes_shrunk = syscall_counters.sbrk_bytes_shrunk;
+    stats->mmap_calls = syscall_counters.mmap_calls;
+    stats->mmap_bytes = syscall_counters.mmap_bytes;
+    stats->munmap_calls = syscall_counters.munmap_calls;
+    stats->munmap_bytes = syscall_counters.munmap_bytes;
+    stats->madvise_calls = syscall_counters.madvise_calls;
+
+    /*the kernel only counts faults per process, first touches of heap pages are part of these*/
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    stats->minor_faults = usage.ru_minflt;
+    stats->major_faults = usage.ru_majflt;
+    stats->minor_faults_delta = usage.ru_minflt - syscall_counters.last_minor_faults;
+    stats->major_faults_delta = usage.ru_majflt - syscall_counters.last_major_faults;
+    syscall_counters.last_minor_faults = usage.ru_minflt;
+    syscall_counters.last_major_faults = usage.ru_majflt;
+}
+
+/* _heap_walk of this engine */
+template <class Config>
+size_t Engine<Config>::walk(heap_walk_callback callback, void* ctx) {
+    /*sbrk blocks in address order, then the mmapped ones. The walk itself never
+     *allocates, but the callback must not call into the allocator either, since
+     *that could merge or unlink the block we are standing on.
+     *A non zero return from the callback stops the walk*/
+    SETTLE_DEFERRED();
+    size_t visited = 0;
+    MallocMetadata* lists[] = { heap.head, heap.mmap_head };
+    for (MallocMetadata* curr : lists) {
+        while (curr != NULL) {
+            visited += 1;
+            if (callback(META_TO_DATA_PTR(curr), curr->block_size, curr->status != OCCUPIED, curr->is_mmapped, ctx) != 0) {
+                return visited;
+            }
+            curr = curr->next;
+        }
+    }
+
+    return visited;
+}
+
+/* _heap_walk_step of this engine */
+template <class Config>
+size_t Engine<Config>::walkStep(heap_walk_callback callback, void* ctx, size_t max_blocks) {
+    SETTLE_DEFERRED();
+    if (!heap_walk_cursor.active) {
+        heap_walk_cursor = { heap.head, false, true };
+    }
+
+    size_t visited = 0;
+    while (visited < max_blocks) {
+        MallocMetadata* curr = heap_walk_cursor.next;
+        if (curr == NULL) {
+            if (heap_walk_cursor.in_mmap_list) {
+                /*report the end on its own step so a batch loop sees 0*/
+                heap_walk_cursor.active = visited != 0;
+                break;
+            }
+            heap_walk_cursor.next = heap.mmap_head;
+            heap_walk_cursor.in_mmap_list = true;
+            continue;
+        }
+
+        heap_walk_cursor.next = curr->next;
+        visited += 1;
+        if (callback(META_TO_DATA_PTR(curr), curr->block_size, curr->status != OCCUPIED, curr->is_mmapped, ctx) != 0) {
+            break;
+        }
+    }
+
+    return visited;
+}
+
+/* _heap_walk_rewind of this engine */
+template <class Config>
+void Engine<Config>::rewindWalk() {
+    heap_walk_cursor.active = false;
+}
+
+size_t _heap_walk(heap_walk_callback callback, void* ctx) {
+    return heap_engine.walk(callback, ctx);
+}
+
+/* Visits at most max_blocks blocks in the order of _heap_walk, starting where the
+ * previous step stopped. Returns how many were visited, 0 once the walk is done;
+ * the step after that starts a new walk. The allocator may be used between steps:
+ * blocks that live through the whole walk are visited exactly once, blocks made,
+ * split off or merged meanwhile may be missed or seen in their old shape */
+size_t _heap_walk_step(heap_walk_callback callback, void* ctx, size_t max_blocks) {
+    return heap_engine.walkStep(callback, ctx, max_blocks);
+}
+
+/* Drops a walk left half way, the next _heap_walk_step starts from the first block */
+void _heap_walk_rewind() {
+    heap_engine.rewindWalk();
+}
+
+/*what regions and object pools hold, on top of the blocks they live in*/
+struct RegionCounters {
+    size_t region_chunks; /*chunks currently held by all regions*/
+    size_t region_bytes; /*bytes handed out by all regions since their last reset*/
+    size_t pool_chunks; /*chunks currently held by all object pools*/
+    size_t pool_bytes;
+};
+
+RegionCounters region_counters = { 0, 0, 0, 0 };
+
+size_t _num_region_chunks() {
+    return region_counters.region_chunks;
+}
+
+size_t _num_region_bytes() {
+    return region_counters.region_bytes;
+}
+
+size_t _num_pool_chunks() {
+    return region_counters.pool_chunks;
+}
+
+size_t _num_pool_bytes() {
+    return region_counters.pool_bytes;
+}
+
+void _pool_account(long chunks, long bytes) {
+    /*called by ObjectPool (object_pool.h) whenever it takes or returns a chunk*/
+    region_counters.pool_chunks += chunks;
+    region_counters.pool_bytes += bytes;
+}
+
+/*------------------heap profiler control--------------*/
+
+int _heap_profile_start(size_t sample_period) {
+    if (heap_profile.buckets == NULL) {
+        /*mmapped rather than static, so programs that never profile do not carry the tables*/
+        size_t buckets_size = HEAP_PROFILE_BUCKETS * sizeof(StackBucket);
+        size_t slots_size = HEAP_PROFILE_SLOTS * sizeof(SampleSlot);
+        char* tables = (char*)mmap(NULL, buckets_size + slots_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if ((void*)tables == (void*)(-1)) {
+            return -1;
         }
+        heap_profile.buckets = (StackBucket*)tables;
+        heap_profile.slots = (SampleSlot*)(tables + buckets_size);
+
+        /*the first backtrace loads libgcc, get that over with outside of smalloc*/
+        void* frame;
+        backtrace(&frame, 1);
     }
 
-    /* c */
-    if (block == global_ptr.tail) {
-        size_t diff = size - block->block_size;
-        void* prev_prog_break = sbrk((intptr_t)(diff));
-        if (prev_prog_break == (void*)(-1)) {
-            throw OutOfMemory();
+    heap_profile.period = sample_period == 0 ? HEAP_PROFILE_DEFAULT_PERIOD : sample_period;
+    heap_profile.enabled = true;
+    heap_profile.bytes_until_sample = nextSampleGap();
+    return 0;
+}
+
+void _heap_profile_stop() {
+    /*blocks sampled so far stay tracked until they are freed*/
+    heap_profile.enabled = false;
+    heap_profile.bytes_until_sample = SIZE_MAX;
+}
+
+size_t _heap_profile_samples() {
+    return heap_profile.live_samples;
+}
+
+bool writeAll(int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written <= 0) {
+            return false;
         }
-        updateMetaData(block, OCCUPIED, block->block_size + diff);
-        updateStats(0,0,0,diff);
-        return block;
+        buf += written;
+        len -= (size_t)written;
     }
 
-    /* d */
-    if (next_free && (size <= (block->block_size + next_size + sizeof(MallocMetadata)))) {
-        mergeWithUpper(block, OCCUPIED);
-        updateStats(-1, -(next_size), -1, sizeof(MallocMetadata));
-        return block;
-    }
+    return true;
+}
 
-    /* e */
-    if (prev_free && next_free && (prev_size + next_size + block->block_size + 2* sizeof(MallocMetadata) >= size)) {
-        mergeWithUpper(block, OCCUPIED);
-        mergeWithLower(block, OCCUPIED);
-        block = block->prev;
-        updateStats(-2, -(prev_size + next_size), -2, 2*sizeof(MallocMetadata));
-        return block;
+int _heap_profile_dump(int fd) {
+    /*legacy gperftools heap profile, which pprof reads as is:
+     *  heap profile: <in use objects>: <in use bytes> [<allocated objects>: <allocated bytes>] @ heap_v2/<period>
+     *followed by one such line per stack and the memory map for symbolization.
+     *Only write(2) and snprintf, so this is safe to run from inside the allocator*/
+    size_t in_use_objects = 0, in_use_bytes = 0, alloc_objects = 0, alloc_bytes = 0;
+    for (size_t i = 0; heap_profile.buckets != NULL && i < HEAP_PROFILE_BUCKETS; i++) {
+        in_use_objects += heap_profile.buckets[i].in_use_objects;
+        in_use_bytes += heap_profile.buckets[i].in_use_bytes;
+        alloc_objects += heap_profile.buckets[i].alloc_objects;
+        alloc_bytes += heap_profile.buckets[i].alloc_bytes;
     }
 
-    /* f */
-    if (next_free && block->next == global_ptr.tail) {
-        if (prev_free) {
-            size_t merged_size = prev_size + next_size + block->block_size + 2 * sizeof(MallocMetadata);
-            size_t diff = size - merged_size;
+    char line[64 + HEAP_PROFILE_MAX_DEPTH * 20];
+    int len = snprintf(line, sizeof(line), "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n",
+                       in_use_objects, in_use_bytes, alloc_objects, alloc_bytes,
+                       heap_profile.period == 0 ? (size_t)HEAP_PROFILE_DEFAULT_PERIOD : heap_profile.period);
+    if (!writeAll(fd, line, len)) {
+        return -1;
+    }
 
-            void *prev_prog_break = sbrk((intptr_t) (diff));
-            if (prev_prog_break == (void *) (-1)) {
-                throw OutOfMemory();
-            }
+    for (size_t i = 0; heap_profile.buckets != NULL && i < HEAP_PROFILE_BUCKETS; i++) {
+        StackBucket* bucket = &heap_profile.buckets[i];
+        if (bucket->alloc_objects == 0) {
+            continue;
+        }
 
-            mergeWithUpper(block, OCCUPIED);
-            mergeWithLower(block, OCCUPIED);
-            block = block->prev;
+        len = snprintf(line, sizeof(line), "%6zu: %8zu [%6zu: %8zu] @", bucket->in_use_objects, bucket->in_use_bytes,
+                       bucket->alloc_objects, bucket->alloc_bytes);
+        for (int frame = 0; frame < bucket->depth; frame++) {
+            len += snprintf(line + len, sizeof(line) - len, " %p", bucket->frames[frame]);
+        }
+        line[len++] = '\n';
+        if (!writeAll(fd, line, len)) {
+            return -1;
+        }
+    }
 
-            updateMetaData(block, OCCUPIED, block->block_size + diff);
-            updateStats(-2, -(prev_size + next_size), -2,
-                        2 * sizeof(MallocMetadata) + diff);
-            return block;
-        } else {
-            size_t merged_size = next_size + block->block_size + sizeof(MallocMetadata);
-            size_t diff = size - merged_size;
+    const char* maps_header = "\nMAPPED_LIBRARIES:\n";
+    if (!writeAll(fd, maps_header, strlen(maps_header))) {
+        return -1;
+    }
 
-            void *prev_prog_break = sbrk((intptr_t) (diff));
-            if (prev_prog_break == (void *) (-1)) {
-                throw OutOfMemory();
-            }
+    int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps == -1) {
+        return -1;
+    }
 
-            mergeWithUpper(block, OCCUPIED);
-            updateMetaData(block, OCCUPIED, block->block_size + diff);
-            updateStats(-1, -(next_size), -1,sizeof(MallocMetadata) + diff);
-            return block;
+    ssize_t got;
+    while ((got = read(maps, line, sizeof(line))) > 0) {
+        if (!writeAll(fd, line, (size_t)got)) {
+            break;
         }
     }
+    close(maps);
+    return got == 0 ? 0 : -1;
+}
 
-    return NULL;
+void requestProfileDump(int)
+{
+    /*dumping right here could catch the heap half updated, so only force the
+     *next allocation onto the slow path and dump from there*/
+    heap_profile.dump_pending = 1;
+    heap_profile.bytes_until_sample = 0;
+}
+
+int _heap_profile_dump_on_signal(int signum, const char* path_prefix) {
+    if (path_prefix == NULL || strlen(path_prefix) >= HEAP_PROFILE_PATH_MAX) {
+        return -1;
+    }
+    strcpy(heap_profile.dump_path, path_prefix);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestProfileDump;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    return sigaction(signum, &action, NULL);
 }
 
-void prependToMmapList(MallocMetadata* block)
+#ifdef MALLOC_LATENCY_HIST
+
+/*------------------latency histogram queries--------------*/
+
+static const char* latency_op_names[LATENCY_OPS] = { "smalloc", "scalloc", "sfree", "srealloc", "smemalign" };
+static const char* latency_path_names[LATENCY_PATHS] = {
+    "other", "bin_hit", "split", "wilderness", "sbrk", "mmap", "in_place", "free", "munmap"
+};
+
+/* path < 0 sums the histograms of every path */
+unsigned long latencyBucketCount(int op, int path, int bucket)
 {
-    /*just insert, no stats needed */
-    block->next = global_ptr.mmap_head;
-    block->prev = NULL;
-    if (global_ptr.mmap_head != NULL) {
-        global_ptr.mmap_head->prev = block;
+    if (path >= 0) {
+        return latency_hist.counts[op][path][bucket];
     }
 
-    global_ptr.mmap_head = block;
+    unsigned long count = 0;
+    for (int p = 0; p < LATENCY_PATHS; p++) {
+        count += latency_hist.counts[op][p][bucket];
+    }
+    return count;
 }
 
-void removeFromMmapList(MallocMetadata* meta)
-{
-    /*just take out, no stats needed */
-    MallocMetadata* prev = meta->prev, *next = meta->next;
-    if (prev != NULL) {
-        prev->next = next;
-    } else {
-        global_ptr.mmap_head = next;
+size_t _latency_count(int op, int path) {
+    if (op < 0 || op >= LATENCY_OPS || path >= LATENCY_PATHS) {
+        return 0;
     }
 
-    if (next != NULL) {
-        next->prev = prev;
+    size_t count = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        count += latencyBucketCount(op, path, bucket);
     }
+    return count;
 }
 
-/*----------------------------------------------------*/
+unsigned long long _latency_max(int op, int path) {
+    if (op < 0 || op >= LATENCY_OPS || path >= LATENCY_PATHS) {
+        return 0;
+    }
 
-void* smalloc(size_t size) {
+    if (path >= 0) {
+        return latency_hist.max[op][path];
+    }
 
-    size_t aligned_size = (size%8 == 0 ? size : size+(8-size%8) ); 
+    unsigned long long max = 0;
+    for (int p = 0; p < LATENCY_PATHS; p++) {
+        max = latency_hist.max[op][p] > max ? latency_hist.max[op][p] : max;
+    }
+    return max;
+}
 
-    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
-        return NULL;
+unsigned long long _latency_percentile(int op, int path, double percentile) {
+    size_t count = _latency_count(op, path);
+    if (count == 0) {
+        return 0;
     }
 
-    if (do_setup) {
-        if (-1 == alignInitialProgBreak()) {
-            return NULL;
+    /*rank of the sample we are looking for, 1 based*/
+    size_t rank = (size_t)(percentile / 100.0 * (double)count + 0.5);
+    rank = rank == 0 ? 1 : (rank > count ? count : rank);
+
+    /*report the upper bound of the bucket, but never more than was actually seen*/
+    unsigned long long max = _latency_max(op, path);
+    size_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += latencyBucketCount(op, path, bucket);
+        if (seen >= rank) {
+            unsigned long long bound = latencyBucketUpperBound(bucket);
+            return bound < max ? bound : max;
         }
-        do_setup = false;
     }
+    return max;
+}
 
-    MallocMetadata* place = findBestFit(aligned_size);
+void _latency_reset() {
+    memset(latency_hist.counts, 0, sizeof(latency_hist.counts));
+    memset(latency_hist.max, 0, sizeof(latency_hist.max));
+}
 
-    /*------------------no place in the list-------------------------*/
-    if (place == NULL){ 
-        if(aligned_size >= MMAP_THRESHOLD)
-        {
-            MallocMetadata* new_region = (MallocMetadata*)mmap(NULL, aligned_size + sizeof(MallocMetadata), 
-                                                                PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-            if((void*)new_region == (void*)(-1))
-            {
-                return NULL;
+void _latency_report(int fd) {
+    /*plain write(2), the report must not allocate*/
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%-10s %-10s %10s %10s %10s %10s %10s %10s %10s\n",
+                       "op", "path", "count", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    if (write(fd, line, len) != len) {
+        return;
+    }
+
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        for (int path = -1; path < LATENCY_PATHS; path++) {
+            size_t count = _latency_count(op, path);
+            if (count == 0) {
+                continue;
             }
-            updateMetaData(new_region, OCCUPIED, aligned_size, true);
-            updateStats(0,0,1,aligned_size);
-            prependToMmapList(new_region);
 
-            return META_TO_DATA_PTR(new_region);
+            len = snprintf(line, sizeof(line), "%-10s %-10s %10zu %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                           latency_op_names[op], path < 0 ? "all" : latency_path_names[path], count,
+                           _latency_percentile(op, path, 50), _latency_percentile(op, path, 90),
+                           _latency_percentile(op, path, 99), _latency_percentile(op, path, 99.9),
+                           _latency_percentile(op, path, 99.99), _latency_max(op, path));
+            if (write(fd, line, len) != len) {
+                return;
+            }
         }
+    }
+}
 
-        if(global_ptr.tail != NULL && global_ptr.tail->status == FREE)
-        { //wilderness block is free but not big enough, so will enlarge it
-            long diff = (long)(aligned_size - global_ptr.tail->block_size);
-            MallocMetadata* curr = (MallocMetadata*)sbrk((intptr_t)(diff));
-            if ((void*)curr == (void*)(-1)) {
-                return NULL;
-            }
+__attribute__((destructor)) static void reportLatencyAtExit()
+{
+    bool any = false;
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        any = any || _latency_count(op, -1) != 0;
+    }
 
-            updateStats(-1, -(long)(global_ptr.tail->block_size), 0, diff);
-            updateMetaData(global_ptr.tail, OCCUPIED, global_ptr.tail->block_size + diff); //will change status to the given one and update free stats
-            removeFromSizeFreeList(global_ptr.tail);
+    if (any) {
+        _latency_report(STDERR_FILENO);
+    }
+}
 
-            return META_TO_DATA_PTR(global_ptr.tail);
-        }
+#endif /* MALLOC_LATENCY_HIST */
 
-        MallocMetadata* new_block = (MallocMetadata*)sbrk((intptr_t)(aligned_size + sizeof(MallocMetadata)));
-        if ((void*)new_block == (void*)(-1)) {
-            return NULL;
-        }
+/*------------------regions--------------*/
 
-        updateMetaData(new_block, OCCUPIED, aligned_size);
-        updateStats(0,0,1,aligned_size);
-        appendToMemoryList(new_block);
+struct RegionChunk {
+    RegionChunk* next;
+    size_t capacity; /*usable bytes following this header*/
+};
 
-        return META_TO_DATA_PTR(new_block);
-    }
-    /*-------------------------------------------------------------------------------------*/
+struct Region {
+    RegionChunk* chunks; /*the head is the chunk we bump into, it is kept across resets*/
+    char* bump;
+    char* limit;
+    size_t chunk_size;
+    size_t used_bytes;
+};
 
+#define CHUNK_TO_DATA_PTR(chunk_ptr) ((char*)((RegionChunk*)chunk_ptr+1))
 
-    /*---------------------found place---------------------------*/
-    size_t diff = place->block_size - aligned_size;
-    if(diff >= SPLIT_THRESHOLD + sizeof(MallocMetadata))
-    {
-        splitBlock(place, aligned_size);
-        return META_TO_DATA_PTR(place);
-    }
-    else{
-        updateMetaData(place, OCCUPIED, place->block_size);
-        updateStats(-1, -(long)(place->block_size), 0, 0);
-        removeFromSizeFreeList(place);
-        return META_TO_DATA_PTR(place);
+RegionChunk* allocRegionChunk(size_t capacity)
+{
+    /*chunks are ordinary smalloc'd blocks, so they show up in the block stats too*/
+    RegionChunk* chunk = (RegionChunk*)smalloc(sizeof(RegionChunk) + capacity);
+    if (chunk == NULL) {
+        return NULL;
     }
-}
 
-void* scalloc(size_t num, size_t size) {
-    void* ret_ptr = smalloc(num*size);
-    if (ret_ptr != NULL) {
-        memset(ret_ptr, 0,(DATA_TO_META_PTR(ret_ptr))->block_size);
-    }
+    chunk->capacity = capacity;
+    region_counters.region_chunks += 1;
+    return chunk;
+}
 
-    return ret_ptr;
+void freeRegionChunk(RegionChunk* chunk)
+{
+    region_counters.region_chunks -= 1;
+    sfree(chunk);
 }
 
-void sfree(void* p) {
-    if (p == NULL) {
-        return;
+Region* sregion_create(size_t chunk_size) {
+    if (chunk_size == 0) {
+        chunk_size = REGION_DEFAULT_CHUNK_SIZE;
     }
-    MallocMetadata* metadata_ptr = DATA_TO_META_PTR(p);
 
-    if (metadata_ptr->status == OCCUPIED) {
-        if(metadata_ptr->is_mmapped == true)
-        {
-//            updateMetaData(metadata_ptr, FREE, metadata_ptr->block_size, true);
-            updateStats(0,0,-1,-(long)(metadata_ptr->block_size));
-            removeFromMmapList(metadata_ptr);
-            int res = munmap(metadata_ptr, metadata_ptr->block_size + sizeof(MallocMetadata));
-            /*as long as metadata_ptr was mmapped it should not fail*/
-            assert(res != -1);
-        }
-        else{
-            freeAndMergeAdjacent(metadata_ptr); 
-        }
+    Region* region = (Region*)smalloc(sizeof(Region));
+    if (region == NULL) {
+        return NULL;
     }
-}
 
-void* srealloc(void* oldp, size_t size) {
+    region->chunks = NULL;
+    region->bump = NULL;
+    region->limit = NULL;
+    region->chunk_size = Config::alignSize(chunk_size);
+    region->used_bytes = 0;
+    return region;
+}
 
-    size_t aligned_size = (size%8 == 0 ? size : size+(8-size%8) );
-    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
+void* sregion_alloc(Region* region, size_t size) {
+    size_t aligned_size = Config::alignSize(size);
+    if (region == NULL || aligned_size == 0 || aligned_size > (size_t)1e8) {
         return NULL;
     }
 
-    if (oldp == NULL) {
-        return smalloc(aligned_size);
+    /*fast path: bump inside the current chunk*/
+    if ((size_t)(region->limit - region->bump) >= aligned_size) {
+        void* ret_ptr = region->bump;
+        region->bump += aligned_size;
+        region->used_bytes += aligned_size;
+        region_counters.region_bytes += aligned_size;
+        return ret_ptr;
     }
 
-    MallocMetadata* old_meta_ptr = DATA_TO_META_PTR(oldp);
-    if (old_meta_ptr->block_size == aligned_size) {
-        return oldp;
-    } 
-    if (old_meta_ptr->is_mmapped == IS_MMAP)
-    {
-        MallocMetadata* new_region = (MallocMetadata*)mmap(NULL, aligned_size + sizeof(MallocMetadata), 
-                                                                PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-        if( (void*)new_region == (void*)(-1))
-        {
+    if (aligned_size > region->chunk_size / 4 && region->chunks != NULL) {
+        /*too big to be worth abandoning the rest of the current chunk,
+         *so it gets a dedicated chunk linked behind the current one*/
+        RegionChunk* chunk = allocRegionChunk(aligned_size);
+        if (chunk == NULL) {
             return NULL;
         }
+        chunk->next = region->chunks->next;
+        region->chunks->next = chunk;
+        region->used_bytes += aligned_size;
+        region_counters.region_bytes += aligned_size;
+        return CHUNK_TO_DATA_PTR(chunk);
+    }
 
-        size_t min_copy_size = old_meta_ptr->block_size <= aligned_size ? old_meta_ptr->block_size : aligned_size;
-        void* move_ret = memmove(META_TO_DATA_PTR(new_region), oldp, min_copy_size);
-        if( move_ret != META_TO_DATA_PTR(new_region))
-        {
-            return NULL;
-        }
-        updateMetaData(new_region, OCCUPIED, aligned_size, true);
-        updateStats(0, 0, 1, aligned_size);
-        prependToMmapList(new_region);
-        
-        sfree(oldp);
-        return META_TO_DATA_PTR(new_region);
+    size_t capacity = aligned_size > region->chunk_size ? aligned_size : region->chunk_size;
+    RegionChunk* chunk = allocRegionChunk(capacity);
+    if (chunk == NULL) {
+        return NULL;
     }
-    else {
-        MallocMetadata* newp_meta;
-        void* address;
-        bool used_malloc = false;
-        try{
-            newp_meta = tryToReuseOrMerge(old_meta_ptr,aligned_size);
-        }
-        catch(OutOfMemory& err){
-            return NULL;
-        }
-        if ( newp_meta == NULL)
-        { /*could not reuse any existing blocks*/
-            address = smalloc(aligned_size);
-            if(address == NULL)
-            {
-                return NULL;
-            }
-            used_malloc = true;
-        }else {
-            address = META_TO_DATA_PTR(newp_meta);
-        }
 
-        size_t min_copy_size = old_meta_ptr->block_size <= aligned_size ? old_meta_ptr->block_size : aligned_size;
-        void* move_ret = memmove(address, oldp, min_copy_size);
-        if (move_ret != address) {
-            /* TODO: Should we somehow undo the allocation of newp? */
-            return NULL;
-        }
+    chunk->next = region->chunks;
+    region->chunks = chunk;
+    region->bump = CHUNK_TO_DATA_PTR(chunk) + aligned_size;
+    region->limit = CHUNK_TO_DATA_PTR(chunk) + capacity;
+    region->used_bytes += aligned_size;
+    region_counters.region_bytes += aligned_size;
+    return CHUNK_TO_DATA_PTR(chunk);
+}
 
-        if(used_malloc == true)
-        {
-            sfree(oldp);
-        } else {
-            if (newp_meta->block_size >= aligned_size + SPLIT_THRESHOLD + sizeof(MallocMetadata)) {
-                splitBlock(newp_meta, aligned_size);
-            }
-        }
-        return address;
+void sregion_reset(Region* region) {
+    if (region == NULL || region->chunks == NULL) {
+        return;
     }
-}
 
-size_t _num_free_blocks() {
-    return global_ptr.free_blocks;
-}
+    /*keep the chunk we bump into so the next request does not have to smalloc again*/
+    RegionChunk* curr = region->chunks->next;
+    while (curr != NULL) {
+        RegionChunk* next = curr->next;
+        freeRegionChunk(curr);
+        curr = next;
+    }
 
-size_t _num_free_bytes() {
-    return global_ptr.free_bytes;
+    curr = region->chunks;
+    curr->next = NULL;
+    region->bump = CHUNK_TO_DATA_PTR(curr);
+    region->limit = CHUNK_TO_DATA_PTR(curr) + curr->capacity;
+    region_counters.region_bytes -= region->used_bytes;
+    region->used_bytes = 0;
 }
 
-size_t _num_allocated_blocks() {
-    return global_ptr.allocated_blocks;
-}
+void sregion_destroy(Region* region) {
+    if (region == NULL) {
+        return;
+    }
 
-size_t _num_allocated_bytes() {
-    return global_ptr.allocated_bytes;
+    RegionChunk* curr = region->chunks;
+    while (curr != NULL) {
+        RegionChunk* next = curr->next;
+        freeRegionChunk(curr);
+        curr = next;
+    }
+
+    region_counters.region_bytes -= region->used_bytes;
+    sfree(region);
 }
 
-size_t _num_meta_data_bytes() {
-    return (global_ptr.allocated_blocks * sizeof(MallocMetadata));
+#ifdef MALLOC_ENGINE_VARIANTS
+
+/*------------------engine variants--------------*/
+
+/* More configurations next to heap_engine (build with -DMALLOC_ENGINE_VARIANTS),
+ * each in an arena of its own, so a benchmark can compare them in one process.
+ * They keep the build's thresholds and alignment */
+
+typedef EngineConfig<FIT_BEST, SizeOrderedList, MALLOC_SPLIT_THRESHOLD, MALLOC_MMAP_THRESHOLD, MALLOC_ALIGNMENT> BestFitConfig;
+typedef EngineConfig<FIT_BEST, PackedSizeIndex, MALLOC_SPLIT_THRESHOLD, MALLOC_MMAP_THRESHOLD, MALLOC_ALIGNMENT> PackedBestFitConfig;
+typedef EngineConfig<FIT_FIRST, AddressOrderedList, MALLOC_SPLIT_THRESHOLD, MALLOC_MMAP_THRESHOLD, MALLOC_ALIGNMENT> FirstFitConfig;
+typedef EngineConfig<FIT_NEXT, AddressOrderedList, MALLOC_SPLIT_THRESHOLD, MALLOC_MMAP_THRESHOLD, MALLOC_ALIGNMENT> NextFitConfig;
+
+Engine<BestFitConfig> best_fit_engine(MAPPED_ARENA);
+Engine<PackedBestFitConfig> packed_best_fit_engine(MAPPED_ARENA);
+Engine<FirstFitConfig> first_fit_engine(MAPPED_ARENA);
+Engine<NextFitConfig> next_fit_engine(MAPPED_ARENA);
+
+/* The EngineVariant functions of one engine */
+template <class EngineType, EngineType& engine>
+struct VariantCalls {
+    static void* allocate(size_t size) { return engine.allocate(size); }
+    static void deallocate(void* p) { engine.deallocate(p); }
+    static void* reallocate(void* oldp, size_t size) { return engine.reallocate(oldp, size); }
+    static size_t freeBlocks() { return engine.blockStats().free_blocks; }
+    static size_t freeBytes() { return engine.blockStats().free_bytes; }
+    static size_t allocatedBytes() { return engine.blockStats().allocated_bytes; }
+    static size_t largestFreeBlock() { return engine.largestFreeBlock(); }
+};
+
+#define ENGINE_VARIANT(name, engine)                                                                        \
+    { name, VariantCalls<decltype(engine), engine>::allocate, VariantCalls<decltype(engine), engine>::deallocate, \
+      VariantCalls<decltype(engine), engine>::reallocate, VariantCalls<decltype(engine), engine>::freeBlocks,   \
+      VariantCalls<decltype(engine), engine>::freeBytes, VariantCalls<decltype(engine), engine>::allocatedBytes, \
+      VariantCalls<decltype(engine), engine>::largestFreeBlock }
+
+static const EngineVariant engine_variants[] = {
+    { "malloc_3", smalloc, sfree, srealloc, _num_free_blocks, _num_free_bytes, _num_allocated_bytes, _largest_free_block },
+    ENGINE_VARIANT("best_fit", best_fit_engine),
+    ENGINE_VARIANT("packed_best_fit", packed_best_fit_engine),
+    ENGINE_VARIANT("first_fit", first_fit_engine),
+    ENGINE_VARIANT("next_fit", next_fit_engine),
+};
+
+size_t _engine_variants(const EngineVariant** variants) {
+    *variants = engine_variants;
+    return sizeof(engine_variants) / sizeof(engine_variants[0]);
 }
-size_t _size_meta_data() {
-    return sizeof(MallocMetadata);
-}
\ No newline at end of file
+
+#endif /* MALLOC_ENGINE_VARIANTS */
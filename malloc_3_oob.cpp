@@ -0,0 +1,746 @@
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <cassert>
+
+/*
+ * malloc_3 with its block metadata kept out of band.
+ *
+ * The heap holds nothing but user data. Every block is described by a BlockInfo
+ * in a dense descriptor table, linked by index in the same address ordered and
+ * size ordered lists malloc_3 keeps in its headers, so walking the free list
+ * only reads the table and never a user page. A hash table from data pointer
+ * to descriptor finds the block for sfree/srealloc; pointers it does not know
+ * are ignored instead of being trusted, and writing past the end of a block
+ * can no longer clobber the allocator's lists.
+ *
+ * Placement (best fit ordered by size then address, split, coalesce, wilderness
+ * growth, mmap for large blocks, srealloc cases a-f) follows malloc_3, so the two
+ * layouts can be compared directly. As blocks have no header, a split off part
+ * only has to be SPLIT_THRESHOLD bytes and merging gains no header bytes.
+ */
+
+#define SPLIT_THRESHOLD (128)
+#define MMAP_THRESHOLD (0x20000)
+#define NO_BLOCK (0xffffffffu)
+#define MAX_BLOCKS (1u << 26) /*reserved, only the used part of the table is ever touched*/
+#define INITIAL_SLOTS (1024)
+
+
+typedef enum { FREE , OCCUPIED} block_status;
+
+
+struct BlockInfo {
+    char* data;
+    size_t block_size;
+    uint32_t next; /*address order, or the mmapped list*/
+    uint32_t prev;
+    uint32_t free_by_size_next;
+    uint32_t free_by_size_prev;
+    block_status status;
+    bool is_mmapped;
+};
+
+struct GlobalMetadata {
+    BlockInfo* blocks; /*the descriptor table*/
+    uint32_t used_descriptors; /*descriptors handed out so far, recycled ones included*/
+    uint32_t unused_head; /*recycled descriptors, chained through next*/
+    uint32_t* slots; /*data pointer -> descriptor, open addressing with linear probing*/
+    size_t slot_count; /*a power of two*/
+    size_t slot_used;
+    uint32_t head; /*head of the memory sorted list*/
+    uint32_t tail; /*the last node of memory list - wilderness*/
+    uint32_t free_by_size_head;
+    uint32_t free_by_size_tail;
+    uint32_t mmap_head;
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t allocated_blocks;
+    size_t allocated_bytes;
+};
+
+GlobalMetadata global_ptr = { NULL, 0, NO_BLOCK, NULL, 0, 0, NO_BLOCK, NO_BLOCK, NO_BLOCK, NO_BLOCK, NO_BLOCK, 0, 0, 0, 0 };
+bool do_setup = true;
+
+int alignInitialProgBreak() {
+    unsigned long init_sbrk_ptr = (unsigned long)sbrk(0);
+    size_t aligned_size = (init_sbrk_ptr%8 == 0 ? 0 : (8-init_sbrk_ptr%8) );
+
+    void* sbrk_ptr = sbrk(aligned_size);
+    if (sbrk_ptr == (void*)(-1)) {
+        return -1;
+    }
+
+    return 1;
+}
+
+uint32_t* allocSlots(size_t count)
+{
+    uint32_t* slots = (uint32_t*)mmap(NULL, count * sizeof(uint32_t), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if ((void*)slots == (void*)(-1)) {
+        return NULL;
+    }
+
+    memset(slots, 0xff, count * sizeof(uint32_t));
+    return slots;
+}
+
+int setupTables() {
+    void* blocks = mmap(NULL, (size_t)MAX_BLOCKS * sizeof(BlockInfo), PROT_READ|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (blocks == (void*)(-1)) {
+        return -1;
+    }
+
+    global_ptr.slots = allocSlots(INITIAL_SLOTS);
+    if (global_ptr.slots == NULL) {
+        munmap(blocks, (size_t)MAX_BLOCKS * sizeof(BlockInfo));
+        return -1;
+    }
+
+    global_ptr.blocks = (BlockInfo*)blocks;
+    global_ptr.slot_count = INITIAL_SLOTS;
+    return alignInitialProgBreak();
+}
+
+/*------------------descriptor table--------------*/
+
+inline BlockInfo* info(uint32_t block)
+{
+    return &global_ptr.blocks[block];
+}
+
+uint32_t newDescriptor()
+{
+    if (global_ptr.unused_head != NO_BLOCK) {
+        uint32_t block = global_ptr.unused_head;
+        global_ptr.unused_head = info(block)->next;
+        return block;
+    }
+
+    if (global_ptr.used_descriptors == MAX_BLOCKS) {
+        return NO_BLOCK;
+    }
+
+    return global_ptr.used_descriptors++;
+}
+
+void releaseDescriptor(uint32_t block)
+{
+    info(block)->next = global_ptr.unused_head;
+    global_ptr.unused_head = block;
+}
+
+/*------------------pointer index--------------*/
+
+size_t slotOf(const char* data)
+{
+    unsigned long hash = (unsigned long)data * 0x9e3779b97f4a7c15UL;
+    return (hash ^ (hash >> 29)) & (global_ptr.slot_count - 1);
+}
+
+void placeInIndex(uint32_t block)
+{
+    /*only call with room to spare, see ensureIndexCapacity*/
+    size_t slot = slotOf(info(block)->data);
+    while (global_ptr.slots[slot] != NO_BLOCK) {
+        slot = (slot + 1) & (global_ptr.slot_count - 1);
+    }
+
+    global_ptr.slots[slot] = block;
+    global_ptr.slot_used += 1;
+}
+
+bool ensureIndexCapacity()
+{
+    /*keep the load factor under 1/2 so probes stay short*/
+    if ((global_ptr.slot_used + 1) * 2 <= global_ptr.slot_count) {
+        return true;
+    }
+
+    uint32_t* old_slots = global_ptr.slots;
+    size_t old_count = global_ptr.slot_count;
+    uint32_t* new_slots = allocSlots(old_count * 2);
+    if (new_slots == NULL) {
+        return false;
+    }
+
+    global_ptr.slots = new_slots;
+    global_ptr.slot_count = old_count * 2;
+    global_ptr.slot_used = 0;
+    for (size_t slot = 0; slot < old_count; slot++) {
+        if (old_slots[slot] != NO_BLOCK) {
+            placeInIndex(old_slots[slot]);
+        }
+    }
+
+    munmap(old_slots, old_count * sizeof(uint32_t));
+    return true;
+}
+
+uint32_t findInIndex(const void* data)
+{
+    size_t slot = slotOf((const char*)data);
+    while (global_ptr.slots[slot] != NO_BLOCK) {
+        if (info(global_ptr.slots[slot])->data == data) {
+            return global_ptr.slots[slot];
+        }
+        slot = (slot + 1) & (global_ptr.slot_count - 1);
+    }
+
+    return NO_BLOCK;
+}
+
+void removeFromIndex(uint32_t block)
+{
+    size_t mask = global_ptr.slot_count - 1;
+    size_t hole = slotOf(info(block)->data);
+    while (global_ptr.slots[hole] != block) {
+        hole = (hole + 1) & mask;
+    }
+
+    /*backward shift deletion, so no probe sequence is cut short*/
+    for (size_t next = (hole + 1) & mask; global_ptr.slots[next] != NO_BLOCK; next = (next + 1) & mask) {
+        size_t home = slotOf(info(global_ptr.slots[next])->data);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            global_ptr.slots[hole] = global_ptr.slots[next];
+            hole = next;
+        }
+    }
+
+    global_ptr.slots[hole] = NO_BLOCK;
+    global_ptr.slot_used -= 1;
+}
+
+/*------------------helper functions--------------*/
+
+void updateStats(long free_blocks, long free_bytes, long allocated_blocks, long allocated_bytes) {
+    global_ptr.free_blocks += free_blocks;
+    global_ptr.free_bytes += free_bytes;
+    global_ptr.allocated_blocks += allocated_blocks;
+    global_ptr.allocated_bytes += allocated_bytes;
+}
+
+void removeFromSizeFreeList(uint32_t block)
+{
+    /*just take out, no stats needed */
+    uint32_t prev = info(block)->free_by_size_prev, next = info(block)->free_by_size_next;
+    if (prev != NO_BLOCK) {
+        info(prev)->free_by_size_next = next;
+    } else {
+        global_ptr.free_by_size_head = next;
+    }
+
+    if (next != NO_BLOCK) {
+        info(next)->free_by_size_prev = prev;
+    } else {
+        global_ptr.free_by_size_tail = prev;
+    }
+}
+
+/* Return true if a < b */
+bool isLowerInFreeList(uint32_t a, uint32_t b) {
+    return ((info(a)->block_size < info(b)->block_size) ||
+            ((info(a)->block_size == info(b)->block_size) && (info(a)->data < info(b)->data)));
+}
+
+void insertToSizeFreeList(uint32_t block)
+{
+    /*just insert, no stats needed */
+    uint32_t curr = global_ptr.free_by_size_head;
+    while (curr != NO_BLOCK && isLowerInFreeList(curr, block)) {
+        curr = info(curr)->free_by_size_next;
+    }
+
+    /*block goes right before curr, or at the tail if curr is NO_BLOCK*/
+    uint32_t prev = curr != NO_BLOCK ? info(curr)->free_by_size_prev : global_ptr.free_by_size_tail;
+    info(block)->free_by_size_prev = prev;
+    info(block)->free_by_size_next = curr;
+    if (prev != NO_BLOCK) {
+        info(prev)->free_by_size_next = block;
+    } else {
+        global_ptr.free_by_size_head = block;
+    }
+
+    if (curr != NO_BLOCK) {
+        info(curr)->free_by_size_prev = block;
+    } else {
+        global_ptr.free_by_size_tail = block;
+    }
+}
+
+uint32_t findBestFit(size_t size)
+{
+    /*finds smallest large enough block, touching only the descriptor table*/
+    if (global_ptr.free_by_size_tail == NO_BLOCK || info(global_ptr.free_by_size_tail)->block_size < size) {
+        return NO_BLOCK;
+    }
+
+    uint32_t curr = global_ptr.free_by_size_head;
+    while (curr != NO_BLOCK && size > info(curr)->block_size) {
+        curr = info(curr)->free_by_size_next;
+    }
+
+    return curr;
+}
+
+void appendToMemoryList(uint32_t block)
+{
+    info(block)->prev = global_ptr.tail;
+    info(block)->next = NO_BLOCK;
+    if (global_ptr.tail != NO_BLOCK) {
+        info(global_ptr.tail)->next = block;
+    } else {
+        global_ptr.head = block;
+    }
+
+    global_ptr.tail = block;
+}
+
+/* The memory list is contiguous unless someone else moved the program break
+ * between two of our sbrk calls, so physical neighbours must be checked before merging */
+bool isAdjacent(uint32_t lower, uint32_t upper)
+{
+    return info(lower)->data + info(lower)->block_size == info(upper)->data;
+}
+
+bool isWilderness(uint32_t block)
+{
+    return block == global_ptr.tail && info(block)->data + info(block)->block_size == sbrk(0);
+}
+
+bool isFreeNeighbour(uint32_t neighbour)
+{
+    return neighbour != NO_BLOCK && info(neighbour)->status == FREE;
+}
+
+void mergeWithUpper(uint32_t block, block_status status) {
+    uint32_t upper = info(block)->next;
+    if (info(upper)->status == FREE) {
+        removeFromSizeFreeList(upper);
+    }
+
+    info(block)->next = info(upper)->next;
+    if (info(upper)->next != NO_BLOCK) {
+        info(info(upper)->next)->prev = block;
+    } else {
+        global_ptr.tail = block;
+    }
+
+    info(block)->block_size += info(upper)->block_size;
+    info(block)->status = status;
+    removeFromIndex(upper);
+    releaseDescriptor(upper);
+}
+
+/* Returns the lower block, which now holds both */
+uint32_t mergeWithLower(uint32_t block, block_status status) {
+    uint32_t lower = info(block)->prev;
+    if (info(lower)->status == FREE) {
+        removeFromSizeFreeList(lower);
+    }
+
+    info(lower)->next = info(block)->next;
+    if (info(block)->next != NO_BLOCK) {
+        info(info(block)->next)->prev = lower;
+    } else {
+        global_ptr.tail = lower;
+    }
+
+    info(lower)->block_size += info(block)->block_size;
+    info(lower)->status = status;
+    removeFromIndex(block);
+    releaseDescriptor(block);
+    return lower;
+}
+
+void freeAndMergeAdjacent(uint32_t block)
+{
+    /*mark as free, try to merge with neighbors and handle stats*/
+    info(block)->status = FREE;
+    updateStats(1, info(block)->block_size, 0, 0);
+
+    uint32_t next = info(block)->next, prev = info(block)->prev;
+    if (isFreeNeighbour(next) && isAdjacent(block, next)) {
+        mergeWithUpper(block, FREE);
+        updateStats(-1, 0, -1, 0);
+    }
+
+    if (isFreeNeighbour(prev) && isAdjacent(prev, block)) {
+        block = mergeWithLower(block, FREE);
+        updateStats(-1, 0, -1, 0);
+    }
+
+    insertToSizeFreeList(block);
+}
+
+void splitBlock(uint32_t block, size_t new_size)
+{
+    /*block must be occupied; the rest becomes a free block. Without a spare
+     *descriptor or index slot the block simply stays whole*/
+    if (!ensureIndexCapacity()) {
+        return;
+    }
+
+    uint32_t other = newDescriptor();
+    if (other == NO_BLOCK) {
+        return;
+    }
+
+    info(other)->data = info(block)->data + new_size;
+    info(other)->block_size = info(block)->block_size - new_size;
+    info(other)->status = OCCUPIED;
+    info(other)->is_mmapped = false;
+    placeInIndex(other);
+
+    info(other)->prev = block;
+    info(other)->next = info(block)->next;
+    if (info(block)->next == NO_BLOCK) {
+        global_ptr.tail = other;
+    } else {
+        info(info(block)->next)->prev = other;
+    }
+    info(block)->next = other;
+    info(block)->block_size = new_size;
+
+    updateStats(0, 0, 1, 0);
+    freeAndMergeAdjacent(other);
+}
+
+bool growWilderness(size_t diff)
+{
+    return sbrk((intptr_t)diff) != (void*)(-1);
+}
+
+uint32_t tryToReuseOrMerge(uint32_t block, size_t size)
+{/*malloc_3's cases a-f, NO_BLOCK if none applies*/
+    uint32_t prev = info(block)->prev, next = info(block)->next;
+    size_t block_size = info(block)->block_size;
+    size_t prev_size = prev != NO_BLOCK ? info(prev)->block_size : 0;
+    size_t next_size = next != NO_BLOCK ? info(next)->block_size : 0;
+    bool prev_free = isFreeNeighbour(prev) && isAdjacent(prev, block);
+    bool next_free = isFreeNeighbour(next) && isAdjacent(block, next);
+
+    /* a */
+    if (block_size >= size) {
+        return block;
+    }
+
+    /* b */
+    if (prev_free) {
+        if (prev_size + block_size >= size) {
+            updateStats(-1, -(long)prev_size, -1, 0);
+            return mergeWithLower(block, OCCUPIED);
+        } else if (isWilderness(block) && growWilderness(size - prev_size - block_size)) {
+            size_t diff = size - prev_size - block_size;
+            block = mergeWithLower(block, OCCUPIED);
+            info(block)->block_size += diff;
+            updateStats(-1, -(long)prev_size, -1, diff);
+            return block;
+        }
+    }
+
+    /* c */
+    if (isWilderness(block)) {
+        if (!growWilderness(size - block_size)) {
+            return NO_BLOCK;
+        }
+        info(block)->block_size = size;
+        updateStats(0, 0, 0, size - block_size);
+        return block;
+    }
+
+    /* d */
+    if (next_free && size <= block_size + next_size) {
+        mergeWithUpper(block, OCCUPIED);
+        updateStats(-1, -(long)next_size, -1, 0);
+        return block;
+    }
+
+    /* e */
+    if (prev_free && next_free && prev_size + next_size + block_size >= size) {
+        mergeWithUpper(block, OCCUPIED);
+        updateStats(-2, -(long)(prev_size + next_size), -2, 0);
+        return mergeWithLower(block, OCCUPIED);
+    }
+
+    /* f */
+    if (next_free && isWilderness(next)) {
+        size_t merged_size = next_size + block_size + (prev_free ? prev_size : 0);
+        size_t diff = size - merged_size;
+        if (!growWilderness(diff)) {
+            return NO_BLOCK;
+        }
+
+        mergeWithUpper(block, OCCUPIED);
+        if (prev_free) {
+            block = mergeWithLower(block, OCCUPIED);
+            updateStats(-2, -(long)(prev_size + next_size), -2, diff);
+        } else {
+            updateStats(-1, -(long)next_size, -1, diff);
+        }
+        info(block)->block_size += diff;
+        return block;
+    }
+
+    return NO_BLOCK;
+}
+
+void prependToMmapList(uint32_t block)
+{
+    info(block)->next = global_ptr.mmap_head;
+    info(block)->prev = NO_BLOCK;
+    if (global_ptr.mmap_head != NO_BLOCK) {
+        info(global_ptr.mmap_head)->prev = block;
+    }
+
+    global_ptr.mmap_head = block;
+}
+
+void removeFromMmapList(uint32_t block)
+{
+    uint32_t prev = info(block)->prev, next = info(block)->next;
+    if (prev != NO_BLOCK) {
+        info(prev)->next = next;
+    } else {
+        global_ptr.mmap_head = next;
+    }
+
+    if (next != NO_BLOCK) {
+        info(next)->prev = prev;
+    }
+}
+
+uint32_t mmapBlock(size_t aligned_size)
+{
+    uint32_t block = newDescriptor();
+    if (block == NO_BLOCK) {
+        return NO_BLOCK;
+    }
+
+    char* data = (char*)mmap(NULL, aligned_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if ((void*)data == (void*)(-1)) {
+        releaseDescriptor(block);
+        return NO_BLOCK;
+    }
+
+    info(block)->data = data;
+    info(block)->block_size = aligned_size;
+    info(block)->status = OCCUPIED;
+    info(block)->is_mmapped = true;
+    placeInIndex(block);
+    prependToMmapList(block);
+    updateStats(0, 0, 1, aligned_size);
+    return block;
+}
+
+/*----------------------------------------------------*/
+
+void* smalloc(size_t size) {
+
+    size_t aligned_size = (size%8 == 0 ? size : size+(8-size%8) );
+
+    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
+        return NULL;
+    }
+
+    if (do_setup) {
+        if (-1 == setupTables()) {
+            return NULL;
+        }
+        do_setup = false;
+    }
+
+    /*every path below may add a block to the index*/
+    if (!ensureIndexCapacity()) {
+        return NULL;
+    }
+
+    uint32_t place = findBestFit(aligned_size);
+
+    /*------------------no place in the list-------------------------*/
+    if (place == NO_BLOCK) {
+        if (aligned_size >= MMAP_THRESHOLD) {
+            uint32_t block = mmapBlock(aligned_size);
+            return block != NO_BLOCK ? info(block)->data : NULL;
+        }
+
+        uint32_t tail = global_ptr.tail;
+        if (tail != NO_BLOCK && info(tail)->status == FREE && isWilderness(tail)) {
+            /*wilderness block is free but not big enough, so will enlarge it*/
+            size_t diff = aligned_size - info(tail)->block_size;
+            if (!growWilderness(diff)) {
+                return NULL;
+            }
+
+            updateStats(-1, -(long)info(tail)->block_size, 0, diff);
+            removeFromSizeFreeList(tail);
+            info(tail)->block_size = aligned_size;
+            info(tail)->status = OCCUPIED;
+            return info(tail)->data;
+        }
+
+        if (tail != NO_BLOCK && !isWilderness(tail) && -1 == alignInitialProgBreak()) {
+            /*the break was moved by someone else and may be unaligned now*/
+            return NULL;
+        }
+
+        uint32_t block = newDescriptor();
+        if (block == NO_BLOCK) {
+            return NULL;
+        }
+
+        char* data = (char*)sbrk((intptr_t)aligned_size);
+        if ((void*)data == (void*)(-1)) {
+            releaseDescriptor(block);
+            return NULL;
+        }
+
+        info(block)->data = data;
+        info(block)->block_size = aligned_size;
+        info(block)->status = OCCUPIED;
+        info(block)->is_mmapped = false;
+        placeInIndex(block);
+        appendToMemoryList(block);
+        updateStats(0, 0, 1, aligned_size);
+        return data;
+    }
+    /*-------------------------------------------------------------------------------------*/
+
+
+    /*---------------------found place---------------------------*/
+    removeFromSizeFreeList(place);
+    info(place)->status = OCCUPIED;
+    updateStats(-1, -(long)info(place)->block_size, 0, 0);
+    if (info(place)->block_size - aligned_size >= SPLIT_THRESHOLD) {
+        splitBlock(place, aligned_size);
+    }
+
+    return info(place)->data;
+}
+
+void* scalloc(size_t num, size_t size) {
+    void* ret_ptr = smalloc(num*size);
+    if (ret_ptr != NULL) {
+        memset(ret_ptr, 0, num*size);
+    }
+
+    return ret_ptr;
+}
+
+void sfree(void* p) {
+    if (p == NULL || do_setup) {
+        return;
+    }
+
+    /*anything that is not the start of one of our blocks is ignored*/
+    uint32_t block = findInIndex(p);
+    if (block == NO_BLOCK || info(block)->status != OCCUPIED) {
+        return;
+    }
+
+    if (info(block)->is_mmapped) {
+        updateStats(0, 0, -1, -(long)info(block)->block_size);
+        removeFromMmapList(block);
+        removeFromIndex(block);
+        int res = munmap(info(block)->data, info(block)->block_size);
+        /*as long as the block was mmapped it should not fail*/
+        assert(res != -1);
+        (void)res;
+        releaseDescriptor(block);
+    } else {
+        freeAndMergeAdjacent(block);
+    }
+}
+
+void* srealloc(void* oldp, size_t size) {
+
+    size_t aligned_size = (size%8 == 0 ? size : size+(8-size%8) );
+    if (aligned_size == 0 || aligned_size > (size_t)1e8) {
+        return NULL;
+    }
+
+    if (oldp == NULL || do_setup) {
+        return smalloc(aligned_size);
+    }
+
+    uint32_t old_block = findInIndex(oldp);
+    if (old_block == NO_BLOCK || info(old_block)->status != OCCUPIED) {
+        return NULL;
+    }
+
+    size_t old_size = info(old_block)->block_size;
+    if (old_size == aligned_size) {
+        return oldp;
+    }
+
+    if (info(old_block)->is_mmapped || !ensureIndexCapacity()) {
+        void* newp = smalloc(aligned_size);
+        if (newp == NULL) {
+            return NULL;
+        }
+
+        memmove(newp, oldp, old_size <= aligned_size ? old_size : aligned_size);
+        sfree(oldp);
+        return newp;
+    }
+
+    uint32_t new_block = tryToReuseOrMerge(old_block, aligned_size);
+    if (new_block == NO_BLOCK) {
+        /*could not reuse any existing blocks*/
+        void* newp = smalloc(aligned_size);
+        if (newp == NULL) {
+            return NULL;
+        }
+
+        memmove(newp, oldp, old_size <= aligned_size ? old_size : aligned_size);
+        sfree(oldp);
+        return newp;
+    }
+
+    /*merging with the lower block moves the data down*/
+    memmove(info(new_block)->data, oldp, old_size <= aligned_size ? old_size : aligned_size);
+    if (info(new_block)->block_size >= aligned_size + SPLIT_THRESHOLD) {
+        splitBlock(new_block, aligned_size);
+    }
+
+    return info(new_block)->data;
+}
+
+size_t _num_free_blocks() {
+    return global_ptr.free_blocks;
+}
+
+size_t _num_free_bytes() {
+    return global_ptr.free_bytes;
+}
+
+size_t _num_allocated_blocks() {
+    return global_ptr.allocated_blocks;
+}
+
+size_t _num_allocated_bytes() {
+    return global_ptr.allocated_bytes;
+}
+
+size_t _num_meta_data_bytes() {
+    /*the descriptors only, the pointer index adds a few bytes per block on top*/
+    return (global_ptr.allocated_blocks * sizeof(BlockInfo));
+}
+
+size_t _size_meta_data() {
+    return sizeof(BlockInfo);
+}
+
+size_t _largest_free_block() {
+    return global_ptr.free_by_size_tail != NO_BLOCK ? info(global_ptr.free_by_size_tail)->block_size : 0;
+}
+
+double _external_fragmentation() {
+    if (global_ptr.free_bytes == 0) {
+        return 0;
+    }
+
+    return 1.0 - (double)_largest_free_block() / (double)global_ptr.free_bytes;
+}
@@ -0,0 +1,30 @@
+#ifndef MALLOC_STATS_H
+#define MALLOC_STATS_H
+
+#include <stddef.h>
+
+/* Snapshot of the block stats and the kernel work behind them, filled by malloc_3's
+ * _malloc_stats. madvise_calls stays 0 until something gives memory back with madvise */
+struct MallocStats {
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t allocated_blocks;
+    size_t allocated_bytes;
+    size_t meta_data_bytes;
+    size_t sbrk_calls;
+    size_t sbrk_bytes_grown;
+    size_t sbrk_bytes_shrunk;
+    size_t mmap_calls;
+    size_t mmap_bytes;
+    size_t munmap_calls;
+    size_t munmap_bytes;
+    size_t madvise_calls;
+    long minor_faults; /* whole process, since it started */
+    long major_faults;
+    long minor_faults_delta; /* since the previous _malloc_stats call */
+    long major_faults_delta;
+};
+
+void _malloc_stats(MallocStats *stats);
+
+#endif /* MALLOC_STATS_H */
@@ -0,0 +1,214 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "my_stdlib.h"
+
+/*
+ * Fixed size object pool on top of malloc_3.
+ *
+ * Chunks of ChunkSize bytes come from smemalign(ChunkSize, ChunkSize), so the
+ * chunk owning an object is found by masking its address and objects need no
+ * header of their own. Each chunk keeps an intrusive LIFO of its free objects;
+ * chunks with free objects are linked on the pool's partial list. A chunk that
+ * becomes completely empty is given back with sfree, except for the last one.
+ *
+ * Like the rest of the allocator this is not thread safe.
+ */
+
+template <class T, size_t ChunkSize = 0x4000>
+class ObjectPool {
+    static_assert(ChunkSize != 0 && (ChunkSize & (ChunkSize - 1)) == 0, "ChunkSize must be a power of two");
+
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    struct Chunk {
+        FreeObject* free_list; /*objects given back to this chunk*/
+        char* carve; /*objects past this point were never handed out*/
+        size_t live;
+        Chunk* next_partial;
+        Chunk* prev_partial;
+        Chunk* next_chunk;
+        Chunk* prev_chunk;
+        bool is_partial;
+    };
+
+    static constexpr size_t alignUp(size_t size, size_t align) {
+        return (size + align - 1) & ~(align - 1);
+    }
+
+    static constexpr size_t OBJECT_ALIGN = alignof(T) > alignof(FreeObject) ? alignof(T) : alignof(FreeObject);
+    static constexpr size_t OBJECT_SIZE = alignUp(sizeof(T) > sizeof(FreeObject) ? sizeof(T) : sizeof(FreeObject), OBJECT_ALIGN);
+    static constexpr size_t FIRST_OBJECT = alignUp(sizeof(Chunk), OBJECT_ALIGN);
+
+public:
+    static constexpr size_t OBJECTS_PER_CHUNK = (ChunkSize - FIRST_OBJECT) / OBJECT_SIZE;
+    static_assert(ChunkSize >= FIRST_OBJECT + OBJECT_SIZE, "ChunkSize too small for even one object");
+
+    ObjectPool() : partial(NULL), all_chunks(NULL), chunks(0), live(0) {}
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool() {
+        /*objects still alive at this point are not destroyed, only their memory is returned*/
+        while (all_chunks != NULL) {
+            releaseChunk(all_chunks);
+        }
+    }
+
+    /* Raw storage for one T, NULL if smemalign failed */
+    T* allocate() {
+        Chunk* chunk = partial;
+        if (chunk == NULL) {
+            chunk = newChunk();
+            if (chunk == NULL) {
+                return NULL;
+            }
+        }
+
+        void* obj;
+        if (chunk->free_list != NULL) {
+            obj = chunk->free_list;
+            chunk->free_list = chunk->free_list->next;
+        } else {
+            obj = chunk->carve;
+            chunk->carve += OBJECT_SIZE;
+        }
+
+        chunk->live += 1;
+        live += 1;
+        if (chunk->free_list == NULL && chunk->carve == chunkEnd(chunk)) {
+            unlinkPartial(chunk);
+        }
+
+        return static_cast<T*>(obj);
+    }
+
+    void deallocate(T* p) {
+        if (p == NULL) {
+            return;
+        }
+
+        Chunk* chunk = chunkOf(p);
+        FreeObject* obj = reinterpret_cast<FreeObject*>(p);
+        obj->next = chunk->free_list;
+        chunk->free_list = obj;
+        chunk->live -= 1;
+        live -= 1;
+
+        if (!chunk->is_partial) {
+            pushPartial(chunk);
+        }
+
+        if (chunk->live == 0 && chunks > 1) {
+            unlinkPartial(chunk);
+            releaseChunk(chunk);
+        }
+    }
+
+    template <class... Args>
+    T* create(Args&&... args) {
+        T* p = allocate();
+        if (p == NULL) {
+            return NULL;
+        }
+
+        return new (p) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* p) {
+        if (p == NULL) {
+            return;
+        }
+
+        p->~T();
+        deallocate(p);
+    }
+
+    size_t num_chunks() const { return chunks; }
+    size_t num_live_objects() const { return live; }
+
+private:
+    static Chunk* chunkOf(void* p) {
+        return reinterpret_cast<Chunk*>((unsigned long)p & ~((unsigned long)ChunkSize - 1));
+    }
+
+    static char* chunkEnd(Chunk* chunk) {
+        return reinterpret_cast<char*>(chunk) + FIRST_OBJECT + OBJECTS_PER_CHUNK * OBJECT_SIZE;
+    }
+
+    Chunk* newChunk() {
+        Chunk* chunk = static_cast<Chunk*>(smemalign(ChunkSize, ChunkSize));
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        chunk->free_list = NULL;
+        chunk->carve = reinterpret_cast<char*>(chunk) + FIRST_OBJECT;
+        chunk->live = 0;
+        chunk->is_partial = false;
+        pushPartial(chunk);
+
+        chunk->prev_chunk = NULL;
+        chunk->next_chunk = all_chunks;
+        if (all_chunks != NULL) {
+            all_chunks->prev_chunk = chunk;
+        }
+        all_chunks = chunk;
+        chunks += 1;
+        _pool_account(1, ChunkSize);
+        return chunk;
+    }
+
+    void releaseChunk(Chunk* chunk) {
+        if (chunk->prev_chunk != NULL) {
+            chunk->prev_chunk->next_chunk = chunk->next_chunk;
+        } else {
+            all_chunks = chunk->next_chunk;
+        }
+
+        if (chunk->next_chunk != NULL) {
+            chunk->next_chunk->prev_chunk = chunk->prev_chunk;
+        }
+
+        chunks -= 1;
+        _pool_account(-1, -(long)ChunkSize);
+        sfree(chunk);
+    }
+
+    void pushPartial(Chunk* chunk) {
+        chunk->prev_partial = NULL;
+        chunk->next_partial = partial;
+        if (partial != NULL) {
+            partial->prev_partial = chunk;
+        }
+        partial = chunk;
+        chunk->is_partial = true;
+    }
+
+    void unlinkPartial(Chunk* chunk) {
+        if (chunk->prev_partial != NULL) {
+            chunk->prev_partial->next_partial = chunk->next_partial;
+        } else {
+            partial = chunk->next_partial;
+        }
+
+        if (chunk->next_partial != NULL) {
+            chunk->next_partial->prev_partial = chunk->prev_partial;
+        }
+        chunk->is_partial = false;
+    }
+
+    Chunk* partial; /*chunks that still have a free or uncarved object*/
+    Chunk* all_chunks;
+    size_t chunks;
+    size_t live;
+};
+
+#endif /* OBJECT_POOL_H */
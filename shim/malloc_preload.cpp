@@ -0,0 +1,207 @@
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "my_stdlib.h"
+
+/*
+ * LD_PRELOAD shim exporting the C allocation symbols on top of malloc_3.
+ *
+ *   LD_PRELOAD=./libmalloc_3_preload.so sort big.txt
+ *
+ * malloc_3 is not thread safe, so every call is serialized by one lock. The lock
+ * is recursive because srealloc reports running out of memory with an exception,
+ * and allocating that exception calls back into malloc.
+ * Everything here is statically initialized, so calls that arrive before any
+ * constructor ran (ld.so, libc start up) work as is.
+ */
+
+#define SHIM_ALIGNMENT (16)
+#define ALIGN_UP(size, align) (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+static pthread_mutex_t heap_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+class HeapLock {
+public:
+    HeapLock() { pthread_mutex_lock(&heap_lock); }
+    ~HeapLock() { pthread_mutex_unlock(&heap_lock); }
+};
+
+static void lockBeforeFork() { pthread_mutex_lock(&heap_lock); }
+static void unlockAfterFork() { pthread_mutex_unlock(&heap_lock); }
+
+static void resetAfterFork()
+{
+    /*the child runs under a new thread id, so it cannot unlock the parent's recursive lock*/
+    pthread_mutex_t fresh_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    memcpy(&heap_lock, &fresh_lock, sizeof(heap_lock));
+}
+
+__attribute__((constructor)) static void registerForkHandlers()
+{
+    /*keep the heap consistent in the child if another thread was inside smalloc*/
+    pthread_atfork(lockBeforeFork, unlockAfterFork, resetAfterFork);
+}
+
+static bool isPowerOfTwo(size_t x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+/* The ABI wants malloc to return memory aligned for any type (16 bytes on x86-64).
+ * The shim builds malloc_3 with -DMALLOC_ALIGNMENT=16, so every block already is
+ * and smemalign only carves for stricter alignments. Linked against an 8 aligned
+ * malloc_3 the rounding to 16 still keeps blocks aligned once the first one is. */
+static void* alignedAlloc(size_t alignment, size_t size)
+{
+    if (alignment < SHIM_ALIGNMENT) {
+        alignment = SHIM_ALIGNMENT;
+    }
+
+    size_t request = ALIGN_UP(size == 0 ? 1 : size, SHIM_ALIGNMENT);
+    if (request < size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void* p;
+    {
+        HeapLock lock;
+        p = smemalign(alignment, request);
+    }
+
+    if (p == NULL) {
+        errno = ENOMEM;
+    }
+
+    return p;
+}
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    return alignedAlloc(SHIM_ALIGNMENT, size);
+}
+
+void free(void* p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    HeapLock lock;
+    sfree(p);
+}
+
+void* calloc(size_t num, size_t size)
+{
+    size_t total;
+    if (__builtin_mul_overflow(num, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void* p = alignedAlloc(SHIM_ALIGNMENT, total);
+    if (p != NULL) {
+        memset(p, 0, total);
+    }
+
+    return p;
+}
+
+void* realloc(void* oldp, size_t size)
+{
+    if (oldp == NULL) {
+        return malloc(size);
+    }
+
+    if (size == 0) {
+        free(oldp);
+        return NULL;
+    }
+
+    size_t request = ALIGN_UP(size, SHIM_ALIGNMENT);
+    void* newp;
+    {
+        HeapLock lock;
+        newp = srealloc(oldp, request);
+        if (newp != NULL && (unsigned long)newp % SHIM_ALIGNMENT != 0) {
+            /*only an 8 aligned engine gets here. srealloc already let go of oldp,
+             *so if no aligned copy can be had keep newp rather than the data*/
+            void* aligned = smemalign(SHIM_ALIGNMENT, request);
+            if (aligned != NULL) {
+                memcpy(aligned, newp, size);
+                sfree(newp);
+                newp = aligned;
+            }
+        }
+    }
+
+    if (newp == NULL) {
+        errno = ENOMEM;
+    }
+
+    return newp;
+}
+
+void* reallocarray(void* oldp, size_t num, size_t size)
+{
+    size_t total;
+    if (__builtin_mul_overflow(num, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return realloc(oldp, total);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return alignedAlloc(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment) || alignment % sizeof(void*) != 0) {
+        return EINVAL;
+    }
+
+    void* p = alignedAlloc(alignment, size);
+    if (p == NULL) {
+        return ENOMEM;
+    }
+
+    *memptr = p;
+    return 0;
+}
+
+void* valloc(size_t size)
+{
+    return alignedAlloc((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+void* pvalloc(size_t size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return alignedAlloc(page_size, ALIGN_UP(size, page_size));
+}
+
+size_t malloc_usable_size(void* p)
+{
+    HeapLock lock;
+    return susable_size(p);
+}
+
+} /* extern "C" */
@@ -0,0 +1,177 @@
+#include <cstddef>
+#include <new>
+
+#include "my_stdlib.h"
+
+/*
+ * Opt-in replacement of every global operator new/delete, link this file
+ * next to malloc_3.cpp to route C++ allocations to smalloc/sfree.
+ *
+ * Unlike the LD_PRELOAD shim there is no lock here, so this is only for
+ * single threaded programs (or ones that already serialize allocations).
+ * Plain new only goes straight to smalloc when malloc_3 hands out blocks
+ * aligned for any object, so build both files with -DMALLOC_ALIGNMENT=16
+ * (__STDCPP_DEFAULT_NEW_ALIGNMENT__ on x86-64). Against an 8 aligned engine
+ * it still works, but every plain new has to go through smemalign.
+ * Sized deletes of blocks that came from smalloc use sfree_sized, which skips
+ * the page map lookup that guards sfree against foreign pointers.
+ */
+
+#ifndef MALLOC_ALIGNMENT
+#define MALLOC_ALIGNMENT (8)
+#endif
+
+#define SMALLOC_ALIGNMENT (MALLOC_ALIGNMENT)
+#define NEW_ALIGNMENT (__STDCPP_DEFAULT_NEW_ALIGNMENT__)
+
+static void* allocOrNull(size_t size, size_t alignment)
+{
+    /*new must return a unique pointer even for 0 bytes*/
+    if (size == 0) {
+        size = 1;
+    }
+
+    if (alignment <= SMALLOC_ALIGNMENT) {
+        return smalloc(size);
+    }
+
+    /*sizes that are multiples of the alignment keep the next blocks aligned too,
+     *so smemalign mostly gets an aligned block from its first smalloc*/
+    size_t rounded = (size + alignment - 1) & ~(alignment - 1);
+    return smemalign(alignment, rounded < size ? size : rounded);
+}
+
+/* The delete matching allocOrNull when the size is known */
+static void sizedFree(void* p, size_t size, size_t alignment)
+{
+    if (alignment <= SMALLOC_ALIGNMENT) {
+        sfree_sized(p, size == 0 ? 1 : size);
+    } else {
+        sfree(p);
+    }
+}
+
+static void* allocOrThrow(size_t size, size_t alignment)
+{
+    void* p = allocOrNull(size, alignment);
+    while (p == NULL) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == NULL) {
+            throw std::bad_alloc();
+        }
+
+        handler();
+        p = allocOrNull(size, alignment);
+    }
+
+    return p;
+}
+
+static void* allocNoThrow(size_t size, size_t alignment) noexcept
+{
+    try {
+        return allocOrThrow(size, alignment);
+    } catch (...) {
+        return NULL;
+    }
+}
+
+void* operator new(size_t size)
+{
+    return allocOrThrow(size, NEW_ALIGNMENT);
+}
+
+void* operator new[](size_t size)
+{
+    return allocOrThrow(size, NEW_ALIGNMENT);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocNoThrow(size, NEW_ALIGNMENT);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocNoThrow(size, NEW_ALIGNMENT);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocOrThrow(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocOrThrow(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocNoThrow(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocNoThrow(size, (size_t)alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+    sfree(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    sfree(p);
+}
+
+void operator delete(void* p, size_t size) noexcept
+{
+    sizedFree(p, size, NEW_ALIGNMENT);
+}
+
+void operator delete[](void* p, size_t size) noexcept
+{
+    sizedFree(p, size, NEW_ALIGNMENT);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    sfree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    sfree(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    sfree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    sfree(p);
+}
+
+void operator delete(void* p, size_t size, std::align_val_t alignment) noexcept
+{
+    sizedFree(p, size, (size_t)alignment);
+}
+
+void operator delete[](void* p, size_t size, std::align_val_t alignment) noexcept
+{
+    sizedFree(p, size, (size_t)alignment);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    sfree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    sfree(p);
+}
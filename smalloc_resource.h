@@ -0,0 +1,126 @@
+#ifndef SMALLOC_RESOURCE_H
+#define SMALLOC_RESOURCE_H
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+#include "my_stdlib.h"
+
+/* Adapters that let std containers allocate through smalloc.
+ * smalloc already returns blocks aligned to the engine's alignment, anything
+ * stricter goes through smemalign. Include this with the -DMALLOC_ALIGNMENT
+ * malloc_3 was built with. */
+
+#ifdef MALLOC_ALIGNMENT
+static constexpr size_t smalloc_alignment = MALLOC_ALIGNMENT;
+#else
+static constexpr size_t smalloc_alignment = 8;
+#endif
+
+inline void* smallocAligned(size_t bytes, size_t alignment)
+{
+    /*smalloc(0) fails, but containers may legally ask for 0 bytes*/
+    size_t size = bytes == 0 ? 1 : bytes;
+    void* p = alignment <= smalloc_alignment ? smalloc(size) : smemalign(alignment, size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+/* The free matching smallocAligned, blocks that came from smalloc skip the page map lookup of sfree */
+inline void sfreeAligned(void* p, size_t bytes, size_t alignment)
+{
+    if (alignment <= smalloc_alignment) {
+        sfree_sized(p, bytes == 0 ? 1 : bytes);
+    } else {
+        sfree(p);
+    }
+}
+
+class SmallocResource : public std::pmr::memory_resource {
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return smallocAligned(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        sfreeAligned(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        /*all instances share the same heap*/
+        return dynamic_cast<const SmallocResource*>(&other) != nullptr;
+    }
+};
+
+inline SmallocResource* smalloc_resource()
+{
+    static SmallocResource resource;
+    return &resource;
+}
+
+template <class T>
+class SmallocAllocator {
+public:
+    typedef T value_type;
+
+    SmallocAllocator() noexcept = default;
+
+    template <class U>
+    SmallocAllocator(const SmallocAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+
+        return static_cast<T*>(smallocAligned(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        sfreeAligned(p, n * sizeof(T), alignof(T));
+    }
+
+    /* Not part of the Allocator requirements: grows an array in place when
+     * srealloc can, which is only valid for trivially copyable types. A smaller
+     * array is copied to a new block instead, srealloc would shrink a heap block
+     * in place to a size deallocate frees as a small object */
+    T* reallocate(T* p, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "srealloc moves bytes, not objects");
+        static_assert(alignof(T) <= smalloc_alignment, "srealloc does not keep stricter alignments");
+        size_t bytes = n * sizeof(T);
+        if (p != NULL && bytes < susable_size(p)) {
+            void* newp = smallocAligned(bytes, alignof(T));
+            memcpy(newp, p, bytes);
+            sfree(p);
+            return static_cast<T*>(newp);
+        }
+
+        void* newp = srealloc(p, bytes);
+        if (newp == NULL) {
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T*>(newp);
+    }
+};
+
+template <class T, class U>
+bool operator==(const SmallocAllocator<T>&, const SmallocAllocator<U>&) noexcept
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const SmallocAllocator<T>&, const SmallocAllocator<U>&) noexcept
+{
+    return false;
+}
+
+#endif /* SMALLOC_RESOURCE_H */
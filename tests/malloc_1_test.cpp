@@ -1,16 +1,21 @@
 #include "my_stdlib.h"
 #include <catch2/catch_test_macros.hpp>
 
+#include <cstdint>
 #include <unistd.h>
 
 #define MAX_ALLOCATION_SIZE (1e8)
+#define ALIGNMENT (16)
+#define CHUNK_SIZE (0x100000)
 
 TEST_CASE("Sanity", "[malloc1]")
 {
     void *base = sbrk(0);
     char *a = (char *)smalloc(10);
     REQUIRE(a != nullptr);
-    REQUIRE(base == a);
+    REQUIRE(a >= (char *)base);
+    REQUIRE(a < (char *)base + ALIGNMENT);
+    REQUIRE((uintptr_t)a % ALIGNMENT == 0);
 }
 
 TEST_CASE("Check size", "[malloc1]")
@@ -18,15 +23,13 @@ TEST_CASE("Check size", "[malloc1]")
     void *base = sbrk(0);
     char *a = (char *)smalloc(1);
     REQUIRE(a != nullptr);
-    REQUIRE(base == a);
     void *after = sbrk(0);
-    REQUIRE(1 == (size_t)after - (size_t)base);
+    REQUIRE(CHUNK_SIZE == (size_t)after - (size_t)base);
 
     char *b = (char *)smalloc(10);
     REQUIRE(b != nullptr);
-    REQUIRE((char *)base + 1 == b);
-    after = sbrk(0);
-    REQUIRE(11 == (size_t)after - (size_t)base);
+    REQUIRE(a + ALIGNMENT == b);
+    REQUIRE(sbrk(0) == after);
 }
 
 TEST_CASE("0 size", "[malloc1]")
@@ -44,10 +47,63 @@ TEST_CASE("Max size", "[malloc1]")
     char *a = (char *)smalloc(MAX_ALLOCATION_SIZE);
     REQUIRE(a != nullptr);
     void *after = sbrk(0);
-    REQUIRE(MAX_ALLOCATION_SIZE == (size_t)after - (size_t)base);
+    REQUIRE(MAX_ALLOCATION_SIZE <= (size_t)after - (size_t)base);
+    REQUIRE(MAX_ALLOCATION_SIZE + CHUNK_SIZE > (size_t)after - (size_t)base);
 
     char *b = (char *)smalloc(MAX_ALLOCATION_SIZE + 1);
     REQUIRE(b == nullptr);
-    after = sbrk(0);
-    REQUIRE(MAX_ALLOCATION_SIZE == (size_t)after - (size_t)base);
+    REQUIRE(sbrk(0) == after);
+}
+
+TEST_CASE("Chunk reuse", "[malloc1]")
+{
+    char *a = (char *)smalloc(1);
+    REQUIRE(a != nullptr);
+    void *after = sbrk(0);
+
+    /*the rest of the chunk is handed out without moving the break*/
+    char *prev = a;
+    for (size_t i = 1; i < CHUNK_SIZE / 64 - 1; i++) {
+        char *p = (char *)smalloc(64);
+        REQUIRE(p == (i == 1 ? prev + ALIGNMENT : prev + 64));
+        prev = p;
+    }
+    REQUIRE(sbrk(0) == after);
+
+    REQUIRE(smalloc(128) != nullptr);
+    REQUIRE(sbrk(0) == (char *)after + CHUNK_SIZE);
+}
+
+TEST_CASE("Mark and release", "[malloc1]")
+{
+    char *a = (char *)smalloc(10);
+    REQUIRE(a != nullptr);
+
+    void *mark = smark();
+    char *b = (char *)smalloc(100);
+    char *c = (char *)smalloc(100);
+    REQUIRE(b == mark);
+    REQUIRE(c != nullptr);
+
+    srelease(mark);
+    REQUIRE(smalloc(100) == b);
+
+    /*marks outside the allocated range are ignored*/
+    srelease(a - ALIGNMENT);
+    srelease(c + 4096);
+    REQUIRE(smalloc(100) == c);
+}
+
+TEST_CASE("Release trims the break", "[malloc1]")
+{
+    void *mark = smark();
+    REQUIRE(mark != nullptr);
+    void *base = sbrk(0);
+
+    REQUIRE(smalloc(MAX_ALLOCATION_SIZE) == mark);
+    REQUIRE((size_t)sbrk(0) - (size_t)base >= MAX_ALLOCATION_SIZE);
+
+    srelease(mark);
+    REQUIRE((char *)sbrk(0) == (char *)mark + CHUNK_SIZE);
+    REQUIRE(smalloc(MAX_ALLOCATION_SIZE) == mark);
 }
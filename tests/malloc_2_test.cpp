@@ -450,6 +450,66 @@ TEST_CASE("Reuse two blocks sizes large", "[malloc2]")
     verify_size(base);
 }
 
+TEST_CASE("Reuse split", "[malloc2]")
+{
+    verify_blocks(0, 0, 0, 0);
+
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(10000);
+    char *b = (char *)smalloc(10);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    sfree(a);
+    verify_blocks(2, 10010, 1, 10000);
+    verify_size(base);
+
+    char *c = (char *)smalloc(100);
+    REQUIRE(c == a);
+    verify_blocks(3, 10010 - _size_meta_data(), 1, 10000 - 100 - _size_meta_data());
+    verify_size(base);
+
+    /*the rest is reused from where the split left it*/
+    char *d = (char *)smalloc(9800);
+    REQUIRE(d == c + 100 + _size_meta_data());
+    verify_blocks(3, 10010 - _size_meta_data(), 0, 0);
+    verify_size(base);
+
+    sfree(c);
+    sfree(d);
+    sfree(b);
+    verify_blocks(3, 10010 - _size_meta_data(), 3, 10010 - _size_meta_data());
+    verify_size(base);
+}
+
+#ifdef MALLOC_2_NEXT_FIT
+TEST_CASE("Reuse next fit", "[malloc2]")
+{
+    verify_blocks(0, 0, 0, 0);
+
+    char *a = (char *)smalloc(100);
+    char *sep1 = (char *)smalloc(10);
+    char *b = (char *)smalloc(100);
+    char *sep2 = (char *)smalloc(10);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    sfree(a);
+    sfree(b);
+
+    REQUIRE(smalloc(100) == a);
+    sfree(a);
+
+    /*the search goes on after a instead of starting over at the lowest block*/
+    REQUIRE(smalloc(100) == b);
+    REQUIRE(smalloc(100) == a);
+    verify_blocks(4, 220, 0, 0);
+
+    sfree(a);
+    sfree(b);
+    sfree(sep1);
+    sfree(sep2);
+}
+#endif
+
 TEST_CASE("scalloc", "[malloc2]")
 {
     verify_blocks(0, 0, 0, 0);
@@ -0,0 +1,156 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == _size_meta_data() * allocated_blocks);                                       \
+    } while (0)
+
+/* The metadata lives outside the heap, so the program break only grows by the data */
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() == (size_t)after - (size_t)base);                                               \
+    } while (0)
+
+TEST_CASE("oob blocks are packed without headers", "[malloc3_oob]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *a = (char *)smalloc(16);
+    char *b = (char *)smalloc(100);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(b == a + 16);
+    verify_blocks(2, 16 + 104, 0, 0);
+    verify_size(base);
+
+    sfree(a);
+    verify_blocks(2, 16 + 104, 1, 16);
+
+    char *c = (char *)smalloc(10);
+    REQUIRE(c == a);
+    verify_blocks(2, 16 + 104, 0, 0);
+
+    sfree(c);
+    sfree(b);
+    verify_blocks(1, 16 + 104, 1, 16 + 104);
+    verify_size(base);
+}
+
+TEST_CASE("oob split and merge", "[malloc3_oob]")
+{
+    void *base = sbrk(0);
+    size_t start_bytes = _num_allocated_bytes();
+    size_t start_free = _num_free_bytes();
+
+    char *a = (char *)smalloc(1024);
+    char *b = (char *)smalloc(64);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    sfree(a);
+
+    /*the leftover is counted without any header bytes taken from it*/
+    char *small = (char *)smalloc(MIN_SPLIT_SIZE);
+    REQUIRE(small == a);
+    REQUIRE(_num_free_bytes() - start_free == 1024 - MIN_SPLIT_SIZE);
+
+    sfree(small);
+    REQUIRE(_num_free_bytes() - start_free == 1024);
+
+    sfree(b);
+    REQUIRE(_num_free_bytes() - start_free == 1024 + 64);
+    REQUIRE(_num_allocated_bytes() - start_bytes == (size_t)sbrk(0) - (size_t)base);
+}
+
+TEST_CASE("oob large blocks are mmapped", "[malloc3_oob]")
+{
+    void *base = sbrk(0);
+    size_t start_blocks = _num_allocated_blocks();
+
+    char *big = (char *)smalloc(MMAP_THRESHOLD);
+    REQUIRE(big != nullptr);
+    REQUIRE(sbrk(0) == base);
+    REQUIRE(_num_allocated_blocks() == start_blocks + 1);
+    memset(big, 1, MMAP_THRESHOLD);
+
+    sfree(big);
+    REQUIRE(_num_allocated_blocks() == start_blocks);
+    REQUIRE(smalloc(MAX_ALLOCATION_SIZE + 1) == nullptr);
+}
+
+TEST_CASE("oob srealloc keeps the data", "[malloc3_oob]")
+{
+    char *a = (char *)smalloc(32);
+    REQUIRE(a != nullptr);
+    for (int i = 0; i < 32; i++) {
+        a[i] = (char)i;
+    }
+
+    char *b = (char *)smalloc(32);
+    REQUIRE(b != nullptr);
+
+    char *grown = (char *)srealloc(a, 400);
+    REQUIRE(grown != nullptr);
+    for (int i = 0; i < 32; i++) {
+        REQUIRE(grown[i] == (char)i);
+    }
+
+    char *moved = (char *)srealloc(grown, MMAP_THRESHOLD);
+    REQUIRE(moved != nullptr);
+    for (int i = 0; i < 32; i++) {
+        REQUIRE(moved[i] == (char)i);
+    }
+
+    sfree(moved);
+    sfree(b);
+}
+
+TEST_CASE("oob overflow cannot corrupt the free lists", "[malloc3_oob]")
+{
+    char *a = (char *)smalloc(64);
+    char *b = (char *)smalloc(64);
+    char *c = (char *)smalloc(64);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(c != nullptr);
+    sfree(b);
+
+    size_t free_blocks = _num_free_blocks();
+    size_t free_bytes = _num_free_bytes();
+
+    /*writing far past a clobbers where an inline header for b and c would be*/
+    memset(a, 0xff, 64 * 3);
+    REQUIRE(_num_free_blocks() == free_blocks);
+    REQUIRE(_num_free_bytes() == free_bytes);
+
+    /*pointers that are not the start of a block are ignored*/
+    sfree(a + 8);
+    sfree(b);
+    REQUIRE(_num_free_blocks() == free_blocks);
+    REQUIRE(_num_free_bytes() == free_bytes);
+
+    REQUIRE(smalloc(64) == b);
+    sfree(a);
+    sfree(b);
+    sfree(c);
+}
@@ -653,3 +653,28 @@ TEST_CASE("Alignment MMAP", "[malloc3]")
     REQUIRE(_num_allocated_bytes() % 8 == 0);
     REQUIRE(_num_free_bytes() % 8 == 0);
 }
+
+TEST_CASE("Sized free", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *a = (char *)smalloc(100);
+    char *b = (char *)scalloc(10, 30);
+    char *large = (char *)smalloc(MMAP_THRESHOLD);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(large != nullptr);
+    verify_blocks(3, 104 + 304 + MMAP_THRESHOLD, 0, 0);
+
+    sfree_sized(a, 100);
+    verify_blocks(3, 104 + 304 + MMAP_THRESHOLD, 1, 104);
+    sfree_sized(large, MMAP_THRESHOLD);
+    verify_blocks(2, 104 + 304, 1, 104);
+    sfree_sized(b, 300);
+    verify_blocks(1, 104 + 304 + _size_meta_data(), 1, 104 + 304 + _size_meta_data());
+    verify_size(base);
+
+    sfree_sized(nullptr, 10);
+    verify_blocks(1, 104 + 304 + _size_meta_data(), 1, 104 + 304 + _size_meta_data());
+}
@@ -0,0 +1,101 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+/* Only built with -DMALLOC_DEFERRED_COALESCE */
+
+TEST_CASE("Deferred frees are reused last in first out", "[malloc3_deferred]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *a = (char *)smalloc(100);
+    char *b = (char *)smalloc(100);
+    char *c = (char *)smalloc(100);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(c != nullptr);
+
+    /*a and b are neighbours, but stay apart while binned*/
+    sfree(a);
+    sfree(b);
+    REQUIRE(smalloc(100) == b);
+    REQUIRE(smalloc(96) == a);
+    verify_blocks(3, 104 * 3, 0, 0);
+    verify_size(base);
+
+    sfree(a);
+    sfree(b);
+    sfree(c);
+    verify_blocks(1, 104 * 3 + _size_meta_data() * 2, 1, 104 * 3 + _size_meta_data() * 2);
+    verify_size(base);
+}
+
+TEST_CASE("Deferred frees merge when the bin misses", "[malloc3_deferred]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *a = (char *)smalloc(100);
+    char *b = (char *)smalloc(100);
+    char *c = (char *)smalloc(100);
+    REQUIRE(c != nullptr);
+    sfree(a);
+    sfree(b);
+
+    /*nothing in the bin fits, so a and b are merged first and then fit*/
+    char *merged = (char *)smalloc(200);
+    REQUIRE(merged == a);
+    verify_blocks(2, 104 * 2 + _size_meta_data() + 100, 0, 0);
+    verify_size(base);
+
+    sfree(merged);
+    sfree(c);
+    verify_blocks(1, 104 * 2 + _size_meta_data() * 2 + 100, 1, 104 * 2 + _size_meta_data() * 2 + 100);
+}
+
+TEST_CASE("Double free of a deferred block is ignored", "[malloc3_deferred]")
+{
+    char *a = (char *)smalloc(64);
+    char *b = (char *)smalloc(64);
+    REQUIRE(b != nullptr);
+    sfree(a);
+    sfree(a);
+    REQUIRE(smalloc(64) == a);
+    REQUIRE(smalloc(64) != a);
+}
@@ -0,0 +1,113 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+#ifndef MALLOC_ALIGNMENT
+#define MALLOC_ALIGNMENT 8
+#endif
+
+static const EngineVariant *findVariant(const char *name)
+{
+    const EngineVariant *variants;
+    size_t count = _engine_variants(&variants);
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(variants[i].name, name) == 0) {
+            return &variants[i];
+        }
+    }
+
+    return nullptr;
+}
+
+TEST_CASE("Engine variants keep their own heaps", "[malloc3_variants]")
+{
+    const EngineVariant *variants;
+    size_t count = _engine_variants(&variants);
+    REQUIRE(count >= 5);
+    REQUIRE(strcmp(variants[0].name, "malloc_3") == 0);
+
+    for (size_t i = 1; i < count; i++) {
+        const EngineVariant &variant = variants[i];
+        void *base = sbrk(0);
+        size_t allocated_blocks = _num_allocated_blocks();
+
+        char *blocks[16];
+        for (size_t j = 0; j < 16; j++) {
+            blocks[j] = (char *)variant.smalloc(j * 100 + 1);
+            REQUIRE(blocks[j] != nullptr);
+            REQUIRE((size_t)blocks[j] % MALLOC_ALIGNMENT == 0);
+            memset(blocks[j], 0xab, j * 100 + 1);
+        }
+        REQUIRE(sbrk(0) == base);
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);
+        size_t variant_bytes = variant.num_allocated_bytes();
+        REQUIRE(variant_bytes >= 16 * 100);
+
+        /*sfree does not take a block of another engine*/
+        sfree(blocks[3]);
+        REQUIRE(variant.num_allocated_bytes() == variant_bytes);
+
+        blocks[3] = (char *)variant.srealloc(blocks[3], 1000);
+        REQUIRE(blocks[3] != nullptr);
+        REQUIRE(blocks[3][0] == (char)0xab);
+
+        for (size_t j = 0; j < 16; j++) {
+            variant.sfree(blocks[j]);
+        }
+        /*everything merged back into one free block*/
+        REQUIRE(variant.num_free_blocks() == 1);
+        REQUIRE(variant.num_allocated_bytes() == variant.num_free_bytes());
+        REQUIRE(variant.largest_free_block() == variant.num_free_bytes());
+    }
+}
+
+TEST_CASE("Engine variants fit by their policy", "[malloc3_variants]")
+{
+    const char *names[] = { "best_fit", "packed_best_fit", "first_fit", "next_fit" };
+    for (const char *name : names) {
+        const EngineVariant *variant = findVariant(name);
+        REQUIRE(variant != nullptr);
+
+        char *big = (char *)variant->smalloc(512);
+        char *sep1 = (char *)variant->smalloc(16);
+        char *exact = (char *)variant->smalloc(256);
+        char *sep2 = (char *)variant->smalloc(16);
+        REQUIRE(sep2 != nullptr);
+        variant->sfree(big);
+        variant->sfree(exact);
+        REQUIRE(variant->largest_free_block() == 512);
+
+        char *a = (char *)variant->smalloc(256);
+        if (strstr(name, "best_fit") != nullptr) {
+            REQUIRE(a == exact);
+        } else {
+            /*the lower block fits first and is split*/
+            REQUIRE(a == big);
+        }
+
+        variant->sfree(a);
+        variant->sfree(sep1);
+        variant->sfree(sep2);
+        REQUIRE(variant->num_free_blocks() == 1);
+        REQUIRE(variant->largest_free_block() == variant->num_free_bytes());
+    }
+}
+
+TEST_CASE("Engine variant mmapped blocks", "[malloc3_variants]")
+{
+    const EngineVariant *variant = findVariant("best_fit");
+    REQUIRE(variant != nullptr);
+    size_t mapped = _num_mapped_bytes();
+    size_t allocated_bytes = variant->num_allocated_bytes();
+
+    char *big = (char *)variant->smalloc(1 << 20);
+    REQUIRE(big != nullptr);
+    REQUIRE(_num_mapped_bytes() > mapped);
+    REQUIRE(variant->num_allocated_bytes() == allocated_bytes + (1 << 20));
+    big[(1 << 20) - 1] = 1;
+    variant->sfree(big);
+    REQUIRE(_num_mapped_bytes() == mapped);
+    REQUIRE(variant->num_allocated_bytes() == allocated_bytes);
+}
@@ -0,0 +1,177 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+/* The values of fit_policy in malloc_3.cpp, so the build's policy can be tested here */
+#define FIT_FIRST 0
+#define FIT_NEXT 1
+#define FIT_BEST 2
+#ifndef MALLOC_FIT_POLICY
+#define MALLOC_FIT_POLICY FIT_BEST
+#endif
+#ifndef MALLOC_ALIGNMENT
+#define MALLOC_ALIGNMENT 8
+#endif
+
+TEST_CASE("fit policy smaller block higher up", "[malloc3_fit]")
+{
+    void *base = sbrk(0);
+    char *big = (char *)smalloc(512);
+    char *sep1 = (char *)smalloc(16);
+    char *exact = (char *)smalloc(256);
+    char *sep2 = (char *)smalloc(16);
+    REQUIRE(sep2 != nullptr);
+    sfree(big);
+    sfree(exact);
+
+    char *a = (char *)smalloc(256);
+#if MALLOC_FIT_POLICY == FIT_BEST
+    REQUIRE(a == exact);
+    verify_blocks(4, 512 + 256 + 32, 1, 512);
+#else
+    /*the lower block fits first and is split*/
+    REQUIRE(a == big);
+    verify_blocks(5, 512 + 256 + 32 - _size_meta_data(), 2, 256 - _size_meta_data() + 256);
+#endif
+    verify_size(base);
+
+    sfree(a);
+    sfree(sep1);
+    sfree(sep2);
+}
+
+TEST_CASE("fit policy reuse after the rover", "[malloc3_fit]")
+{
+    char *a = (char *)smalloc(256);
+    char *sep1 = (char *)smalloc(16);
+    char *b = (char *)smalloc(256);
+    char *sep2 = (char *)smalloc(16);
+    char *c = (char *)smalloc(256);
+    char *sep3 = (char *)smalloc(16);
+    REQUIRE(sep3 != nullptr);
+    sfree(a);
+    sfree(b);
+    sfree(c);
+
+    REQUIRE(smalloc(256) == a);
+    REQUIRE(smalloc(256) == b);
+    sfree(a);
+
+    char *d = (char *)smalloc(256);
+#if MALLOC_FIT_POLICY == FIT_NEXT
+    /*the search goes on after b instead of starting over at a*/
+    REQUIRE(d == c);
+#else
+    REQUIRE(d == a);
+#endif
+
+    sfree(d);
+    sfree(b);
+    sfree(sep1);
+    sfree(sep2);
+    sfree(sep3);
+}
+
+TEST_CASE("fit policy largest free block", "[malloc3_fit]")
+{
+    size_t meta = _size_meta_data();
+    char *a = (char *)smalloc(512);
+    char *sep1 = (char *)smalloc(16);
+    char *b = (char *)smalloc(1024);
+    char *sep2 = (char *)smalloc(16);
+    char *c = (char *)smalloc(256);
+    char *sep3 = (char *)smalloc(16);
+    REQUIRE(sep3 != nullptr);
+    REQUIRE(_largest_free_block() == 0);
+
+    sfree(b);
+    sfree(a);
+    REQUIRE(_largest_free_block() == 1024);
+
+    /*the largest block is taken whole*/
+    char *x = (char *)smalloc(1024);
+    REQUIRE(x == b);
+    REQUIRE(_largest_free_block() == 512);
+
+    /*the largest block is split, the rest is smaller than c*/
+    sfree(c);
+    char *y = (char *)smalloc(304);
+    REQUIRE(y == a);
+    REQUIRE(_num_free_blocks() == 2);
+    REQUIRE(_largest_free_block() == 256);
+
+    /*merges*/
+    sfree(sep2);
+    REQUIRE(_largest_free_block() == 16 + meta + 256);
+    sfree(x);
+    REQUIRE(_largest_free_block() == 1024 + meta + 16 + meta + 256);
+    sfree(y);
+    REQUIRE(_largest_free_block() == 1024 + meta + 16 + meta + 256);
+    sfree(sep1);
+    REQUIRE(_largest_free_block() == 512 + meta + 16 + meta + 1024 + meta + 16 + meta + 256);
+    REQUIRE(_num_free_blocks() == 1);
+
+    sfree(sep3);
+}
+
+TEST_CASE("fit policy alignment", "[malloc3_fit]")
+{
+    char *blocks[64];
+    for (size_t i = 0; i < 64; i++) {
+        blocks[i] = (char *)smalloc(i * 7 + 1);
+        REQUIRE(blocks[i] != nullptr);
+        REQUIRE((size_t)blocks[i] % MALLOC_ALIGNMENT == 0);
+    }
+
+    for (size_t i = 0; i < 64; i += 2) {
+        sfree(blocks[i]);
+    }
+
+    for (size_t i = 0; i < 64; i += 2) {
+        blocks[i] = (char *)smalloc(i * 3 + 1);
+        REQUIRE((size_t)blocks[i] % MALLOC_ALIGNMENT == 0);
+    }
+
+    char *big = (char *)smalloc(MMAP_THRESHOLD + 1);
+    REQUIRE((size_t)big % MALLOC_ALIGNMENT == 0);
+    sfree(big);
+
+    for (size_t i = 0; i < 64; i++) {
+        sfree(blocks[i]);
+    }
+}
@@ -0,0 +1,76 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("Largest free block", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    REQUIRE(_largest_free_block() == 0);
+    REQUIRE(_external_fragmentation() == 0);
+
+    char *a = (char *)smalloc(100);
+    char *b = (char *)smalloc(16);
+    char *c = (char *)smalloc(300);
+    char *d = (char *)smalloc(16);
+    REQUIRE(d != nullptr);
+    REQUIRE(_largest_free_block() == 0);
+
+    sfree(a);
+    REQUIRE(_largest_free_block() == aligned_size(100));
+    REQUIRE(_external_fragmentation() == 0);
+
+    sfree(c);
+    REQUIRE(_largest_free_block() == aligned_size(300));
+    double expected = 1.0 - (double)aligned_size(300) / (double)(aligned_size(100) + aligned_size(300));
+    REQUIRE(_external_fragmentation() == expected);
+
+    /* Merging the holes leaves one block again */
+    sfree(b);
+    REQUIRE(_largest_free_block() == _num_free_bytes());
+    REQUIRE(_external_fragmentation() == 0);
+}
+
+TEST_CASE("Largest free block mmap", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    char *a = (char *)smalloc(MMAP_THRESHOLD);
+    REQUIRE(a != nullptr);
+    sfree(a);
+    REQUIRE(_largest_free_block() == 0);
+    REQUIRE(_external_fragmentation() == 0);
+}
@@ -0,0 +1,105 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+struct FreeSummary {
+    size_t request;
+    void *best_fit;
+    size_t best_fit_size;
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t largest;
+};
+
+static int summarize(void *ptr, size_t size, bool is_free, bool is_mmapped, void *ctx)
+{
+    FreeSummary *summary = (FreeSummary *)ctx;
+    if (!is_free || is_mmapped) {
+        return 0;
+    }
+
+    summary->free_blocks += 1;
+    summary->free_bytes += size;
+    if (size > summary->largest) {
+        summary->largest = size;
+    }
+
+    /*the walk goes up in address order, so the first of equal sizes wins*/
+    if (size >= summary->request && (summary->best_fit == nullptr || size < summary->best_fit_size)) {
+        summary->best_fit = ptr;
+        summary->best_fit_size = size;
+    }
+    return 0;
+}
+
+TEST_CASE("Free index keeps best fit over many blocks", "[malloc3]")
+{
+    const size_t slots = 2000;
+    void *ptrs[slots] = {nullptr};
+    unsigned long rng = 0x2545f4914f6cdd1dUL;
+
+    for (int step = 0; step < 6000; step++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t slot = rng % slots;
+        if (ptrs[slot] != nullptr) {
+            sfree(ptrs[slot]);
+            ptrs[slot] = nullptr;
+            continue;
+        }
+
+        size_t size = aligned_size(8 + (rng >> 20) % 1500);
+        FreeSummary summary = {size, nullptr, 0, 0, 0, 0};
+        _heap_walk(summarize, &summary);
+        REQUIRE(summary.free_blocks == _num_free_blocks());
+        REQUIRE(summary.free_bytes == _num_free_bytes());
+        REQUIRE(summary.largest == _largest_free_block());
+
+        ptrs[slot] = smalloc(size);
+        REQUIRE(ptrs[slot] != nullptr);
+        if (summary.best_fit != nullptr) {
+            REQUIRE(ptrs[slot] == summary.best_fit);
+        }
+    }
+
+    for (size_t slot = 0; slot < slots; slot++) {
+        sfree(ptrs[slot]);
+    }
+    REQUIRE(_num_free_blocks() == 1);
+}
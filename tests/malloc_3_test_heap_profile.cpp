@@ -0,0 +1,144 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <signal.h>
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+static std::string dumpProfile()
+{
+    char path[] = "/tmp/malloc_3_profile_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd != -1);
+    REQUIRE(_heap_profile_dump(fd) == 0);
+
+    std::string text;
+    char buf[4096];
+    ssize_t got;
+    lseek(fd, 0, SEEK_SET);
+    while ((got = read(fd, buf, sizeof(buf))) > 0)
+    {
+        text.append(buf, got);
+    }
+    close(fd);
+    unlink(path);
+    return text;
+}
+
+TEST_CASE("Heap profile disabled", "[malloc3]")
+{
+    void *a = smalloc(1000);
+    sfree(a);
+    REQUIRE(_heap_profile_samples() == 0);
+}
+
+TEST_CASE("Heap profile samples", "[malloc3]")
+{
+    /*a period of 1 byte samples every allocation*/
+    REQUIRE(_heap_profile_start(1) == 0);
+
+    void *a = smalloc(100);
+    void *b = smalloc(MMAP_THRESHOLD);
+    void *c = scalloc(10, 10);
+    REQUIRE(_heap_profile_samples() == 3);
+
+    sfree(b);
+    REQUIRE(_heap_profile_samples() == 2);
+
+    /*grows in place into the wilderness, the sample moves along*/
+    c = srealloc(c, 5000);
+    REQUIRE(c != nullptr);
+    REQUIRE(_heap_profile_samples() == 2);
+
+    /*has to move, the old sample goes away with the old block*/
+    a = srealloc(a, 10000);
+    REQUIRE(_heap_profile_samples() == 2);
+
+    void *d = smemalign(256, 300);
+    REQUIRE(_heap_profile_samples() == 3);
+
+    _heap_profile_stop();
+    void *e = smalloc(100);
+    REQUIRE(_heap_profile_samples() == 3);
+
+    sfree(a);
+    sfree(c);
+    sfree(d);
+    sfree(e);
+    REQUIRE(_heap_profile_samples() == 0);
+}
+
+TEST_CASE("Heap profile dump", "[malloc3]")
+{
+    REQUIRE(_heap_profile_start(1) == 0);
+    void *a = smalloc(100);
+    void *b = smalloc(200);
+    sfree(b);
+
+    std::string text = dumpProfile();
+    /*one object of 100 bytes still in use, two allocated in total*/
+    REQUIRE(text.rfind("heap profile:      1:      100 [     2:      300] @ heap_v2/1\n", 0) == 0);
+    REQUIRE(text.find("\nMAPPED_LIBRARIES:\n") != std::string::npos);
+    REQUIRE(text.find("[stack]") != std::string::npos);
+    sfree(a);
+}
+
+TEST_CASE("Heap profile dump on signal", "[malloc3]")
+{
+    char prefix[] = "/tmp/malloc_3_signal_XXXXXX";
+    int fd = mkstemp(prefix);
+    REQUIRE(fd != -1);
+    close(fd);
+    unlink(prefix);
+
+    REQUIRE(_heap_profile_dump_on_signal(SIGUSR2, prefix) == 0);
+    raise(SIGUSR2);
+    /*the dump happens on the next allocation, even with the profiler off*/
+    void *a = smalloc(16);
+
+    std::string path = std::string(prefix) + ".0000.heap";
+    FILE *dump = fopen(path.c_str(), "r");
+    REQUIRE(dump != nullptr);
+    char header[32] = {};
+    REQUIRE(fgets(header, sizeof(header), dump) != nullptr);
+    REQUIRE(strncmp(header, "heap profile:", 13) == 0);
+    fclose(dump);
+    unlink(path.c_str());
+    sfree(a);
+}
@@ -0,0 +1,166 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+struct WalkedBlock
+{
+    void *ptr;
+    size_t size;
+    bool is_free;
+    bool is_mmapped;
+};
+
+struct WalkLog
+{
+    WalkedBlock blocks[16];
+    size_t count;
+    size_t stop_after;
+};
+
+static int logBlock(void *ptr, size_t size, bool is_free, bool is_mmapped, void *ctx)
+{
+    WalkLog *log = (WalkLog *)ctx;
+    log->blocks[log->count++] = WalkedBlock{ptr, size, is_free, is_mmapped};
+    return log->count == log->stop_after;
+}
+
+TEST_CASE("Heap walk", "[malloc3]")
+{
+    WalkLog log = {};
+    REQUIRE(_heap_walk(logBlock, &log) == 0);
+
+    char *a = (char *)smalloc(100);
+    char *b = (char *)smalloc(200);
+    char *c = (char *)smalloc(300);
+    char *large = (char *)smalloc(MMAP_THRESHOLD);
+    REQUIRE(large != nullptr);
+    sfree(b);
+
+    REQUIRE(_heap_walk(logBlock, &log) == 4);
+    REQUIRE(log.count == 4);
+    REQUIRE(log.blocks[0].ptr == a);
+    REQUIRE(log.blocks[0].size == aligned_size(100));
+    REQUIRE(!log.blocks[0].is_free);
+    REQUIRE(log.blocks[1].ptr == b);
+    REQUIRE(log.blocks[1].size == aligned_size(200));
+    REQUIRE(log.blocks[1].is_free);
+    REQUIRE(log.blocks[2].ptr == c);
+    REQUIRE(!log.blocks[2].is_mmapped);
+    REQUIRE(log.blocks[3].ptr == large);
+    REQUIRE(log.blocks[3].size == MMAP_THRESHOLD);
+    REQUIRE(log.blocks[3].is_mmapped);
+
+    size_t free_blocks = 0, free_bytes = 0;
+    for (size_t i = 0; i < log.count; i++)
+    {
+        free_blocks += log.blocks[i].is_free;
+        free_bytes += log.blocks[i].is_free ? log.blocks[i].size : 0;
+    }
+    REQUIRE(free_blocks == _num_free_blocks());
+    REQUIRE(free_bytes == _num_free_bytes());
+
+    log = WalkLog{};
+    log.stop_after = 2;
+    REQUIRE(_heap_walk(logBlock, &log) == 2);
+    REQUIRE(log.blocks[1].ptr == b);
+
+    sfree(a);
+    sfree(c);
+    sfree(large);
+    log = WalkLog{};
+    REQUIRE(_heap_walk(logBlock, &log) == 1);
+    REQUIRE(log.blocks[0].is_free);
+    REQUIRE(log.blocks[0].size == _num_free_bytes());
+}
+
+TEST_CASE("Heap walk in steps", "[malloc3]")
+{
+    WalkLog log = {};
+    REQUIRE(_heap_walk_step(logBlock, &log, 4) == 0);
+
+    char *blocks[6];
+    for (int i = 0; i < 6; i++)
+    {
+        blocks[i] = (char *)smalloc(100 * (i + 1));
+    }
+    char *large = (char *)smalloc(MMAP_THRESHOLD);
+    REQUIRE(large != nullptr);
+
+    REQUIRE(_heap_walk_step(logBlock, &log, 2) == 2);
+    REQUIRE(_heap_walk_step(logBlock, &log, 3) == 3);
+    REQUIRE(_heap_walk_step(logBlock, &log, 3) == 2);
+    REQUIRE(_heap_walk_step(logBlock, &log, 3) == 0);
+    REQUIRE(log.count == 7);
+    for (int i = 0; i < 6; i++)
+    {
+        REQUIRE(log.blocks[i].ptr == blocks[i]);
+    }
+    REQUIRE(log.blocks[6].ptr == large);
+
+    /*the allocator runs between steps: the cursor stands on blocks[3] when it is merged away*/
+    log = WalkLog{};
+    REQUIRE(_heap_walk_step(logBlock, &log, 3) == 3);
+    sfree(blocks[3]);
+    sfree(blocks[2]);
+    sfree(large);
+    REQUIRE(_heap_walk_step(logBlock, &log, 16) == 2);
+    REQUIRE(_heap_walk_step(logBlock, &log, 16) == 0);
+    REQUIRE(log.count == 5);
+    REQUIRE(log.blocks[3].ptr == blocks[4]);
+    REQUIRE(log.blocks[4].ptr == blocks[5]);
+
+    /*a walk left half way starts over after a rewind*/
+    log = WalkLog{};
+    REQUIRE(_heap_walk_step(logBlock, &log, 1) == 1);
+    _heap_walk_rewind();
+    REQUIRE(_heap_walk_step(logBlock, &log, 1) == 1);
+    REQUIRE(log.blocks[1].ptr == blocks[0]);
+
+    /*a callback that stops the walk ends the step, the next one goes on after that block*/
+    _heap_walk_rewind();
+    log = WalkLog{};
+    log.stop_after = 1;
+    REQUIRE(_heap_walk_step(logBlock, &log, 16) == 1);
+    REQUIRE(_heap_walk_step(logBlock, &log, 16) == 4);
+    REQUIRE(log.blocks[1].ptr == blocks[1]);
+
+    for (int i : {0, 1, 4, 5})
+    {
+        sfree(blocks[i]);
+    }
+}
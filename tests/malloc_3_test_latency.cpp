@@ -0,0 +1,95 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("Latency paths", "[malloc3]")
+{
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_ANY_PATH) == 0);
+
+    void *a = smalloc(1000);
+    void *b = smalloc(16);
+    REQUIRE(b != nullptr);
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_PATH_SBRK) == 2);
+
+    sfree(a);
+    REQUIRE(_latency_count(LATENCY_SFREE, LATENCY_PATH_FREE) == 1);
+
+    /*small enough to leave a split off part behind*/
+    a = smalloc(100);
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_PATH_SPLIT) == 1);
+    void *c = smalloc(800);
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_PATH_BIN_HIT) == 1);
+
+    void *large = smalloc(MMAP_THRESHOLD);
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_PATH_MMAP) == 1);
+    sfree(large);
+    REQUIRE(_latency_count(LATENCY_SFREE, LATENCY_PATH_MUNMAP) == 1);
+
+    /*the smalloc and sfree inside srealloc are not counted on their own*/
+    a = srealloc(a, 2000);
+    REQUIRE(_latency_count(LATENCY_SREALLOC, LATENCY_ANY_PATH) == 1);
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_ANY_PATH) == 5);
+    REQUIRE(_latency_count(LATENCY_SFREE, LATENCY_ANY_PATH) == 2);
+
+    sfree(a);
+    sfree(b);
+    sfree(c);
+    REQUIRE(_latency_count(LATENCY_SFREE, LATENCY_ANY_PATH) == 5);
+}
+
+TEST_CASE("Latency percentiles", "[malloc3]")
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        sfree(smalloc(64));
+    }
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_ANY_PATH) == 1000);
+
+    unsigned long long p50 = _latency_percentile(LATENCY_SMALLOC, LATENCY_ANY_PATH, 50);
+    unsigned long long p99 = _latency_percentile(LATENCY_SMALLOC, LATENCY_ANY_PATH, 99);
+    unsigned long long p9999 = _latency_percentile(LATENCY_SMALLOC, LATENCY_ANY_PATH, 99.99);
+    REQUIRE(p50 > 0);
+    REQUIRE(p50 <= p99);
+    REQUIRE(p99 <= p9999);
+    REQUIRE(p9999 <= _latency_max(LATENCY_SMALLOC, LATENCY_ANY_PATH));
+    REQUIRE(_latency_percentile(LATENCY_SMALLOC, LATENCY_ANY_PATH, 100) == _latency_max(LATENCY_SMALLOC, LATENCY_ANY_PATH));
+
+    _latency_reset();
+    REQUIRE(_latency_count(LATENCY_SMALLOC, LATENCY_ANY_PATH) == 0);
+    REQUIRE(_latency_percentile(LATENCY_SMALLOC, LATENCY_ANY_PATH, 50) == 0);
+}
@@ -0,0 +1,142 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("smemalign", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(16);
+    REQUIRE(a != nullptr);
+
+    char *b = (char *)smemalign(256, 100);
+    REQUIRE(b != nullptr);
+    REQUIRE((size_t)b % 256 == 0);
+    verify_size(base);
+    for (int i = 0; i < 100; i++)
+    {
+        b[i] = (char)i;
+    }
+
+    char *c = (char *)smalloc(16);
+    REQUIRE(c != nullptr);
+    verify_size(base);
+
+    sfree(b);
+    sfree(a);
+    sfree(c);
+    REQUIRE(_num_free_blocks() == 1);
+    REQUIRE(_num_free_bytes() == _num_allocated_bytes());
+    verify_size(base);
+}
+
+TEST_CASE("smemalign already aligned", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    char *a = (char *)smemalign(8, 10);
+    REQUIRE(a != nullptr);
+    verify_blocks(1, 16, 0, 0);
+    verify_size(base);
+    sfree(a);
+    verify_blocks(1, 16, 1, 16);
+}
+
+TEST_CASE("smemalign invalid", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    REQUIRE(smemalign(0, 10) == nullptr);
+    REQUIRE(smemalign(24, 10) == nullptr);
+    REQUIRE(smemalign(64, 0) == nullptr);
+    REQUIRE(smemalign(64, MAX_ALLOCATION_SIZE + 1) == nullptr);
+    verify_blocks(0, 0, 0, 0);
+}
+
+TEST_CASE("smemalign mmap", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    char *a = (char *)smemalign(8192, MMAP_THRESHOLD);
+    REQUIRE(a != nullptr);
+    REQUIRE((size_t)a % 8192 == 0);
+    REQUIRE(_num_allocated_blocks() == 1);
+    REQUIRE(_num_allocated_bytes() >= MMAP_THRESHOLD);
+    verify_size_with_large_blocks(base, 0);
+    a[0] = 1;
+    a[MMAP_THRESHOLD - 1] = 1;
+
+    char *b = (char *)smemalign(64, MMAP_THRESHOLD);
+    REQUIRE(b != nullptr);
+    REQUIRE((size_t)b % 64 == 0);
+    REQUIRE(_num_allocated_blocks() == 2);
+
+    sfree(a);
+    sfree(b);
+    verify_blocks(0, 0, 0, 0);
+    verify_size_with_large_blocks(base, 0);
+}
+
+TEST_CASE("smemalign header fills the gap", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(8);
+    REQUIRE(a != nullptr);
+
+    /*pad so that the next block's data sits 16 bytes past a 32 byte boundary,
+     *then a header right in front of it would end exactly on the boundary*/
+    size_t pad = (16 - ((size_t)a + 8 + _size_meta_data() + _size_meta_data()) % 32 + 32) % 32;
+    pad = pad == 0 ? 32 : pad;
+    char *b = (char *)smalloc(pad);
+    REQUIRE(b != nullptr);
+    REQUIRE(((size_t)b + pad + _size_meta_data()) % 32 == 16);
+
+    char *c = (char *)smemalign(32, 40);
+    REQUIRE(c != nullptr);
+    REQUIRE((size_t)c % 32 == 0);
+    verify_size(base);
+
+    /*the front part is a real free block, never an empty one*/
+    verify_blocks(4, 8 + pad + 32 + 40, 1, 32);
+
+    sfree(c);
+    sfree(b);
+    sfree(a);
+    REQUIRE(_num_free_blocks() == 1);
+    verify_size(base);
+}
@@ -0,0 +1,97 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("sfree ignores foreign pointers", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *a = (char *)smalloc(100);
+    REQUIRE(a != nullptr);
+    verify_blocks(1, 100, 0, 0);
+
+    long on_stack[16] = {0};
+    sfree(&on_stack[8]);
+    verify_blocks(1, 100, 0, 0);
+    REQUIRE(susable_size(&on_stack[8]) == 0);
+
+    char *foreign = (char *)mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    REQUIRE(foreign != MAP_FAILED);
+    memset(foreign, 0, 4096);
+    sfree(foreign + 64);
+    verify_blocks(1, 100, 0, 0);
+    REQUIRE(susable_size(foreign + 64) == 0);
+    munmap(foreign, 4096);
+
+    sfree(a);
+    verify_blocks(1, 100, 1, 100);
+    verify_size(base);
+}
+
+TEST_CASE("sfree of mmapped blocks needs their start", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *big = (char *)smalloc(MMAP_THRESHOLD);
+    REQUIRE(big != nullptr);
+    verify_blocks(1, MMAP_THRESHOLD, 0, 0);
+
+    sfree(big + 4096);
+    verify_blocks(1, MMAP_THRESHOLD, 0, 0);
+    REQUIRE(susable_size(big + 4096) == 0);
+    REQUIRE(susable_size(big) == MMAP_THRESHOLD);
+
+    sfree(big);
+    verify_blocks(0, 0, 0, 0);
+
+    /*the pages are gone, a second free must not touch them*/
+    sfree(big);
+    verify_blocks(0, 0, 0, 0);
+
+    char *aligned = (char *)smemalign(8192, MMAP_THRESHOLD);
+    REQUIRE(aligned != nullptr);
+    REQUIRE((size_t)aligned % 8192 == 0);
+    sfree(aligned);
+    sfree(aligned);
+    verify_blocks(0, 0, 0, 0);
+    verify_size_with_large_blocks(base, 0);
+}
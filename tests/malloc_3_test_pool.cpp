@@ -0,0 +1,128 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+#include "object_pool.h"
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+struct Point
+{
+    long x;
+    long y;
+    long z;
+    Point(long x, long y, long z) : x(x), y(y), z(z) {}
+};
+
+TEST_CASE("Pool allocate", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    {
+        ObjectPool<Point, 4096> pool;
+        Point *a = pool.create(1, 2, 3);
+        REQUIRE(a != nullptr);
+        REQUIRE(a->x == 1);
+        REQUIRE(a->z == 3);
+        Point *b = pool.create(4, 5, 6);
+        REQUIRE(b != nullptr);
+        REQUIRE(b != a);
+        REQUIRE((size_t)b - (size_t)a == sizeof(Point));
+        REQUIRE(a->x == 1);
+
+        REQUIRE(pool.num_chunks() == 1);
+        REQUIRE(pool.num_live_objects() == 2);
+        REQUIRE(_num_pool_chunks() == 1);
+        REQUIRE(_num_pool_bytes() == 4096);
+        verify_size(base);
+
+        pool.destroy(a);
+        pool.destroy(b);
+        REQUIRE(pool.num_live_objects() == 0);
+        /* The last chunk is kept around */
+        REQUIRE(_num_pool_chunks() == 1);
+    }
+    REQUIRE(_num_pool_chunks() == 0);
+    REQUIRE(_num_pool_bytes() == 0);
+    REQUIRE(_num_free_bytes() == _num_allocated_bytes());
+    verify_size(base);
+}
+
+TEST_CASE("Pool reuse", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    ObjectPool<Point, 4096> pool;
+    Point *a = pool.create(1, 2, 3);
+    Point *b = pool.create(1, 2, 3);
+    Point *c = pool.create(1, 2, 3);
+    REQUIRE(c != nullptr);
+
+    pool.destroy(b);
+    pool.destroy(a);
+    REQUIRE(pool.create(0, 0, 0) == a);
+    REQUIRE(pool.create(0, 0, 0) == b);
+    REQUIRE(pool.num_live_objects() == 3);
+}
+
+TEST_CASE("Pool releases empty chunks", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    typedef ObjectPool<Point, 4096> PointPool;
+    const size_t count = 3 * PointPool::OBJECTS_PER_CHUNK;
+    Point *points[count];
+
+    PointPool pool;
+    for (size_t i = 0; i < count; i++)
+    {
+        points[i] = pool.create((long)i, 0, 0);
+        REQUIRE(points[i] != nullptr);
+        REQUIRE((size_t)points[i] % alignof(Point) == 0);
+    }
+    REQUIRE(pool.num_chunks() == 3);
+    REQUIRE(_num_pool_chunks() == 3);
+    REQUIRE(_num_pool_bytes() == 3 * 4096);
+    size_t allocated_blocks = _num_allocated_blocks();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        REQUIRE(points[i]->x == (long)i);
+        pool.destroy(points[i]);
+    }
+    REQUIRE(pool.num_chunks() == 1);
+    REQUIRE(_num_pool_chunks() == 1);
+    REQUIRE(_num_pool_bytes() == 4096);
+    REQUIRE(_num_free_blocks() > 0);
+    REQUIRE(_num_allocated_blocks() <= allocated_blocks);
+}
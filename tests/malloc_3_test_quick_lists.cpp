@@ -0,0 +1,144 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+/* Only built with -DMALLOC_QUICK_LISTS, for the block sizes 24, 48, 96 and 256 */
+
+TEST_CASE("Quick-listed blocks do not merge", "[malloc3_quick]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *a = (char *)smalloc(24);
+    char *b = (char *)smalloc(24);
+    char *c = (char *)smalloc(40);
+    REQUIRE(c != nullptr);
+
+    sfree(a);
+    sfree(b);
+    verify_blocks(3, 24 * 2 + 40, 2, 24 * 2);
+
+    /*last in, first out*/
+    REQUIRE(smalloc(24) == b);
+    REQUIRE(smalloc(17) == a);
+    verify_blocks(3, 24 * 2 + 40, 0, 0);
+
+    /*other sizes still merge*/
+    char *d = (char *)smalloc(40);
+    REQUIRE(d != nullptr);
+    sfree(c);
+    sfree(d);
+    verify_blocks(3, 24 * 2 + 40 * 2 + _size_meta_data(), 1, 40 * 2 + _size_meta_data());
+    verify_size(base);
+}
+
+TEST_CASE("Quick lists merge before the heap grows", "[malloc3_quick]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+
+    char *blocks[4];
+    for (int i = 0; i < 4; i++) {
+        blocks[i] = (char *)smalloc(96);
+        REQUIRE(blocks[i] != nullptr);
+    }
+    char *guard = (char *)smalloc(40);
+    REQUIRE(guard != nullptr);
+
+    for (int i = 0; i < 4; i++) {
+        sfree(blocks[i]);
+    }
+    verify_blocks(5, 96 * 4 + 40, 4, 96 * 4);
+
+    /*nothing fits 300 bytes until the four 96 byte blocks merge*/
+    char *merged = (char *)smalloc(300);
+    REQUIRE(merged == blocks[0]);
+    verify_size(base);
+    /*the merged block was big enough to split off the rest*/
+    REQUIRE(_num_free_blocks() == 1);
+    REQUIRE(_num_free_bytes() == 96 * 4 + 3 * _size_meta_data() - 304 - _size_meta_data());
+}
+
+TEST_CASE("A full quick list is consolidated", "[malloc3_quick]")
+{
+    const int count = 70;
+    char *blocks[count];
+    for (int i = 0; i < count; i++) {
+        blocks[i] = (char *)smalloc(48);
+        REQUIRE(blocks[i] != nullptr);
+    }
+    char *guard = (char *)smalloc(40);
+    REQUIRE(guard != nullptr);
+
+    for (int i = 0; i < 64; i++) {
+        sfree(blocks[i]);
+    }
+    REQUIRE(_num_free_blocks() == 64);
+    REQUIRE(_num_free_bytes() == 64 * 48);
+
+    /*the 65th push merges the first 64 into one block*/
+    sfree(blocks[64]);
+    REQUIRE(_num_free_blocks() == 2);
+    REQUIRE(_num_free_bytes() == 64 * 48 + 63 * _size_meta_data() + 48);
+
+    /*double frees of quick-listed blocks are ignored*/
+    sfree(blocks[64]);
+    REQUIRE(_num_free_blocks() == 2);
+}
+
+TEST_CASE("Consolidated quick lists are trimmed", "[malloc3_quick]")
+{
+    const int count = 65;
+    char *blocks[count];
+    for (int i = 0; i < count; i++) {
+        blocks[i] = (char *)smalloc(48);
+        REQUIRE(blocks[i] != nullptr);
+    }
+
+    /*sfree does not trim quick-listed blocks, the consolidation does*/
+    REQUIRE(smallopt(SMALLOPT_TRIM_THRESHOLD, 0) == 1);
+    void *top = sbrk(0);
+    for (int i = count - 1; i > 0; i--) {
+        sfree(blocks[i]);
+    }
+    REQUIRE(sbrk(0) == top);
+
+    /*the trimmed top block keeps its header*/
+    sfree(blocks[0]);
+    REQUIRE((char *)sbrk(0) == blocks[1]);
+}
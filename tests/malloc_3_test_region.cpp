@@ -0,0 +1,141 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("Region bump", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    Region *r = sregion_create(1024);
+    REQUIRE(r != nullptr);
+    REQUIRE(_num_region_chunks() == 0);
+    size_t header_size = _num_allocated_bytes();
+
+    char *a = (char *)sregion_alloc(r, 10);
+    REQUIRE(a != nullptr);
+    char *b = (char *)sregion_alloc(r, 10);
+    REQUIRE(b != nullptr);
+    REQUIRE(b == a + aligned_size(10));
+    REQUIRE((size_t)a % 8 == 0);
+    REQUIRE(_num_region_chunks() == 1);
+    REQUIRE(_num_region_bytes() == 2 * aligned_size(10));
+    REQUIRE(_num_allocated_blocks() == 2);
+    REQUIRE(_num_allocated_bytes() > header_size + 1024);
+    verify_size(base);
+
+    sregion_destroy(r);
+    REQUIRE(_num_region_chunks() == 0);
+    REQUIRE(_num_region_bytes() == 0);
+    REQUIRE(_num_free_blocks() == 1);
+    REQUIRE(_num_free_bytes() == _num_allocated_bytes());
+    verify_size(base);
+}
+
+TEST_CASE("Region reset", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    Region *r = sregion_create(256);
+    REQUIRE(r != nullptr);
+
+    char *first = (char *)sregion_alloc(r, 48);
+    REQUIRE(first != nullptr);
+    for (int i = 0; i < 20; i++)
+    {
+        REQUIRE(sregion_alloc(r, 48) != nullptr);
+    }
+    REQUIRE(_num_region_chunks() > 1);
+    REQUIRE(_num_region_bytes() == 21 * 48);
+
+    sregion_reset(r);
+    REQUIRE(_num_region_chunks() == 1);
+    REQUIRE(_num_region_bytes() == 0);
+    REQUIRE(_num_free_blocks() > 0);
+    verify_size(base);
+
+    char *again = (char *)sregion_alloc(r, 48);
+    REQUIRE(again != nullptr);
+    REQUIRE(_num_region_chunks() == 1);
+    REQUIRE(_num_region_bytes() == 48);
+
+    sregion_destroy(r);
+    REQUIRE(_num_region_chunks() == 0);
+    REQUIRE(_num_free_bytes() == _num_allocated_bytes());
+    verify_size(base);
+}
+
+TEST_CASE("Region large allocation", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    Region *r = sregion_create(1024);
+    REQUIRE(r != nullptr);
+
+    char *a = (char *)sregion_alloc(r, 16);
+    REQUIRE(a != nullptr);
+    char *big = (char *)sregion_alloc(r, 2000);
+    REQUIRE(big != nullptr);
+    REQUIRE(_num_region_chunks() == 2);
+
+    /* The large request got its own chunk, bumping continues where it was */
+    char *b = (char *)sregion_alloc(r, 16);
+    REQUIRE(b == a + 16);
+    REQUIRE(_num_region_bytes() == 16 + 2000 + 16);
+
+    sregion_reset(r);
+    REQUIRE(_num_region_chunks() == 1);
+    REQUIRE(sregion_alloc(r, 16) == a);
+
+    sregion_destroy(r);
+    REQUIRE(_num_region_chunks() == 0);
+    REQUIRE(_num_region_bytes() == 0);
+}
+
+TEST_CASE("Region invalid", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    Region *r = sregion_create(0);
+    REQUIRE(r != nullptr);
+    REQUIRE(sregion_alloc(r, 0) == nullptr);
+    REQUIRE(sregion_alloc(r, MAX_ALLOCATION_SIZE + 1) == nullptr);
+    REQUIRE(sregion_alloc(nullptr, 10) == nullptr);
+    REQUIRE(_num_region_chunks() == 0);
+    sregion_reset(r);
+    sregion_destroy(r);
+    sregion_destroy(nullptr);
+    REQUIRE(_num_free_bytes() == _num_allocated_bytes());
+}
@@ -0,0 +1,172 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+#include "smalloc_resource.h"
+
+#include <map>
+#include <memory_resource>
+#include <unistd.h>
+#include <vector>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("Resource allocate", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    void *base = sbrk(0);
+    std::pmr::memory_resource *resource = smalloc_resource();
+
+    void *a = resource->allocate(100);
+    REQUIRE(a != nullptr);
+    /*the default alignment is that of max_align_t, 16 bytes on x86-64*/
+    REQUIRE((size_t)a % alignof(std::max_align_t) == 0);
+    REQUIRE(susable_size(a) >= 100);
+    verify_size(base);
+
+    /*stricter alignments go through smemalign*/
+    void *b = resource->allocate(100, 64);
+    REQUIRE(b != nullptr);
+    REQUIRE((size_t)b % 64 == 0);
+    verify_size(base);
+
+    /*0 bytes is a legal request*/
+    void *c = resource->allocate(0);
+    REQUIRE(c != nullptr);
+
+    resource->deallocate(a, 100);
+    resource->deallocate(b, 100, 64);
+    resource->deallocate(c, 0);
+    REQUIRE(_num_free_blocks() == 1);
+    REQUIRE(_num_free_bytes() + _num_meta_data_bytes() == (size_t)sbrk(0) - (size_t)base);
+
+    SmallocResource other;
+    REQUIRE(resource->is_equal(other));
+    REQUIRE_FALSE(resource->is_equal(*std::pmr::new_delete_resource()));
+}
+
+TEST_CASE("Resource containers", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    {
+        std::pmr::vector<long> numbers(smalloc_resource());
+        for (long i = 0; i < 1000; i++)
+        {
+            numbers.push_back(i);
+        }
+        REQUIRE(susable_size(numbers.data()) >= 1000 * sizeof(long));
+
+        std::pmr::map<int, long> squares(smalloc_resource());
+        for (int i = 0; i < 100; i++)
+        {
+            squares[i] = numbers[i] * numbers[i];
+        }
+        REQUIRE(squares[99] == 99 * 99);
+        REQUIRE(_num_allocated_blocks() - _num_free_blocks() == 101);
+    }
+
+    REQUIRE(_num_allocated_blocks() - _num_free_blocks() == 0);
+}
+
+struct alignas(64) CacheLine
+{
+    char bytes[64];
+};
+
+TEST_CASE("Allocator", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    SmallocAllocator<long> allocator;
+    long *a = allocator.allocate(10);
+    REQUIRE(a != nullptr);
+    verify_blocks(1, 80, 0, 0);
+    allocator.deallocate(a, 10);
+    verify_blocks(1, 80, 1, 80);
+
+    SmallocAllocator<CacheLine> lines(allocator);
+    CacheLine *b = lines.allocate(3);
+    REQUIRE((size_t)b % 64 == 0);
+    lines.deallocate(b, 3);
+
+    REQUIRE(allocator == lines);
+    REQUIRE_FALSE(allocator != lines);
+    REQUIRE_THROWS_AS(allocator.allocate((size_t)-1 / sizeof(long) + 1), std::bad_array_new_length);
+    REQUIRE_THROWS_AS(allocator.allocate(MAX_ALLOCATION_SIZE), std::bad_alloc);
+
+    {
+        std::vector<int, SmallocAllocator<int>> numbers;
+        std::map<int, int, std::less<int>, SmallocAllocator<std::pair<const int, int>>> squares;
+        for (int i = 0; i < 100; i++)
+        {
+            numbers.push_back(i);
+            squares[i] = i * i;
+        }
+        REQUIRE(numbers[42] == 42);
+        REQUIRE(squares[42] == 42 * 42);
+        REQUIRE(_num_allocated_blocks() - _num_free_blocks() == 101);
+    }
+    REQUIRE(_num_allocated_blocks() - _num_free_blocks() == 0);
+}
+
+TEST_CASE("Allocator reallocate", "[malloc3]")
+{
+    verify_blocks(0, 0, 0, 0);
+    SmallocAllocator<int> allocator;
+    int *a = allocator.allocate(4);
+    for (int i = 0; i < 4; i++)
+    {
+        a[i] = i;
+    }
+
+    /*the only block is the wilderness, so it grows where it is*/
+    int *b = allocator.reallocate(a, 1000);
+    REQUIRE(b == a);
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(b[i] == i);
+    }
+    verify_blocks(1, 4000, 0, 0);
+
+    REQUIRE_THROWS_AS(allocator.reallocate(b, MAX_ALLOCATION_SIZE), std::bad_alloc);
+    REQUIRE(b[3] == 3);
+
+    /*shrinking copies, so the block can be freed by its new size*/
+    int *c = allocator.reallocate(b, 2);
+    REQUIRE(c != b);
+    REQUIRE(c[1] == 1);
+    size_t c_size = susable_size(c);
+    verify_blocks(2, 4000 + c_size, 1, 4000);
+
+    allocator.deallocate(c, 2);
+    verify_blocks(1, 4000 + _size_meta_data() + c_size, 1, 4000 + _size_meta_data() + c_size);
+}
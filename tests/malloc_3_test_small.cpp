@@ -0,0 +1,168 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+#define SMALL_MAX_SIZE (128)
+#define SMALL_PAGE_SIZE (4096)
+#define SMALL_SPAN_PAGES (16)
+
+TEST_CASE("Small objects are packed without headers", "[malloc3_small]")
+{
+    REQUIRE(_num_small_pages() == 0);
+
+    char *a = (char *)smalloc(24);
+    char *b = (char *)smalloc(17);
+    REQUIRE(a != nullptr);
+    REQUIRE(b == a + 24);
+    REQUIRE(susable_size(a) == 24);
+    REQUIRE(_num_small_pages() == 1);
+    REQUIRE(_num_small_objects() == 2);
+
+    /*the main heap only sees the page*/
+    REQUIRE(_num_allocated_blocks() >= 1);
+    REQUIRE(_num_allocated_bytes() >= SMALL_PAGE_SIZE);
+    REQUIRE((size_t)a / SMALL_PAGE_SIZE == (size_t)b / SMALL_PAGE_SIZE);
+
+    size_t free_slots = _num_small_free_slots();
+    sfree(a);
+    REQUIRE(_num_small_free_slots() == free_slots + 1);
+    REQUIRE(_num_small_objects() == 1);
+
+    char *c = (char *)smalloc(20);
+    REQUIRE(c == a);
+
+    /*repeated and interior frees are ignored*/
+    sfree(b);
+    sfree(b);
+    sfree(c + 8);
+    REQUIRE(_num_small_objects() == 1);
+    sfree(c);
+    REQUIRE(_num_small_objects() == 0);
+
+    /*the last page of a class is kept*/
+    REQUIRE(_num_small_pages() == 1);
+}
+
+TEST_CASE("Empty small spans go back to the heap", "[malloc3_small]")
+{
+    /*31 objects of 128 bytes fit a page, so these need two spans of 16 pages*/
+    const int count = 600;
+    static char *objects[count];
+    for (int i = 0; i < count; i++) {
+        objects[i] = (char *)smalloc(SMALL_MAX_SIZE);
+        REQUIRE(objects[i] != nullptr);
+        memset(objects[i], i, SMALL_MAX_SIZE);
+    }
+
+    REQUIRE(_num_small_pages() >= SMALL_SPAN_PAGES + 1);
+    REQUIRE(_num_small_spans() == 2);
+    size_t free_bytes = _num_free_bytes();
+
+    for (int i = 0; i < count; i++) {
+        REQUIRE(objects[i][SMALL_MAX_SIZE - 1] == (char)i);
+        sfree(objects[i]);
+    }
+
+    /*the span of the last page of the class stays*/
+    REQUIRE(_num_small_pages() == 1);
+    REQUIRE(_num_small_spans() == 1);
+    REQUIRE(_num_small_objects() == 0);
+    REQUIRE(_num_free_bytes() >= free_bytes + SMALL_SPAN_PAGES * SMALL_PAGE_SIZE - _size_meta_data());
+
+    /*larger requests still come from the main heap*/
+    char *big = (char *)smalloc(SMALL_MAX_SIZE + 1);
+    REQUIRE(big != nullptr);
+    REQUIRE(susable_size(big) >= SMALL_MAX_SIZE + 8);
+    REQUIRE(_num_small_objects() == 0);
+    sfree(big);
+}
+
+TEST_CASE("Small spans follow each other without a gap", "[malloc3_small]")
+{
+    /*62 objects of 64 bytes fit a page: these fill a bit more than 4 spans*/
+    const int count = 4 * SMALL_SPAN_PAGES * 62 + 1;
+    static char *objects[count];
+    char *base = (char *)sbrk(0);
+    for (int i = 0; i < count; i++) {
+        objects[i] = (char *)smalloc(64);
+        REQUIRE(objects[i] != nullptr);
+    }
+
+    /*only the first span pays for page alignment*/
+    REQUIRE(_num_small_spans() == 5);
+    REQUIRE((size_t)((char *)sbrk(0) - base) <= 5 * SMALL_SPAN_PAGES * SMALL_PAGE_SIZE + SMALL_PAGE_SIZE);
+    REQUIRE(_num_free_bytes() < SMALL_PAGE_SIZE);
+
+    /*objects on the last page of a span, next to the following span's header, are freed too*/
+    for (int i = 0; i < count; i++) {
+        sfree(objects[i]);
+    }
+    REQUIRE(_num_small_objects() == 0);
+    REQUIRE(_num_small_spans() == 1);
+}
+
+TEST_CASE("Sized free of small objects", "[malloc3_small]")
+{
+    char *a = (char *)smalloc(24);
+    char *b = (char *)smalloc(24);
+    char *big = (char *)smalloc(SMALL_MAX_SIZE + 1);
+    REQUIRE(a != nullptr);
+    REQUIRE(b == a + 24);
+    REQUIRE(big != nullptr);
+    REQUIRE(_num_small_objects() == 2);
+
+    /*the page is found from the object's address*/
+    sfree_sized(b, 24);
+    REQUIRE(_num_small_objects() == 1);
+    REQUIRE(smalloc(17) == b);
+
+    size_t free_bytes = _num_free_bytes();
+    sfree_sized(big, SMALL_MAX_SIZE + 1);
+    REQUIRE(_num_free_bytes() > free_bytes);
+    REQUIRE(_num_small_objects() == 2);
+
+    sfree_sized(a, 24);
+    sfree_sized(b, 17);
+    REQUIRE(_num_small_objects() == 0);
+}
+
+TEST_CASE("Small objects with scalloc and srealloc", "[malloc3_small]")
+{
+    char *a = (char *)smalloc(40);
+    REQUIRE(a != nullptr);
+    memset(a, 0xab, 40);
+    sfree(a);
+
+    char *zeroed = (char *)scalloc(5, 8);
+    REQUIRE(zeroed == a);
+    for (int i = 0; i < 40; i++) {
+        REQUIRE(zeroed[i] == 0);
+    }
+
+    for (int i = 0; i < 40; i++) {
+        zeroed[i] = (char)i;
+    }
+
+    /*shrinking, or growing within the slot, keeps the object where it is*/
+    REQUIRE(srealloc(zeroed, 33) == zeroed);
+
+    char *grown = (char *)srealloc(zeroed, 100);
+    REQUIRE(grown != nullptr);
+    REQUIRE(grown != zeroed);
+    REQUIRE(susable_size(grown) == 104);
+    for (int i = 0; i < 40; i++) {
+        REQUIRE(grown[i] == (char)i);
+    }
+
+    char *large = (char *)srealloc(grown, 1000);
+    REQUIRE(large != nullptr);
+    REQUIRE(susable_size(large) == 1000);
+    for (int i = 0; i < 40; i++) {
+        REQUIRE(large[i] == (char)i);
+    }
+
+    REQUIRE(_num_small_objects() == 0);
+    sfree(large);
+}
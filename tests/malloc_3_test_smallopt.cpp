@@ -0,0 +1,254 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+#include <cstdlib>
+#include <cstring>
+
+static long smalloptValue(int param)
+{
+    long value = 0;
+    REQUIRE(_smallopt_value(param, &value) == 1);
+    return value;
+}
+
+TEST_CASE("smallopt defaults and read back", "[malloc3_smallopt]")
+{
+    REQUIRE(smalloptValue(SMALLOPT_MMAP_THRESHOLD) == MMAP_THRESHOLD);
+    REQUIRE(smalloptValue(SMALLOPT_SPLIT_THRESHOLD) == MIN_SPLIT_SIZE);
+    REQUIRE(smalloptValue(SMALLOPT_TRIM_THRESHOLD) == -1);
+    REQUIRE(smalloptValue(SMALLOPT_TOP_PAD) == 0);
+    REQUIRE(smalloptValue(SMALLOPT_ARENA_MAX) == 1);
+    REQUIRE(smalloptValue(SMALLOPT_PURGE_DECAY_MS) == -1);
+
+    REQUIRE(smallopt(SMALLOPT_MMAP_THRESHOLD, 4097) == 1);
+    REQUIRE(smalloptValue(SMALLOPT_MMAP_THRESHOLD) == (long)aligned_size(4097));
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 0) == 1);
+    REQUIRE(smalloptValue(SMALLOPT_PURGE_DECAY_MS) == 0);
+
+    /*rejected values leave the parameter alone*/
+    REQUIRE(smallopt(SMALLOPT_MMAP_THRESHOLD, 0) == 0);
+    REQUIRE(smallopt(SMALLOPT_SPLIT_THRESHOLD, -1) == 0);
+    REQUIRE(smallopt(SMALLOPT_TRIM_THRESHOLD, -2) == 0);
+    REQUIRE(smallopt(SMALLOPT_ARENA_MAX, 4) == 0);
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS + 1, 1) == 0);
+    long value = 0;
+    REQUIRE(_smallopt_value(SMALLOPT_PURGE_DECAY_MS + 1, &value) == 0);
+    REQUIRE(smalloptValue(SMALLOPT_MMAP_THRESHOLD) == (long)aligned_size(4097));
+    REQUIRE(smalloptValue(SMALLOPT_ARENA_MAX) == 1);
+}
+
+TEST_CASE("smallopt environment", "[malloc3_smallopt]")
+{
+    /*nothing has been allocated yet in this process, so setup has not read it*/
+    setenv("SMALLOC_MMAP_THRESHOLD", "8192", 1);
+    setenv("SMALLOC_SPLIT_THRESHOLD", "not a number", 1);
+    setenv("SMALLOC_ARENA_MAX", "8", 1);
+
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(8192);
+    REQUIRE(a != nullptr);
+    REQUIRE(sbrk(0) == base);
+    REQUIRE(smalloptValue(SMALLOPT_MMAP_THRESHOLD) == 8192);
+    REQUIRE(smalloptValue(SMALLOPT_SPLIT_THRESHOLD) == MIN_SPLIT_SIZE);
+    REQUIRE(smalloptValue(SMALLOPT_ARENA_MAX) == 1);
+    sfree(a);
+}
+
+TEST_CASE("smallopt live thresholds", "[malloc3_smallopt]")
+{
+    void *base = sbrk(0);
+    char *heap_block = (char *)smalloc(16384);
+    REQUIRE(heap_block != nullptr);
+
+    REQUIRE(smallopt(SMALLOPT_MMAP_THRESHOLD, 8192) == 1);
+    char *mapped = (char *)smalloc(16384);
+    REQUIRE(mapped != nullptr);
+    verify_size_with_large_blocks(base, 16384 + _size_meta_data());
+    verify_blocks(2, 16384 * 2, 0, 0);
+
+    /*each block is freed the way it was allocated*/
+    sfree(heap_block);
+    sfree(mapped);
+    verify_blocks(1, 16384, 1, 16384);
+
+    /*a larger split threshold keeps the leftover in the block*/
+    REQUIRE(smallopt(SMALLOPT_SPLIT_THRESHOLD, 16384) == 1);
+    char *a = (char *)smalloc(4096);
+    REQUIRE(a == heap_block);
+    verify_blocks(1, 16384, 0, 0);
+    sfree(a);
+}
+
+TEST_CASE("smallopt top pad and trim", "[malloc3_smallopt]")
+{
+    REQUIRE(smallopt(SMALLOPT_TOP_PAD, 4096) == 1);
+    REQUIRE(smallopt(SMALLOPT_TRIM_THRESHOLD, 8192) == 1);
+    void *base = sbrk(0);
+
+    /*the pad comes along with the first block and stays free behind it*/
+    char *a = (char *)smalloc(100);
+    REQUIRE(a != nullptr);
+    verify_blocks(2, 104 + 4096 - _size_meta_data(), 1, 4096 - _size_meta_data());
+    verify_size(base);
+
+    char *b = (char *)smalloc(64 * 1024);
+    REQUIRE(b != nullptr);
+    REQUIRE((size_t)sbrk(0) - (size_t)base >= 104 + 64 * 1024 + 4096);
+
+    /*freeing the top gives all but the pad back*/
+    sfree(b);
+    verify_blocks(2, 104 + 4096, 1, 4096);
+    verify_size(base);
+
+    /*merged with the pad the top is still under the trim threshold*/
+    sfree(a);
+    verify_blocks(1, 104 + _size_meta_data() + 4096, 1, 104 + _size_meta_data() + 4096);
+    verify_size(base);
+}
+
+TEST_CASE("smallopt purge", "[malloc3_smallopt]")
+{
+    MallocStats stats;
+    char *a = (char *)smalloc(64 * 1024);
+    char *sep = (char *)smalloc(16);
+    REQUIRE(sep != nullptr);
+    memset(a, 0xab, 64 * 1024);
+
+    _malloc_stats(&stats);
+    size_t madvise_calls = stats.madvise_calls;
+
+    sfree(a);
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls);
+
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 0) == 1);
+    a = (char *)smalloc(64 * 1024);
+    memset(a, 0xab, 64 * 1024);
+    sfree(a);
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls + 1);
+
+    /*the purged pages read back as zero*/
+    a = (char *)smalloc(64 * 1024);
+    REQUIRE(a[32 * 1024] == 0);
+    sfree(a);
+    sfree(sep);
+}
+
+TEST_CASE("smallopt purge decay", "[malloc3_smallopt]")
+{
+    MallocStats stats;
+    /*blocks[2] is bigger so that it is the one a best fit picks again*/
+    const size_t sizes[4] = {32 * 1024, 32 * 1024, 48 * 1024, 32 * 1024};
+    char *blocks[4];
+    char *seps[4];
+    for (int i = 0; i < 4; i++)
+    {
+        blocks[i] = (char *)smalloc(sizes[i]);
+        seps[i] = (char *)smalloc(16);
+        memset(blocks[i], 0xab, sizes[i]);
+    }
+
+    /*long past the last purge, so the first free purges*/
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 1) == 1);
+    _malloc_stats(&stats);
+    size_t madvise_calls = stats.madvise_calls;
+    sfree(blocks[0]);
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls + 1);
+
+    /*only the block freed since then is purged again*/
+    usleep(5000);
+    sfree(blocks[1]);
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls + 2);
+
+    /*a dirty block that is allocated again leaves the set untouched by the next purge*/
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 3600 * 1000) == 1);
+    sfree(blocks[2]);
+    char *reused = (char *)smalloc(sizes[2]);
+    REQUIRE(reused == blocks[2]);
+    memset(reused, 0xcd, sizes[2]);
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 1) == 1);
+    usleep(5000);
+    sfree(blocks[3]);
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls + 3);
+    REQUIRE(reused[sizes[2] / 2] == (char)0xcd);
+
+    sfree(reused);
+    for (int i = 0; i < 4; i++)
+    {
+        sfree(seps[i]);
+    }
+}
+
+TEST_CASE("smallopt purge decay bounds the dirty set", "[malloc3_smallopt]")
+{
+    MallocStats stats;
+    const int count = 65;
+    const size_t size = 8 * 1024;
+    char *blocks[count];
+    char *seps[count];
+    for (int i = 0; i < count; i++)
+    {
+        blocks[i] = (char *)smalloc(size);
+        seps[i] = (char *)smalloc(16);
+        memset(blocks[i], 0xab, size);
+    }
+
+    /*the first free purges, after that the decay never runs out*/
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 1) == 1);
+    sfree(seps[count - 1]);
+    REQUIRE(smallopt(SMALLOPT_PURGE_DECAY_MS, 3600 * 1000) == 1);
+
+    _malloc_stats(&stats);
+    size_t madvise_calls = stats.madvise_calls;
+    for (int i = 0; i < count - 1; i++)
+    {
+        sfree(blocks[i]);
+    }
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls);
+
+    /*the set holds 64 blocks, one more purges them early*/
+    sfree(blocks[count - 1]);
+    _malloc_stats(&stats);
+    REQUIRE(stats.madvise_calls == madvise_calls + 64);
+}
@@ -0,0 +1,103 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+#define MAX_ALLOCATION_SIZE (1e8)
+#define MMAP_THRESHOLD (128 * 1024)
+#define MIN_SPLIT_SIZE (128)
+
+static inline size_t aligned_size(size_t size)
+{
+    return (size % 8) ? (size & (size_t)(-8)) + 8 : size;
+}
+
+#define verify_blocks(allocated_blocks, allocated_bytes, free_blocks, free_bytes)                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        REQUIRE(_num_allocated_blocks() == allocated_blocks);                                                          \
+        REQUIRE(_num_allocated_bytes() == aligned_size(allocated_bytes));                                              \
+        REQUIRE(_num_free_blocks() == free_blocks);                                                                    \
+        REQUIRE(_num_free_bytes() == aligned_size(free_bytes));                                                        \
+        REQUIRE(_num_meta_data_bytes() == aligned_size(_size_meta_data() * allocated_blocks));                         \
+    } while (0)
+
+#define verify_size(base)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(_num_allocated_bytes() + aligned_size(_size_meta_data() * _num_allocated_blocks()) ==                  \
+                (size_t)after - (size_t)base);                                                                         \
+    } while (0)
+
+#define verify_size_with_large_blocks(base, diff)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        void *after = sbrk(0);                                                                                         \
+        REQUIRE(diff == (size_t)after - (size_t)base);                                                                 \
+    } while (0)
+
+TEST_CASE("Syscall counters", "[malloc3]")
+{
+    MallocStats before;
+    _malloc_stats(&before);
+    REQUIRE(before.sbrk_calls == 0);
+    REQUIRE(before.mmap_calls == 0);
+
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(100);
+    char *b = (char *)smalloc(200);
+    REQUIRE(b != nullptr);
+
+    MallocStats stats;
+    _malloc_stats(&stats);
+    /*the first call may also align the program break*/
+    REQUIRE(stats.sbrk_calls >= 2);
+    REQUIRE(stats.sbrk_bytes_grown == (size_t)sbrk(0) - (size_t)base);
+    REQUIRE(stats.sbrk_bytes_shrunk == 0);
+    REQUIRE(stats.allocated_blocks == 2);
+    REQUIRE(stats.allocated_bytes == aligned_size(100) + aligned_size(200));
+
+    /*reusing a free block needs no system call*/
+    size_t sbrk_calls = stats.sbrk_calls;
+    sfree(a);
+    a = (char *)smalloc(100);
+    _malloc_stats(&stats);
+    REQUIRE(stats.sbrk_calls == sbrk_calls);
+
+    char *large = (char *)smalloc(MMAP_THRESHOLD);
+    _malloc_stats(&stats);
+    REQUIRE(stats.mmap_calls == 1);
+    REQUIRE(stats.mmap_bytes == MMAP_THRESHOLD + _size_meta_data());
+    sfree(large);
+    _malloc_stats(&stats);
+    REQUIRE(stats.munmap_calls == 1);
+    REQUIRE(stats.munmap_bytes == stats.mmap_bytes);
+    REQUIRE(stats.madvise_calls == 0);
+
+    sfree(a);
+    sfree(b);
+}
+
+TEST_CASE("Page fault deltas", "[malloc3]")
+{
+    MallocStats stats;
+    _malloc_stats(&stats);
+
+    /*first touch of every page of a fresh mapping faults*/
+    size_t pages = 64;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char *large = (char *)smalloc(pages * page_size);
+    REQUIRE(large != nullptr);
+    memset(large, 1, pages * page_size);
+
+    _malloc_stats(&stats);
+    REQUIRE(stats.minor_faults_delta >= (long)pages);
+    REQUIRE(stats.minor_faults >= stats.minor_faults_delta);
+
+    /*nothing touched since the last snapshot*/
+    _malloc_stats(&stats);
+    REQUIRE(stats.minor_faults_delta < (long)pages);
+    sfree(large);
+}
@@ -3,10 +3,23 @@
 
 #include <stddef.h>
 
+#include "../malloc_stats.h"
+#include "../engine_variants.h"
+
 void *smalloc(size_t size);
 void *scalloc(size_t num, size_t size);
 void sfree(void *p);
 void *srealloc(void *oldp, size_t size);
+void *smemalign(size_t alignment, size_t size);
+size_t susable_size(void *p);
+
+/* malloc_3 only: sfree for a p that smalloc or scalloc returned for size bytes,
+ * it skips the ownership check sfree does (used by sized operator delete) */
+void sfree_sized(void *p, size_t size);
+
+/* malloc_1 only: srelease frees everything allocated since the smark that returned mark */
+void *smark();
+void srelease(void *mark);
 
 size_t _num_free_blocks();
 size_t _num_free_bytes();
@@ -14,5 +27,87 @@ size_t _num_allocated_blocks();
 size_t _num_allocated_bytes();
 size_t _num_meta_data_bytes();
 size_t _size_meta_data();
+size_t _largest_free_block();
+double _external_fragmentation();
+/* malloc_3 only: bytes mmapped and not yet unmapped */
+size_t _num_mapped_bytes();
+
+/* Run time tuning, the values match malloc_3.cpp. Every parameter can also be set
+ * with the environment variable of the same name with SMALLOC_ for SMALLOPT_,
+ * read when the allocator is first used */
+enum {
+    SMALLOPT_MMAP_THRESHOLD,
+    SMALLOPT_SPLIT_THRESHOLD,
+    SMALLOPT_TRIM_THRESHOLD, /* -1 never trims */
+    SMALLOPT_TOP_PAD,
+    SMALLOPT_ARENA_MAX, /* only 1 */
+    SMALLOPT_PURGE_DECAY_MS /* -1 never purges, 0 purges on every sfree */
+};
+
+int smallopt(int param, long value);
+int _smallopt_value(int param, long *value);
+
+/* Called for every block by _heap_walk, returning non zero stops the walk */
+typedef int (*heap_walk_callback)(void *ptr, size_t size, bool is_free, bool is_mmapped, void *ctx);
+size_t _heap_walk(heap_walk_callback callback, void *ctx);
+/* malloc_3 only: resumable walk, at most max_blocks per call, 0 once done.
+ * The allocator may be used between calls */
+size_t _heap_walk_step(heap_walk_callback callback, void *ctx, size_t max_blocks);
+void _heap_walk_rewind();
+
+struct Region;
+
+Region *sregion_create(size_t chunk_size);
+void *sregion_alloc(Region *region, size_t size);
+void sregion_reset(Region *region);
+void sregion_destroy(Region *region);
+
+size_t _num_region_chunks();
+size_t _num_region_bytes();
+
+size_t _num_pool_chunks();
+size_t _num_pool_bytes();
+void _pool_account(long chunks, long bytes);
+
+/* Sampling heap profiler, see _heap_profile_dump for the output format.
+ * A sample period of 0 picks the default of 512 KiB */
+int _heap_profile_start(size_t sample_period);
+void _heap_profile_stop();
+size_t _heap_profile_samples();
+int _heap_profile_dump(int fd);
+int _heap_profile_dump_on_signal(int signum, const char *path_prefix);
+
+#ifdef MALLOC_LATENCY_HIST
+/* Only in builds with -DMALLOC_LATENCY_HIST, the values match malloc_3.cpp */
+enum { LATENCY_SMALLOC, LATENCY_SCALLOC, LATENCY_SFREE, LATENCY_SREALLOC, LATENCY_SMEMALIGN };
+enum {
+    LATENCY_ANY_PATH = -1,
+    LATENCY_PATH_OTHER,
+    LATENCY_PATH_BIN_HIT,
+    LATENCY_PATH_SPLIT,
+    LATENCY_PATH_WILDERNESS,
+    LATENCY_PATH_SBRK,
+    LATENCY_PATH_MMAP,
+    LATENCY_PATH_IN_PLACE,
+    LATENCY_PATH_FREE,
+    LATENCY_PATH_MUNMAP
+};
+
+size_t _latency_count(int op, int path);
+unsigned long long _latency_percentile(int op, int path, double percentile);
+unsigned long long _latency_max(int op, int path);
+void _latency_reset();
+void _latency_report(int fd);
+#endif
+
+#ifdef MALLOC_SMALL_BITMAP
+/* Only in builds with -DMALLOC_SMALL_BITMAP: pages held by the small object
+ * classes, objects living in them, their free slots and the spans of 16 pages
+ * the pages are taken from */
+size_t _num_small_pages();
+size_t _num_small_objects();
+size_t _num_small_free_slots();
+size_t _num_small_spans();
+#endif
 
 #endif /* MY_STDLIB_H */